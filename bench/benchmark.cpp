@@ -0,0 +1,101 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <regex>
+#include <sstream>
+#include <stdexcept>
+
+namespace arm_bench {
+
+Result run_benchmark(const Benchmark& benchmark, unsigned repetitions, double scale) {
+    std::vector<double> rates;
+    for (unsigned i = 0; i < std::max(repetitions, 1u); ++i) {
+        Sample sample = benchmark.run(scale);
+        rates.push_back(static_cast<double>(sample.operations) / std::max(sample.seconds, 1e-9) / 1e6);
+    }
+    std::sort(rates.begin(), rates.end());
+    
+    Result result;
+    result.name = benchmark.name;
+    result.unit = benchmark.unit;
+    result.median = rates[rates.size() / 2];
+    result.min = rates.front();
+    result.max = rates.back();
+    return result;
+}
+
+void write_table(std::ostream& out, const std::vector<Result>& results) {
+    for (const Result& result : results) {
+        out << std::left << std::setw(32) << result.name << std::right << std::fixed
+            << std::setprecision(2) << std::setw(12) << result.median << " " << std::left
+            << std::setw(7) << result.unit << std::right << " (" << result.min << " - "
+            << result.max << ")\n";
+    }
+    out << std::defaultfloat;
+}
+
+void write_json(std::ostream& out, const std::vector<Result>& results) {
+    out << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        out << "    {\"name\": \"" << result.name << "\", \"unit\": \"" << result.unit
+            << "\", \"value\": " << result.median << ", \"min\": " << result.min
+            << ", \"max\": " << result.max << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+std::vector<Result> read_json(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Failed to open baseline: " + path);
+    }
+    std::stringstream contents;
+    contents << in.rdbuf();
+    std::string text = contents.str();
+    
+    // Only the fields compare() needs, from objects in the layout write_json uses
+    static const std::regex entry(
+        R"re("name"\s*:\s*"([^"]*)"\s*,\s*"unit"\s*:\s*"([^"]*)"\s*,\s*"value"\s*:\s*([-+0-9.eE]+))re");
+    std::vector<Result> results;
+    for (std::sregex_iterator it(text.begin(), text.end(), entry), end; it != end; ++it) {
+        Result result;
+        result.name = (*it)[1];
+        result.unit = (*it)[2];
+        result.median = result.min = result.max = std::stod((*it)[3]);
+        results.push_back(result);
+    }
+    return results;
+}
+
+size_t compare(std::ostream& out, const std::vector<Result>& baseline,
+               const std::vector<Result>& results, double threshold) {
+    size_t regressions = 0;
+    out << std::fixed << std::setprecision(2);
+    for (const Result& result : results) {
+        auto base = std::find_if(baseline.begin(), baseline.end(),
+                                 [&](const Result& b) { return b.name == result.name; });
+        out << std::left << std::setw(32) << result.name << std::right;
+        if (base == baseline.end() || base->median <= 0) {
+            out << std::setw(12) << result.median << " " << result.unit << "  (no baseline)\n";
+            continue;
+        }
+        
+        double change = result.median / base->median - 1;
+        out << std::setw(12) << base->median << " -> " << std::setw(10) << result.median << " "
+            << std::left << std::setw(7) << result.unit << std::right << std::showpos
+            << std::setw(9) << change * 100 << "%" << std::noshowpos;
+        if (change < -threshold) {
+            out << "  REGRESSION";
+            ++regressions;
+        }
+        out << "\n";
+    }
+    out << std::defaultfloat;
+    return regressions;
+}
+
+} // namespace arm_bench
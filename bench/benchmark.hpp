@@ -0,0 +1,71 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace arm_bench {
+
+// Work done by one timed run of a benchmark
+struct Sample {
+    uint64_t operations{0};
+    double seconds{0};
+};
+
+// A benchmark times its own core loop, so setup (building programs, loading
+// them, warming caches) stays out of the measurement. scale multiplies the
+// amount of work.
+struct Benchmark {
+    std::string name;
+    std::string unit;  // Of operations per second: "Mops/s" or "MIPS"
+    std::function<Sample(double scale)> run;
+};
+
+// Throughput of a benchmark over all repetitions, in millions of operations
+// per second; the median is the figure reported and compared
+struct Result {
+    std::string name;
+    std::string unit;
+    double median{0};
+    double min{0};
+    double max{0};
+};
+
+class Stopwatch {
+public:
+    Stopwatch() : start(std::chrono::steady_clock::now()) {}
+    
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start;
+};
+
+// Every benchmark in the suite (see workloads.cpp)
+std::vector<Benchmark> all_benchmarks();
+
+Result run_benchmark(const Benchmark& benchmark, unsigned repetitions, double scale);
+
+void write_table(std::ostream& out, const std::vector<Result>& results);
+void write_json(std::ostream& out, const std::vector<Result>& results);
+
+// Baseline results previously written by write_json. Throws
+// std::runtime_error if the file cannot be read.
+std::vector<Result> read_json(const std::string& path);
+
+// Print each result against its baseline; returns the number of results
+// slower than the baseline by more than threshold (a fraction)
+size_t compare(std::ostream& out, const std::vector<Result>& baseline,
+               const std::vector<Result>& results, double threshold);
+
+// Decodes every 32-bit word (or every stride-th one, for a quicker sample)
+// with both Decoder::decode and Decoder::decode_reference, prints up to
+// max_reported words they disagree on and returns the number of disagreements
+uint64_t verify_decoder(std::ostream& out, size_t max_reported = 20, uint32_t stride = 1);
+
+} // namespace arm_bench
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Encoders for the instruction forms the decoder accepts (see
+// src/decoder.cpp), shared by the benchmark workloads and the tests.
+// Register ALU opcodes shift rm by a fixed amount: ADD(S) by 2, SUB(S) and
+// ORR by 1, the others not at all.
+namespace arm_bench::encode {
+
+constexpr uint32_t XZR = 31;
+
+inline uint32_t reg(uint32_t opc, uint32_t rd, uint32_t rn, uint32_t rm) {
+    return 0x04000000 | (opc << 21) | (rm << 16) | (rn << 5) | rd;
+}
+inline uint32_t and_(uint32_t rd, uint32_t rn, uint32_t rm) { return reg(0x0, rd, rn, rm); }
+inline uint32_t eor(uint32_t rd, uint32_t rn, uint32_t rm) { return reg(0x1, rd, rn, rm); }
+inline uint32_t sub(uint32_t rd, uint32_t rn, uint32_t rm) { return reg(0x2, rd, rn, rm); }
+inline uint32_t add(uint32_t rd, uint32_t rn, uint32_t rm) { return reg(0x4, rd, rn, rm); }
+inline uint32_t orr(uint32_t rd, uint32_t rn, uint32_t rm) { return reg(0xA, rd, rn, rm); }
+inline uint32_t ands(uint32_t rd, uint32_t rn, uint32_t rm) { return 0x20000000 | and_(rd, rn, rm); }
+inline uint32_t subs(uint32_t rd, uint32_t rn, uint32_t rm) { return 0x20000000 | sub(rd, rn, rm); }
+inline uint32_t adds(uint32_t rd, uint32_t rn, uint32_t rm) { return 0x20000000 | add(rd, rn, rm); }
+inline uint32_t csel(uint32_t rd, uint32_t rn, uint32_t rm, uint32_t cond) {
+    return 0x04C00000 | (rm << 16) | (cond << 12) | (rn << 5) | rd;
+}
+
+inline uint32_t imm(uint32_t op, uint32_t rd, uint32_t rn, uint32_t value) {
+    return 0x02000000 | (op << 23) | ((value & 0xFFF) << 10) | (rn << 5) | rd;
+}
+inline uint32_t addi(uint32_t rd, uint32_t rn, uint32_t value) { return imm(0, rd, rn, value); }
+inline uint32_t subi(uint32_t rd, uint32_t rn, uint32_t value) { return imm(1, rd, rn, value); }
+inline uint32_t andi(uint32_t rd, uint32_t rn, uint32_t value) { return imm(2, rd, rn, value); }
+inline uint32_t orri(uint32_t rd, uint32_t rn, uint32_t value) { return imm(3, rd, rn, value); }
+inline uint32_t subsi(uint32_t rd, uint32_t rn, uint32_t value) { return 0x20000000 | subi(rd, rn, value); }
+
+// The load bit is also bit 12 of the offset, so loads reach rn + 4096 + offset
+inline uint32_t ldur(uint32_t rt, uint32_t rn, uint32_t offset) {
+    return (1 << 22) | ((offset & 0xFFF) << 10) | (rn << 5) | rt;
+}
+inline uint32_t stur(uint32_t rt, uint32_t rn, uint32_t offset) {
+    return ((offset & 0xFFF) << 10) | (rn << 5) | rt;
+}
+
+// Branch offsets are in instructions, relative to the branch
+inline uint32_t b_cond(uint32_t cond, int32_t offset) {
+    return 0x1A000000 | ((static_cast<uint32_t>(offset) & 0x7FFFF) << 5) | cond;
+}
+inline uint32_t cbz(uint32_t rt, int32_t offset) {
+    return 0x9A000000 | ((static_cast<uint32_t>(offset) & 0x7FFFF) << 5) | rt;
+}
+inline uint32_t cbnz(uint32_t rt, int32_t offset) { return cbz(rt, offset) | (1 << 24); }
+inline uint32_t halt() { return cbz(XZR, 0); }
+
+// Advanced SIMD: size is log2 of the element bytes
+inline uint32_t simd(uint32_t group, uint32_t op, uint32_t rd, uint32_t rn, uint32_t rm, uint32_t size) {
+    return 0x0E000000 | (group << 28) | (op << 21) | (rm << 16) | (size << 10) | (rn << 5) | rd;
+}
+inline uint32_t vadd(uint32_t rd, uint32_t rn, uint32_t rm, uint32_t size) { return simd(0, 0, rd, rn, rm, size); }
+inline uint32_t vmul(uint32_t rd, uint32_t rn, uint32_t rm, uint32_t size) { return simd(0, 2, rd, rn, rm, size); }
+inline uint32_t veor(uint32_t rd, uint32_t rn, uint32_t rm) { return simd(0, 5, rd, rn, rm, 0); }
+inline uint32_t addv(uint32_t rd, uint32_t rn, uint32_t size) { return simd(1, 2, rd, rn, 0, size); }
+inline uint32_t umov(uint32_t rd, uint32_t rn, uint32_t size, uint32_t index) {
+    return simd(1, 1, rd, rn, 0, size) | (index << 12);
+}
+inline uint32_t ld1(uint32_t rt, uint32_t rn, bool post_index = false) {
+    return 0x0C400000 | (post_index ? 1u << 23 : 0) | (rn << 5) | rt;
+}
+inline uint32_t st1(uint32_t rt, uint32_t rn, bool post_index = false) {
+    return 0x0C000000 | (post_index ? 1u << 23 : 0) | (rn << 5) | rt;
+}
+
+// Little-endian instruction words, ready for CPU::load_program
+inline std::vector<uint8_t> to_bytes(const std::vector<uint32_t>& code) {
+    std::vector<uint8_t> bytes(code.size() * sizeof(uint32_t));
+    for (size_t i = 0; i < code.size(); ++i) {
+        for (size_t byte = 0; byte < sizeof(uint32_t); ++byte) {
+            bytes[i * 4 + byte] = static_cast<uint8_t>(code[i] >> (8 * byte));
+        }
+    }
+    return bytes;
+}
+
+} // namespace arm_bench::encode
@@ -0,0 +1,104 @@
+// main.cpp - emulator benchmark suite
+#include "benchmark.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace {
+
+void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "Options:\n"
+              << "  --filter <text>      Only run benchmarks whose name contains text\n"
+              << "  --repetitions <n>    Timed runs per benchmark; the median is reported\n"
+              << "                       (default: 5)\n"
+              << "  --scale <factor>     Multiply the work done by each run (default: 1)\n"
+              << "  --json <file>        Also write the results as JSON\n"
+              << "  --baseline <file>    Compare with results saved by --json and exit\n"
+              << "                       with status 1 on a regression\n"
+              << "  --threshold <pct>    Slowdown counted as a regression (default: 5)\n"
+              << "  --list               List the benchmarks and exit\n"
+              << "  --verify-decoder     Check the decoder against the reference decoder\n"
+              << "                       on every 32-bit word and exit\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string filter;
+    unsigned repetitions = 5;
+    double scale = 1;
+    std::string json_path;
+    std::string baseline_path;
+    double threshold = 5;
+    bool list = false;
+    bool verify = false;
+    
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--filter" && i + 1 < argc) {
+                filter = argv[++i];
+            } else if (arg == "--repetitions" && i + 1 < argc) {
+                repetitions = static_cast<unsigned>(std::stoul(argv[++i]));
+            } else if (arg == "--scale" && i + 1 < argc) {
+                scale = std::stod(argv[++i]);
+            } else if (arg == "--json" && i + 1 < argc) {
+                json_path = argv[++i];
+            } else if (arg == "--baseline" && i + 1 < argc) {
+                baseline_path = argv[++i];
+            } else if (arg == "--threshold" && i + 1 < argc) {
+                threshold = std::stod(argv[++i]);
+            } else if (arg == "--list") {
+                list = true;
+            } else if (arg == "--verify-decoder") {
+                verify = true;
+            } else {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+        
+        if (verify) {
+            uint64_t mismatches = arm_bench::verify_decoder(std::cout);
+            std::cout << mismatches << " of 4294967296 words decoded differently\n";
+            return mismatches == 0 ? 0 : 1;
+        }
+        
+        std::vector<arm_bench::Result> results;
+        for (const arm_bench::Benchmark& benchmark : arm_bench::all_benchmarks()) {
+            if (benchmark.name.find(filter) == std::string::npos) continue;
+            if (list) {
+                std::cout << benchmark.name << "\n";
+                continue;
+            }
+            results.push_back(arm_bench::run_benchmark(benchmark, repetitions, scale));
+            arm_bench::write_table(std::cout, {results.back()});
+        }
+        if (list) return 0;
+        
+        if (!json_path.empty()) {
+            std::ofstream out(json_path);
+            if (!out) {
+                std::cerr << "Failed to create " << json_path << "\n";
+                return 1;
+            }
+            arm_bench::write_json(out, results);
+        }
+        
+        if (!baseline_path.empty()) {
+            std::cout << "\nCompared with " << baseline_path << ":\n";
+            size_t regressions = arm_bench::compare(std::cout, arm_bench::read_json(baseline_path),
+                                                    results, threshold / 100);
+            if (regressions > 0) {
+                std::cout << regressions << " regression(s) over " << threshold << "%\n";
+                return 1;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include "benchmark.hpp"
+#include "decoder.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+namespace arm_bench {
+
+namespace {
+
+bool same(const arm_emulator::Instruction& a, const arm_emulator::Instruction& b) {
+    return a.opcode == b.opcode && a.cond == b.cond && a.rd == b.rd && a.rn == b.rn &&
+           a.rm == b.rm && a.ra == b.ra && a.imm == b.imm && a.shift == b.shift && a.esize == b.esize &&
+           a.addr_mode == b.addr_mode && a.wback == b.wback;
+}
+
+} // namespace
+
+uint64_t verify_decoder(std::ostream& out, size_t max_reported, uint32_t stride) {
+    // Every stride-th word; an odd stride also varies the low bits
+    const uint64_t words = ((uint64_t{1} << 32) + stride - 1) / stride;
+    constexpr uint64_t CHUNK = uint64_t{1} << 24;
+    
+    // Threads take chunks of the encoding space in turn
+    std::atomic<uint64_t> next_chunk{0};
+    std::atomic<uint64_t> mismatches{0};
+    std::vector<uint32_t> examples;
+    std::mutex examples_mutex;
+    
+    auto worker = [&] {
+        for (uint64_t start; (start = next_chunk.fetch_add(CHUNK)) < words;) {
+            for (uint64_t index = start; index < std::min(start + CHUNK, words); ++index) {
+                uint32_t instruction = static_cast<uint32_t>(index * stride);
+                if (same(arm_emulator::Decoder::decode(instruction),
+                         arm_emulator::Decoder::decode_reference(instruction))) {
+                    continue;
+                }
+                mismatches.fetch_add(1, std::memory_order_relaxed);
+                std::lock_guard<std::mutex> lock(examples_mutex);
+                if (examples.size() < max_reported) examples.push_back(instruction);
+            }
+        }
+    };
+    
+    std::vector<std::thread> threads(std::max(1u, std::thread::hardware_concurrency()));
+    for (auto& thread : threads) thread = std::thread(worker);
+    for (auto& thread : threads) thread.join();
+    
+    std::sort(examples.begin(), examples.end());
+    for (uint32_t instruction : examples) {
+        out << "0x" << std::hex << std::setw(8) << std::setfill('0') << instruction << std::dec
+            << std::setfill(' ') << ": " << arm_emulator::Decoder::decode(instruction).to_string()
+            << ", reference " << arm_emulator::Decoder::decode_reference(instruction).to_string() << "\n";
+    }
+    return mismatches;
+}
+
+} // namespace arm_bench
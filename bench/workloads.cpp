@@ -0,0 +1,196 @@
+#include "benchmark.hpp"
+#include "encode.hpp"
+
+#include "cpu.hpp"
+#include "decoder.hpp"
+#include "memory.hpp"
+
+#include <stdexcept>
+
+namespace arm_bench {
+
+using arm_emulator::CPU;
+using arm_emulator::ExecutionEngine;
+using arm_emulator::Memory;
+using namespace arm_bench::encode;
+
+namespace {
+
+constexpr uint64_t CODE = 0x400000;
+constexpr uint64_t DATA = 0x800000;
+
+struct Workload {
+    const char* name;
+    std::vector<uint32_t> code;
+    uint64_t iterations;  // At scale 1
+    void (*setup)(CPU& cpu, uint64_t iterations);
+};
+
+// Independent ALU operations; X1 counts down
+Workload alu_loop() {
+    return {"alu_loop",
+            {addi(2, 2, 1), eor(3, 3, 2), add(4, 4, 3), subi(5, 5, 3), orri(6, 6, 1),
+             andi(7, 3, 0xFF), subi(1, 1, 1), cbnz(1, -7), halt()},
+            2000000,
+            [](CPU& cpu, uint64_t iterations) { cpu.get_registers().set_register(1, iterations); }};
+}
+
+// Copy a 4KB buffer 16 bytes at a time, X1 times
+Workload memcpy_loop() {
+    return {"memcpy",
+            {addi(10, 12, 0), addi(11, 13, 0), orri(2, XZR, 256),
+             ldur(3, 10, 0), ldur(4, 10, 8), stur(3, 11, 0), stur(4, 11, 8),
+             addi(10, 10, 16), addi(11, 11, 16), subi(2, 2, 1), cbnz(2, -7),
+             subi(1, 1, 1), cbnz(1, -12), halt()},
+            4000,
+            [](CPU& cpu, uint64_t iterations) {
+                cpu.get_registers().set_register(1, iterations);
+                cpu.get_registers().set_register(12, DATA - 4096);  // Loads add 4096
+                cpu.get_registers().set_register(13, DATA + 0x10000);
+            }};
+}
+
+// Two data-dependent branches per iteration on an LCG (X5 = 5 * X5 + 1)
+Workload branch_loop() {
+    return {"branchy",
+            {add(6, 5, 5), addi(5, 6, 1), andi(7, 5, 0x10), cbz(7, 2), addi(8, 8, 1),
+             andi(7, 5, 0x400), cbnz(7, 2), addi(9, 9, 1), subi(1, 1, 1), cbnz(1, -9), halt()},
+            1500000,
+            [](CPU& cpu, uint64_t iterations) { cpu.get_registers().set_register(1, iterations); }};
+}
+
+// Sum, square and checksum a 4KB buffer 16 bytes at a time, X1 times
+Workload simd_loop() {
+    return {"simd",
+            {addi(10, 12, 0), orri(2, XZR, 256),
+             ld1(0, 10, true), vadd(1, 1, 0, 2), vmul(2, 0, 0, 1), veor(3, 3, 2),
+             subi(2, 2, 1), cbnz(2, -5),
+             addv(4, 1, 2), umov(5, 4, 2, 0), subi(1, 1, 1), cbnz(1, -11), halt()},
+            4000,
+            [](CPU& cpu, uint64_t iterations) {
+                cpu.get_registers().set_register(1, iterations);
+                cpu.get_registers().set_register(12, DATA);
+            }};
+}
+
+uint64_t scaled(uint64_t count, double scale) {
+    return std::max<uint64_t>(1, static_cast<uint64_t>(static_cast<double>(count) * scale));
+}
+
+const char* engine_name(ExecutionEngine engine) {
+    switch (engine) {
+        case ExecutionEngine::Switch: return "switch";
+        case ExecutionEngine::Threaded: return "threaded";
+        case ExecutionEngine::Block: return "block";
+        case ExecutionEngine::Jit: return "jit";
+    }
+    return "unknown";
+}
+
+// Keeps results of the micro benchmarks alive
+volatile uint64_t sink;
+
+Benchmark decode_benchmark(const char* name, arm_emulator::Instruction (*decode)(uint32_t)) {
+    return {name, "Mops/s", [decode](double scale) {
+        std::vector<uint32_t> words;
+        for (const Workload& workload : {alu_loop(), memcpy_loop(), branch_loop()}) {
+            words.insert(words.end(), workload.code.begin(), workload.code.end());
+        }
+        uint64_t count = scaled(4000000, scale);
+        uint64_t sum = 0;
+        Stopwatch stopwatch;
+        for (uint64_t i = 0; i < count; ++i) {
+            sum += static_cast<uint64_t>(decode(words[i % words.size()]).opcode);
+        }
+        double seconds = stopwatch.seconds();
+        sink = sum;
+        return Sample{count, seconds};
+    }};
+}
+
+// Accesses sweep a 64KB region, so they hit the TLB as programs usually do
+constexpr uint64_t REGION = 0x10000;
+
+template <typename Access>
+Benchmark memory_benchmark(const char* name, Access access) {
+    return {name, "Mops/s", [access](double scale) {
+        Memory memory;
+        for (uint64_t offset = 0; offset < REGION; offset += 8) {
+            memory.write64(DATA + offset, offset * 0x9E3779B97F4A7C15ULL);
+        }
+        uint64_t count = scaled(20000000, scale);
+        uint64_t sum = 0;
+        Stopwatch stopwatch;
+        for (uint64_t i = 0; i < count; ++i) {
+            sum += access(memory, DATA + ((i * 8) & (REGION - 8)), i);
+        }
+        double seconds = stopwatch.seconds();
+        sink = sum;
+        return Sample{count, seconds};
+    }};
+}
+
+Benchmark step_benchmark() {
+    return {"cpu/step_instruction", "MIPS", [](double scale) {
+        Workload workload = alu_loop();
+        CPU cpu;
+        cpu.load_program(to_bytes(workload.code), CODE);
+        uint64_t count = scaled(5000000, scale);
+        workload.setup(cpu, count);  // Never runs out within count steps
+        Stopwatch stopwatch;
+        for (uint64_t i = 0; i < count; ++i) {
+            cpu.step_instruction();
+        }
+        return Sample{count, stopwatch.seconds()};
+    }};
+}
+
+Benchmark guest_benchmark(Workload (*make)(), ExecutionEngine engine) {
+    Workload workload = make();
+    return {std::string("guest/") + workload.name + "/" + engine_name(engine), "MIPS",
+            [make, engine](double scale) {
+        Workload workload = make();
+        CPU cpu(Memory::DEFAULT_SIZE, engine);
+        cpu.load_program(to_bytes(workload.code), CODE);
+        workload.setup(cpu, scaled(workload.iterations, scale));
+        Stopwatch stopwatch;
+        arm_emulator::RunResult result = cpu.run();
+        double seconds = stopwatch.seconds();
+        
+        // A workload that stops early would report a meaningless rate
+        if (result.reason != arm_emulator::StopReason::Halted) {
+            throw std::runtime_error(std::string(workload.name) + " stopped early: " +
+                                     arm_emulator::to_string(result.reason));
+        }
+        return Sample{result.instructions, seconds};
+    }};
+}
+
+} // namespace
+
+std::vector<Benchmark> all_benchmarks() {
+    std::vector<Benchmark> benchmarks;
+    benchmarks.push_back(decode_benchmark("decode", arm_emulator::Decoder::decode));
+    benchmarks.push_back(decode_benchmark("decode/reference", arm_emulator::Decoder::decode_reference));
+    benchmarks.push_back(memory_benchmark("memory/read32", [](Memory& m, uint64_t a, uint64_t) -> uint64_t {
+        return m.read32(a);
+    }));
+    benchmarks.push_back(memory_benchmark("memory/read64", [](Memory& m, uint64_t a, uint64_t) {
+        return m.read64(a);
+    }));
+    benchmarks.push_back(memory_benchmark("memory/write64", [](Memory& m, uint64_t a, uint64_t i) {
+        m.write64(a, i);
+        return i;
+    }));
+    benchmarks.push_back(step_benchmark());
+    
+    for (Workload (*make)() : {alu_loop, memcpy_loop, branch_loop, simd_loop}) {
+        for (ExecutionEngine engine : {ExecutionEngine::Switch, ExecutionEngine::Threaded,
+                                       ExecutionEngine::Block, ExecutionEngine::Jit}) {
+            benchmarks.push_back(guest_benchmark(make, engine));
+        }
+    }
+    return benchmarks;
+}
+
+} // namespace arm_bench
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "cpu.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace arm_emulator {
+
+// One guest program to run from a fresh CPU
+struct BatchJob {
+    std::string image;                 // Raw image or ELF executable
+    uint64_t load_address{0x400000};   // Where a raw image is placed
+    uint64_t max_instructions{~0ULL};  // Instruction budget
+    
+    // Initial register values by index (X0-X30, 32 = SP, 33 = PC, 34 = NZCV),
+    // applied after loading so they override an ELF entry point
+    std::vector<std::pair<size_t, uint64_t>> registers;
+};
+
+struct BatchResult {
+    StopReason reason{StopReason::LoadFailed};
+    uint64_t instructions{0};  // Instructions retired
+    Registers registers;       // Final state
+    Trap trap;                 // What went wrong, for StopReason::Fault
+};
+
+// Runs independent jobs on a pool of threads, one CPU per job. Each worker
+// owns a deque of job indices: it takes work from the back of its own deque
+// and, once that is empty, steals from the front of the others', so long
+// and short jobs even out across threads without a central queue.
+class BatchRunner {
+public:
+    // threads = 0 uses every hardware thread
+    explicit BatchRunner(unsigned threads = 0,
+                         ExecutionEngine engine = ExecutionEngine::Switch,
+                         uint64_t memory_size = Memory::DEFAULT_SIZE);
+    
+    // Run every job and return the results in job order
+    std::vector<BatchResult> run(const std::vector<BatchJob>& jobs);
+    
+    unsigned thread_count() const noexcept { return threads; }
+
+private:
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<size_t> jobs;
+    };
+    
+    unsigned threads;
+    ExecutionEngine engine;
+    uint64_t memory_size;
+    
+    // Worker loop: drain the own queue, then steal until every queue is empty
+    void work(unsigned self, std::vector<WorkQueue>& queues,
+              const std::vector<BatchJob>& jobs, std::vector<BatchResult>& results) const;
+    
+    BatchResult run_job(const BatchJob& job) const;
+};
+
+// Read jobs from a text file, one per line:
+//
+//   image [load_address] [max=N] [X0=value ...] [SP=value] [PC=value] [NZCV=value]
+//
+// Register names are case-insensitive and numbers may be decimal, hex (0x)
+// or octal (0). NZCV keeps only the flag bits, 31-28. Blank lines and lines
+// starting with '#' are ignored. Throws std::runtime_error on malformed
+// lines.
+std::vector<BatchJob> read_batch_jobs(std::istream& in);
+
+// Print one line per job: index, image, stop reason, instruction count,
+// PC, SP and the non-zero general-purpose registers
+void write_batch_results(std::ostream& out, const std::vector<BatchJob>& jobs,
+                         const std::vector<BatchResult>& results);
+
+} // namespace arm_emulator
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "instruction.hpp"
+#include "dispatch.hpp"
+#include "jit.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace arm_emulator {
+
+// A decoded instruction inside a basic block
+struct BlockInstruction {
+    Handler handler;
+    Instruction instr;
+};
+
+// Straight-line guest code ending at the first branch (or INVALID, or the
+// length limit). Successors with static addresses are linked directly once resolved.
+struct BasicBlock {
+    uint64_t start_pc{0};
+    uint64_t end_pc{0};  // Address following the last instruction
+    std::vector<BlockInstruction> instructions;
+
+    // Static successors: branch target (B, BL, B.cond, CBZ, CBNZ) and fall-through
+    static constexpr uint64_t NO_TARGET = ~0ULL;
+    uint64_t taken_pc{NO_TARGET};
+    uint64_t fallthrough_pc{NO_TARGET};
+    BasicBlock* taken{nullptr};
+    BasicBlock* fallthrough{nullptr};
+
+    // True if a breakpoint lies inside the block; it then runs one step at a time
+    bool has_breakpoint{false};
+
+    // Interpreted executions so far, and native code once the block is hot
+    uint32_t exec_count{0};
+    JitFunction jit_code{nullptr};
+};
+
+// Owns all basic blocks, keyed by start address
+class BlockCache {
+public:
+    // Maximum number of instructions in a block
+    static constexpr size_t MAX_BLOCK_INSTRUCTIONS = 64;
+
+    // Return the block starting at pc, or nullptr
+    BasicBlock* find(uint64_t pc) const;
+
+    // Take ownership of a newly built block
+    BasicBlock* insert(std::unique_ptr<BasicBlock> block);
+
+    // Mark the cache stale if a block overlaps [address, address + size).
+    // Blocks may be executing, so they are only freed by flush_if_stale().
+    void invalidate(uint64_t address, size_t size) noexcept;
+
+    // Request that all blocks be dropped (e.g. breakpoints changed)
+    void mark_stale() noexcept { stale = true; }
+    bool is_stale() const noexcept { return stale; }
+
+    // Drop all blocks if stale and report whether it did; only call when no
+    // block is executing
+    bool flush_if_stale();
+
+private:
+    std::map<uint64_t, std::unique_ptr<BasicBlock>> blocks;
+    bool stale{false};
+};
+
+} // namespace arm_emulator
\ No newline at end of file
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "execution_observer.hpp"
+#include "instruction.hpp"
+#include "symbol_table.hpp"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace arm_emulator {
+
+// Predicts whether conditional branches are taken. update() is called with
+// the outcome right after predict() for the same branch.
+class BranchPredictor {
+public:
+    virtual ~BranchPredictor() = default;
+    virtual bool predict(uint64_t pc) = 0;
+    virtual void update(uint64_t pc, bool taken) = 0;
+    virtual std::string name() const = 0;
+    
+    // "bimodal[:index_bits]", "gshare[:index_bits[:history_bits]]" or "tage".
+    // Throws std::invalid_argument for anything else.
+    static std::unique_ptr<BranchPredictor> create(const std::string& spec);
+};
+
+// Two-bit saturating counters indexed by PC
+class BimodalPredictor : public BranchPredictor {
+public:
+    explicit BimodalPredictor(unsigned index_bits = 12);
+    bool predict(uint64_t pc) override;
+    void update(uint64_t pc, bool taken) override;
+    std::string name() const override;
+
+private:
+    std::vector<uint8_t> counters;
+    uint64_t mask;
+};
+
+// Two-bit counters indexed by PC XOR global branch history
+class GsharePredictor : public BranchPredictor {
+public:
+    explicit GsharePredictor(unsigned index_bits = 14, unsigned history_bits = 14);
+    bool predict(uint64_t pc) override;
+    void update(uint64_t pc, bool taken) override;
+    std::string name() const override;
+
+private:
+    std::vector<uint8_t> counters;
+    uint64_t mask;
+    unsigned history_bits;
+    uint64_t history{0};
+    
+    size_t index(uint64_t pc) const noexcept;
+};
+
+// Reduced TAGE: a bimodal base predictor and four tagged tables indexed
+// with geometrically longer global histories. The longest matching table
+// provides the prediction; mispredictions allocate in a longer table.
+class TagePredictor : public BranchPredictor {
+public:
+    TagePredictor();
+    bool predict(uint64_t pc) override;
+    void update(uint64_t pc, bool taken) override;
+    std::string name() const override { return "tage"; }
+
+private:
+    static constexpr unsigned TABLES = 4;
+    static constexpr unsigned INDEX_BITS = 10;
+    static constexpr unsigned TAG_BITS = 8;
+    static constexpr std::array<unsigned, TABLES> HISTORY_LENGTHS = {5, 11, 23, 47};
+    static constexpr uint64_t USEFUL_RESET_PERIOD = 1 << 18;
+    
+    struct Entry {
+        uint16_t tag{0};
+        int8_t counter{0};   // -4..3, taken if >= 0
+        uint8_t useful{0};   // 0..3
+    };
+    
+    BimodalPredictor base;
+    std::array<std::vector<Entry>, TABLES> tables;
+    uint64_t history{0};
+    uint64_t updates{0};
+    
+    // Lookup state from predict() for the following update()
+    std::array<size_t, TABLES> indices{};
+    std::array<uint16_t, TABLES> tags{};
+    int provider{-1};     // Table that provided the prediction, or -1 for base
+    bool provider_prediction{false};
+    bool alternate_prediction{false};
+};
+
+// Models branch prediction for the instructions a CPU retires: conditional
+// branches through a BranchPredictor, returns through a return-address stack
+// and other indirect branches through a last-target buffer. Direct
+// unconditional branches are always predicted correctly.
+class BranchModel : public ExecutionObserver {
+public:
+    static constexpr size_t DEFAULT_RAS_DEPTH = 16;
+    
+    explicit BranchModel(std::unique_ptr<BranchPredictor> predictor,
+                         size_t ras_depth = DEFAULT_RAS_DEPTH);
+    
+    void on_retire(const RetiredInstruction& retired) override;
+    
+    // Account for one retired instruction that went from pc to next_pc;
+    // on_retire decodes the word and calls this. Other than branches,
+    // opcodes are ignored.
+    void on_branch(Opcode opcode, uint64_t pc, uint64_t next_pc);
+    
+    // Branches seen and mispredicted so far, over every kind
+    uint64_t executed() const noexcept;
+    uint64_t mispredicted() const noexcept;
+    
+    // Mispredict rates by kind of branch, then the branches with the most
+    // mispredictions
+    void write_report(std::ostream& out, const SymbolTable& symbols, size_t top = 10) const;
+    
+    const std::string& name() const noexcept { return predictor_name; }
+
+private:
+    enum Kind { Conditional, Direct, Indirect, Return, KINDS };
+    
+    struct Stats {
+        uint64_t executed{0};
+        uint64_t taken{0};
+        uint64_t mispredicted{0};
+    };
+    
+    struct Site {
+        Kind kind;
+        Stats stats;
+    };
+    
+    std::unique_ptr<BranchPredictor> predictor;
+    std::string predictor_name;
+    
+    // Circular return-address stack; pushes past the depth overwrite the oldest
+    std::vector<uint64_t> ras;
+    size_t ras_top{0};
+    size_t ras_size{0};
+    
+    std::unordered_map<uint64_t, uint64_t> targets;  // Last target of indirect branches
+    std::unordered_map<uint64_t, Site> sites;        // Statistics per static branch
+    std::array<Stats, KINDS> totals{};
+    
+    static const char* kind_name(Kind kind) noexcept;
+};
+
+} // namespace arm_emulator
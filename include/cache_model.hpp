@@ -0,0 +1,120 @@
+#pragma once
+
+#include "execution_observer.hpp"
+#include "symbol_table.hpp"
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace arm_emulator {
+
+enum class ReplacementPolicy { LRU, FIFO, Random };
+
+struct CacheConfig {
+    uint64_t size{32 * 1024};  // Bytes
+    unsigned associativity{8};
+    unsigned line_size{64};
+    ReplacementPolicy policy{ReplacementPolicy::LRU};
+    
+    // "size:ways:line[:lru|fifo|random]", with k or m suffixes on the size,
+    // e.g. "32k:8:64:lru". Throws std::invalid_argument on malformed specs.
+    static CacheConfig parse(const std::string& spec);
+};
+
+// One set-associative, write-back, write-allocate cache level
+class Cache {
+public:
+    // Throws std::invalid_argument unless the line size and the number of
+    // sets are powers of two
+    explicit Cache(const CacheConfig& config);
+    
+    struct Result {
+        bool hit;
+        bool writeback;          // A dirty line was evicted
+        uint64_t victim_address; // Its address, when writeback is set
+    };
+    
+    // Look up the line holding address, allocating it on a miss
+    Result access(uint64_t address, bool write);
+    
+    const CacheConfig& get_config() const noexcept { return config; }
+    uint64_t line_address(uint64_t address) const noexcept { return address & ~line_mask; }
+    
+    uint64_t hits{0};
+    uint64_t misses{0};
+    uint64_t writebacks{0};
+
+private:
+    struct Line {
+        uint64_t tag{0};
+        uint64_t stamp{0};  // Last use (LRU) or fill (FIFO)
+        bool valid{false};
+        bool dirty{false};
+    };
+    
+    CacheConfig config;
+    std::vector<Line> lines;  // associativity lines per set
+    uint64_t line_mask;
+    unsigned line_shift;
+    uint64_t set_mask;
+    uint64_t clock{0};
+    uint64_t random_state{0x9E3779B97F4A7C15ULL};
+};
+
+// Split L1 instruction and data caches over a unified L2, fed with the
+// fetches and loads and stores of retired instructions. Attach it with
+// CPU::add_observer; when it is not attached it costs nothing.
+class CacheHierarchy : public ExecutionObserver {
+public:
+    struct Config {
+        CacheConfig l1i;
+        CacheConfig l1d;
+        CacheConfig l2{1024 * 1024, 16, 64, ReplacementPolicy::LRU};
+        uint64_t region_size{4096};  // Granularity of the per-region statistics
+        
+        // Comma-separated level=spec overrides of the defaults, e.g.
+        // "l1d=64k:8:64,l2=2m:16:64:random,region=64k", or "default"
+        static Config parse(const std::string& spec);
+    };
+    
+    explicit CacheHierarchy(const Config& config);
+    
+    void on_retire(const RetiredInstruction& retired) override;
+    
+    // Statistics per cache, then the PCs and data regions with the most misses
+    void write_report(std::ostream& out, const SymbolTable& symbols, size_t top = 10) const;
+    
+    const Cache& l1i() const noexcept { return l1i_cache; }
+    const Cache& l1d() const noexcept { return l1d_cache; }
+    const Cache& l2() const noexcept { return l2_cache; }
+
+private:
+    struct PcStats {
+        uint64_t fetches{0};
+        uint64_t fetch_misses{0};
+        uint64_t data_accesses{0};
+        uint64_t data_misses{0};
+    };
+    
+    struct RegionStats {
+        uint64_t accesses{0};
+        uint64_t misses{0};
+    };
+    
+    Cache l1i_cache;
+    Cache l1d_cache;
+    Cache l2_cache;
+    uint64_t region_size;
+    
+    std::unordered_map<uint64_t, PcStats> pcs;
+    std::unordered_map<uint64_t, RegionStats> regions;
+    
+    // Access [address, address + size) through l1 and the L2 behind it;
+    // returns the number of L1 misses (one per line)
+    unsigned access(Cache& l1, uint64_t address, size_t size, bool write);
+};
+
+} // namespace arm_emulator
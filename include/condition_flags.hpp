@@ -0,0 +1,100 @@
+#pragma once
+
+#include "instruction.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace arm_emulator {
+
+// NZCV packed into four bits (PSTATE keeps them in bits 31-28)
+constexpr uint32_t FLAG_N = 8;
+constexpr uint32_t FLAG_Z = 4;
+constexpr uint32_t FLAG_C = 2;
+constexpr uint32_t FLAG_V = 1;
+
+// Bit n of CONDITION_TABLE[cond] is set if cond holds when NZCV is n
+constexpr std::array<uint16_t, 16> build_condition_table() {
+    std::array<uint16_t, 16> table{};
+    for (uint32_t cond = 0; cond < 16; ++cond) {
+        for (uint32_t nzcv = 0; nzcv < 16; ++nzcv) {
+            bool n = nzcv & FLAG_N, z = nzcv & FLAG_Z, c = nzcv & FLAG_C, v = nzcv & FLAG_V;
+            bool holds = true;
+            switch (static_cast<Condition>(cond)) {
+                case Condition::EQ: holds = z; break;
+                case Condition::NE: holds = !z; break;
+                case Condition::CS: holds = c; break;
+                case Condition::CC: holds = !c; break;
+                case Condition::MI: holds = n; break;
+                case Condition::PL: holds = !n; break;
+                case Condition::VS: holds = v; break;
+                case Condition::VC: holds = !v; break;
+                case Condition::HI: holds = c && !z; break;
+                case Condition::LS: holds = !(c && !z); break;
+                case Condition::GE: holds = n == v; break;
+                case Condition::LT: holds = n != v; break;
+                case Condition::GT: holds = !z && n == v; break;
+                case Condition::LE: holds = !(!z && n == v); break;
+                case Condition::AL:
+                case Condition::NV: holds = true; break;
+            }
+            if (holds) table[cond] |= static_cast<uint16_t>(1u << nzcv);
+        }
+    }
+    return table;
+}
+
+inline constexpr std::array<uint16_t, 16> CONDITION_TABLE = build_condition_table();
+
+constexpr bool condition_holds(Condition cond, uint32_t nzcv) noexcept {
+    return (CONDITION_TABLE[static_cast<size_t>(cond)] >> nzcv) & 1;
+}
+
+// Condition flags, evaluated lazily. Flag-setting instructions only record
+// which operation last set the flags and its operands; NZCV is worked out
+// when a condition is tested. Fields are 64-bit so generated code can store
+// them directly.
+struct ConditionFlags {
+    enum Kind : uint64_t {
+        Value,  // a holds the NZCV bits
+        Logic,  // a holds the result of a logical operation (C and V clear)
+        Add,    // a + b
+        Sub,    // a - b
+    };
+    
+    uint64_t kind{Value};
+    uint64_t a{0};
+    uint64_t b{0};
+    
+    void set_logic(uint64_t result) noexcept { kind = Logic; a = result; }
+    void set_add(uint64_t x, uint64_t y) noexcept { kind = Add; a = x; b = y; }
+    void set_sub(uint64_t x, uint64_t y) noexcept { kind = Sub; a = x; b = y; }
+    void set_nzcv(uint32_t nzcv) noexcept { kind = Value; a = nzcv & 0xF; }
+    
+    uint32_t nzcv() const noexcept {
+        uint64_t result = a;
+        uint32_t carry_overflow = 0;
+        switch (kind) {
+            case Value:
+                return static_cast<uint32_t>(a);
+            case Add:
+                result = a + b;
+                if (result < a) carry_overflow |= FLAG_C;
+                if ((~(a ^ b) & (a ^ result)) >> 63) carry_overflow |= FLAG_V;
+                break;
+            case Sub:
+                result = a - b;
+                if (a >= b) carry_overflow |= FLAG_C;
+                if (((a ^ b) & (a ^ result)) >> 63) carry_overflow |= FLAG_V;
+                break;
+            default:
+                break;
+        }
+        return (result >> 63 ? FLAG_N : 0) | (result == 0 ? FLAG_Z : 0) | carry_overflow;
+    }
+    
+    bool holds(Condition cond) const noexcept { return condition_holds(cond, nzcv()); }
+};
+
+} // namespace arm_emulator
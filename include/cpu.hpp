@@ -3,8 +3,16 @@
 #include "registers.hpp"
 #include "memory.hpp"
 #include "instruction.hpp"
+#include "decode_cache.hpp"
+#include "block_cache.hpp"
+#include "jit.hpp"
+#include "dispatch.hpp"
+#include "trap.hpp"
+#include "execution_observer.hpp"
+#include "vector_kernels.hpp"
 
 #include <cstdint>
+#include <exception>
 #include <string>
 #include <vector>
 #include <memory>
@@ -12,22 +20,87 @@
 
 namespace arm_emulator {
 
+// Why a run stopped
+enum class StopReason {
+    Halted,            // Branched to itself
+    Fault,             // An instruction could not be executed (see CPU::get_trap)
+    InstructionLimit,  // Used up its instruction budget
+    Breakpoint,        // Reached a breakpoint
+    Watchpoint,        // A load or store hit a watchpoint
+    AddressReached,    // Reached the address given to run_until
+    LoadFailed,        // The image could not be loaded (batch jobs)
+    HistoryStart,      // Reverse execution reached the oldest recorded state
+};
+
+const char* to_string(StopReason reason) noexcept;
+
+struct RunResult {
+    StopReason reason{StopReason::Halted};
+    uint64_t instructions{0};  // Instructions retired by this run
+};
+
 class CPU {
 public:
-    // Initialize CPU with memory size (default 1MB)
-    explicit CPU(size_t memory_size = 1024 * 1024);
+    // Initialize CPU with the size of its address space (default 4GB, backed
+    // on demand) and interpreter core
+    explicit CPU(uint64_t memory_size = Memory::DEFAULT_SIZE,
+                 ExecutionEngine engine = ExecutionEngine::Switch);
+    
+    // The memory's code-write callback refers back to this CPU
+    CPU(const CPU&) = delete;
+    CPU& operator=(const CPU&) = delete;
     
     // Reset the CPU state (registers, memory, etc.)
     void reset() noexcept;
     
+    // Registers and memory at a point in time. Memory pages are shared
+    // copy-on-write, so taking and restoring snapshots is cheap.
+    struct Snapshot {
+        Registers registers;
+        Memory::Snapshot memory;
+        bool running{false};
+    };
+    
+    // Capture the current state; costs O(pages written since the last snapshot)
+    Snapshot snapshot();
+    
+    // Return to a snapshot taken from this CPU or one with the same memory size
+    void restore(const Snapshot& snapshot);
+    
+    // Create a CPU with the same configuration, breakpoints and state. The two
+    // share memory pages until either writes them.
+    std::unique_ptr<CPU> fork();
+    
     // Load a program into memory at the specified address
     bool load_program(const std::vector<uint8_t>& program, uint64_t address = 0);
     
-    // Execute a single instruction
+    // Map a program image file into memory without copying it (guest writes
+    // are private to the emulator). ELF64 AArch64 executables are loaded from
+    // their program headers, segments populated on first access, and start at
+    // their entry point; any other file is a raw image placed at address.
+    bool load_program_file(const std::string& path, uint64_t address = 0);
+    
+    // Write the machine state to a snapshot file (see SnapshotFile)
+    bool save_snapshot(const std::string& path) const;
+    
+    // Replace the machine state with a snapshot file. Its pages are mapped
+    // rather than read, so this takes time proportional to the page count only.
+    bool load_snapshot(const std::string& path);
+    
+    // Execute a single instruction; false if it stopped at a breakpoint or
+    // faulted (see get_trap)
     bool step_instruction();
     
     // Run until a halt condition is met (e.g., infinite loop or program end)
-    void run();
+    RunResult run() { return run_for(~0ULL); }
+    
+    // Run at most max_instructions instructions. Instructions that fault or
+    // are stopped at by a breakpoint are not retired.
+    RunResult run_for(uint64_t max_instructions);
+    
+    // Run until PC reaches address (other than where it starts), or one of
+    // the other stop conditions of run_for
+    RunResult run_until(uint64_t address, uint64_t max_instructions = ~0ULL);
     
     // Get the current CPU state as a string (for debugging)
     std::string get_state() const;
@@ -35,16 +108,55 @@ public:
     // Get references to registers and memory (for debugging/testing)
     Registers& get_registers() { return registers; }
     const Registers& get_registers() const { return registers; }
+    Memory& get_memory() { return *memory; }
     const Memory& get_memory() const { return *memory; }
     
-    // Check if the CPU is in a running state
-    bool is_running() const { return running; }
+    // The fault that stopped the CPU, if any. Cleared by reset() and when
+    // restoring a snapshot.
+    const Trap& get_trap() const { return trap; }
+    
+    // The access that stopped the last run with StopReason::Watchpoint
+    const Memory::WatchHit& get_watch_hit() const { return watch_hit; }
+    
+    // Check if the CPU is in a running state (stopping at a watchpoint does
+    // not end the program; the next run or step continues it)
+    bool is_running() const { return running || watch_stop; }
+    
+    // Interpreter core selected at construction
+    ExecutionEngine get_engine() const { return engine; }
     
-    // Set a breakpoint at the specified address
-    void set_breakpoint(uint64_t address) { breakpoints.insert(address); }
+    // Set a breakpoint at the specified address. Breakpoints are flagged on
+    // cached instructions and blocks, so they cost nothing until reached.
+    // Running or stepping again from a breakpoint executes past it.
+    void set_breakpoint(uint64_t address);
     
     // Clear a breakpoint
-    void clear_breakpoint(uint64_t address) { breakpoints.erase(address); }
+    void clear_breakpoint(uint64_t address);
+    
+    // Stop after a load or store touching [address, address + size); see
+    // Memory::add_watchpoint
+    void set_watchpoint(uint64_t address, uint64_t size,
+                        Memory::WatchKind kind = Memory::WatchKind::Write) {
+        memory->add_watchpoint(address, size, kind);
+    }
+    
+    // Clear the watchpoint starting at address
+    bool clear_watchpoint(uint64_t address) { return memory->remove_watchpoint(address); }
+    
+    // Report every retired instruction to observer, which must outlive its
+    // registration. While any observer is registered the CPU executes one
+    // instruction at a time, whichever engine it was built with.
+    void add_observer(ExecutionObserver* observer);
+    void remove_observer(ExecutionObserver* observer);
+    
+    // Stop reporting to observers (and run at full speed) while paused, e.g.
+    // while re-executing instructions they have already seen. Returns the
+    // previous setting so that pauses can nest.
+    bool pause_observers(bool paused) noexcept {
+        bool was_paused = observers_paused;
+        observers_paused = paused;
+        return was_paused;
+    }
 
 private:
     // CPU components
@@ -52,20 +164,116 @@ private:
     std::unique_ptr<Memory> memory;
     
     // Execution state
+    ExecutionEngine engine;
     bool running{false};
     std::set<uint64_t> breakpoints;
+    std::vector<ExecutionObserver*> observers;
+    bool observers_paused{false};
+    
+    bool observed() const noexcept { return !observers.empty() && !observers_paused; }
     
-    // Instruction execution helpers
+    // Where execution last stopped at a breakpoint, and the breakpoint the
+    // current run or step resumes from (executed rather than stopped at)
+    static constexpr uint64_t NO_PC = ~0ULL;
+    uint64_t breakpoint_stop_pc{NO_PC};
+    uint64_t breakpoint_skip_pc{NO_PC};
+    
+    // Target of run_until, kept in breakpoints while it runs
+    uint64_t until_pc{NO_PC};
+    
+    // A watchpoint stopped execution by clearing running
+    bool watch_stop{false};
+    Memory::WatchHit watch_hit{};
+    
+    // Set by whatever stops the current run
+    StopReason stop_reason{StopReason::Halted};
+    
+    // Guest fault that stopped execution
+    Trap trap;
+    
+    // Set when cached code was written or a watchpoint was hit, so the block
+    // engines leave the current block before its next instruction
+    bool leave_block{false};
+    
+    // Advanced SIMD operations, with the best kernels for this host
+    const VectorKernels& vector_kernels;
+    
+    // Decoded instructions keyed by PC, invalidated on writes to code pages
+    DecodeCache decode_cache;
+    
+    // Basic blocks for the block and JIT engines
+    BlockCache block_cache;
+    
+    // Native code for hot blocks, and the host exception (such as an
+    // allocation failure) a JIT helper caught
+    JitCompiler jit;
+    std::exception_ptr jit_exception;
+    
+    // Prepare to continue from a breakpoint or watchpoint stop
+    void resume() noexcept;
+    
+    // Called on reaching a breakpoint; false if the run resumes from it
+    bool stop_at_breakpoint(uint64_t pc) noexcept;
+    
+    // Execute the instruction at PC without resuming from a stop
+    bool execute_step();
+    
+    // Run on the selected engine without resuming from a stop
+    RunResult run_engine(uint64_t max_instructions);
+    
+    // Record a fault at the current PC and stop
+    void raise_fault(FaultKind kind, uint64_t address, uint32_t size, bool write) noexcept {
+        trap = Trap{kind, registers.get_pc(), address, size, write};
+        running = false;
+        leave_block = true;
+        stop_reason = StopReason::Fault;
+    }
+    
+    // Decoded instruction at pc (cached); nullptr if pc cannot be fetched
+    const DecodedEntry* fetch_decoded(uint64_t pc);
+    
+    // Instruction execution helpers; false if the instruction faulted
     Instruction decode_instruction(uint32_t instruction_word) const;
-    void execute_instruction(const Instruction& instr);
+    bool execute_instruction(const Instruction& instr);
+    
+    // Run loops of each engine; return the number of instructions retired
+    uint64_t run_switch(uint64_t max_instructions);
+    uint64_t run_threaded(uint64_t max_instructions);
+    uint64_t run_blocks(uint64_t max_instructions);
+    
+    // Step by step with a RetiredInstruction for the observers
+    uint64_t run_observed(uint64_t max_instructions);
+    
+    // Find or build the basic block starting at pc
+    BasicBlock* lookup_block(uint64_t pc);
+    
+    // Set PC to a branch target; a branch to itself halts the CPU
+    void branch_to(uint64_t pc, uint64_t target) noexcept {
+        registers.set_pc(target);
+        if (target == pc) halt();
+    }
+    
+    void halt() noexcept {
+        running = false;
+        stop_reason = StopReason::Halted;
+    }
+    
+    // Drop all blocks and their native code if the block cache is stale
+    void flush_blocks_if_stale();
+    
+    // Handlers and JIT helpers execute instructions directly
+    friend struct InstructionHandlers;
+    friend struct JitHelpers;
     
     // Instruction implementation methods
     void execute_data_processing(const Instruction& instr);
     void execute_branch(const Instruction& instr);
-    void execute_load_store(const Instruction& instr);
+    bool execute_load_store(const Instruction& instr);
+    bool execute_vector(const Instruction& instr);
     
     // Helper methods
-    bool check_condition(Condition cond) const;
+    // Evaluates the lazily recorded flags against cond
+    bool check_condition(Condition cond) const { return registers.flags().holds(cond); }
     uint64_t get_shifted_operand(uint64_t value, uint8_t shift_type, uint8_t shift_amount) const;
     
     // Memory access helpers with alignment checks
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "instruction.hpp"
+#include "dispatch.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace arm_emulator {
+
+// A decoded instruction together with the guest PC and raw word it came from
+struct DecodedEntry {
+    uint64_t pc{~0ULL};  // Tag; empty slots hold a PC that belongs to another slot
+    uint32_t word{0};
+    Handler handler{nullptr};  // Pre-resolved for the threaded engine
+    bool breakpoint{false};    // Execution stops before this instruction
+    Instruction instr;
+};
+
+// Direct-mapped cache of decoded instructions indexed by guest PC.
+// Entries are invalidated by the CPU whenever memory backing them is written.
+class DecodeCache {
+public:
+    // Number of slots (must be a power of two)
+    static constexpr size_t NUM_ENTRIES = 4096;
+
+    DecodeCache();
+
+    // Return the cached entry for pc, or nullptr on a miss
+    const DecodedEntry* lookup(uint64_t pc) const noexcept {
+        const DecodedEntry& entry = entries[index(pc)];
+        return entry.pc == pc ? &entry : nullptr;
+    }
+
+    // Store a decoded instruction, replacing whatever occupied its slot
+    const DecodedEntry& insert(uint64_t pc, uint32_t word, const Instruction& instr,
+                               bool breakpoint = false);
+
+    // Drop every entry whose instruction overlaps [address, address + size)
+    void invalidate(uint64_t address, size_t size) noexcept;
+
+    // Drop all entries
+    void flush() noexcept;
+
+private:
+    std::vector<DecodedEntry> entries;
+
+    static size_t index(uint64_t pc) noexcept { return (pc >> 2) & (NUM_ENTRIES - 1); }
+    
+    // Tag for an empty slot. Any fixed value such as ~0 could be a guest PC
+    // (a branch can go anywhere), but a PC indexing the next slot can never
+    // be looked up in this one.
+    static uint64_t empty_tag(size_t slot) noexcept { return ((slot + 1) & (NUM_ENTRIES - 1)) << 2; }
+};
+
+} // namespace arm_emulator
\ No newline at end of file
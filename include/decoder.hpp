@@ -6,15 +6,22 @@ namespace arm_emulator {
 
 class Decoder {
 public:
-    // Decode a 32-bit ARM instruction into our internal representation
+    // Decode a 32-bit ARM instruction into our internal representation,
+    // using tables built at compile time from the encoding list in decoder.cpp
     static Instruction decode(uint32_t instruction);
     
+    // The same decoding done field by field; slower, and kept as the
+    // reference the tables are checked against (arm_bench --verify-decoder)
+    static Instruction decode_reference(uint32_t instruction);
+    
 private:
-    // Helper methods for different instruction types
+    // Helper methods for different instruction types (decode_reference)
     static Instruction decode_data_processing_register(uint32_t instruction);
     static Instruction decode_data_processing_immediate(uint32_t instruction);
     static Instruction decode_load_store(uint32_t instruction);
     static Instruction decode_branch(uint32_t instruction);
+    static Instruction decode_simd_data_processing(uint32_t instruction);
+    static Instruction decode_simd_load_store(uint32_t instruction);
 };
 
 } // namespace arm_emulator
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "instruction.hpp"
+
+namespace arm_emulator {
+
+class CPU;
+
+// Interpreter core used by CPU::run and CPU::step_instruction
+enum class ExecutionEngine {
+    Switch,    // Decode, then one central switch on the opcode
+    Threaded,  // Handlers pre-resolved at decode time, dispatched directly
+    Block,     // Cached basic blocks with direct links between static successors
+    Jit        // Block engine that compiles hot blocks to native code
+};
+
+// Executes one instruction completely, including the PC update
+using Handler = void (*)(CPU& cpu, const Instruction& instr);
+
+// Return the specialized handler for an opcode
+Handler resolve_handler(Opcode opcode) noexcept;
+
+} // namespace arm_emulator
\ No newline at end of file
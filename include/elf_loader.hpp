@@ -0,0 +1,31 @@
+#pragma once
+
+#include "mapped_file.hpp"
+#include "memory.hpp"
+#include "symbol_table.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace arm_emulator {
+
+// Loads ELF64 little-endian AArch64 executables. PT_LOAD segments are
+// registered with Memory as lazy regions, so a page is read from the file
+// (or zero-filled for .bss) only when the guest first touches it.
+class ElfLoader {
+public:
+    // True if the file starts with the ELF magic number
+    static bool is_elf(const MappedFile& file) noexcept;
+
+    // Map the segments of an ELF image into memory and return its entry point.
+    // Throws std::runtime_error if the image is malformed or not AArch64.
+    static uint64_t load(const std::shared_ptr<MappedFile>& file, Memory& memory);
+
+    // Defined function and label symbols from the .symtab section, in file
+    // order; empty if the image is stripped. Throws std::runtime_error if the
+    // section headers are malformed.
+    static std::vector<Symbol> read_symbols(const MappedFile& file);
+};
+
+} // namespace arm_emulator
\ No newline at end of file
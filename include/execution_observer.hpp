@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+namespace arm_emulator {
+
+// What a retired instruction did, as reported to an ExecutionObserver
+struct RetiredInstruction {
+    static constexpr uint8_t NO_REGISTER = 0xFF;
+    
+    uint64_t pc{0};
+    uint64_t next_pc{0};              // PC after the instruction (branch target if taken)
+    uint32_t word{0};                 // Raw instruction word
+    uint8_t dest{NO_REGISTER};        // X register written, if any
+    bool memory{false};               // A load or store; address and value are valid
+    bool write{false};                // The access was a store
+    uint8_t size{8};                  // Bytes accessed
+    uint64_t dest_value{0};
+    uint64_t address{0};
+    uint64_t value{0};                // Value stored or loaded (0 for loads into XZR;
+                                      // the low 64 bits of SIMD accesses)
+};
+
+// Receives every instruction a CPU retires (see CPU::add_observer). Called on
+// the thread running the CPU, so implementations must be quick.
+class ExecutionObserver {
+public:
+    virtual ~ExecutionObserver() = default;
+    virtual void on_retire(const RetiredInstruction& retired) = 0;
+};
+
+} // namespace arm_emulator
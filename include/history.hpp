@@ -0,0 +1,72 @@
+#pragma once
+
+#include "cpu.hpp"
+
+#include <cstdint>
+#include <map>
+
+namespace arm_emulator {
+
+// Execution history of a CPU that can be stepped backwards. Guest execution
+// is deterministic, so the history is just a checkpoint (a CPU snapshot,
+// holding only the pages written since the one before) every `interval`
+// retired instructions. Going back restores the nearest earlier checkpoint
+// and executes forward again up to the target instruction.
+//
+// Replays are not reported to the CPU's observers, which have already seen
+// those instructions.
+//
+// Runs must go through the history to be recorded. Anything else that
+// changes the machine state invalidates it; call reset() afterwards.
+class ExecutionHistory {
+public:
+    static constexpr uint64_t DEFAULT_INTERVAL = 100000;
+    static constexpr size_t DEFAULT_MAX_CHECKPOINTS = 1024;
+    
+    // When max_checkpoints is exceeded, every other checkpoint is dropped
+    // and the interval doubles, so memory stays bounded on long runs
+    explicit ExecutionHistory(CPU& cpu, uint64_t interval = DEFAULT_INTERVAL,
+                              size_t max_checkpoints = DEFAULT_MAX_CHECKPOINTS);
+    
+    // Start a new history at the CPU's current state
+    void reset();
+    
+    // CPU::run_for and CPU::run_until, recording checkpoints on the way
+    RunResult run_for(uint64_t max_instructions);
+    RunResult run_until(uint64_t address, uint64_t max_instructions = ~0ULL);
+    
+    // Go back count instructions, or to the start of the history
+    // (StopReason::HistoryStart) if there are fewer
+    RunResult step_back(uint64_t count = 1);
+    
+    // Go back to the latest earlier point at which a breakpoint or watchpoint
+    // stops execution, or to the start of the history
+    RunResult reverse_continue();
+    
+    // Instructions retired since the start of the history
+    uint64_t position() const noexcept { return current; }
+    
+    size_t checkpoint_count() const noexcept { return checkpoints.size(); }
+    uint64_t get_interval() const noexcept { return interval; }
+
+private:
+    CPU& cpu;
+    uint64_t interval;
+    size_t max_checkpoints;
+    uint64_t current{0};
+    
+    // Snapshots keyed by position; there is always one at position 0
+    std::map<uint64_t, CPU::Snapshot> checkpoints;
+    
+    // Run forward, stopping at each multiple of the interval for a checkpoint
+    RunResult advance(uint64_t max_instructions, const uint64_t* until);
+    
+    // Checkpoint the current position unless there is one already
+    void checkpoint();
+    
+    // Restore the nearest checkpoint at or before target and execute up to
+    // target, through any breakpoint and watchpoint stops on the way
+    RunResult replay_to(uint64_t target);
+};
+
+} // namespace arm_emulator
@@ -2,11 +2,12 @@
 
 #include <cstdint>
 #include <string>
+#include <type_traits>
 
 namespace arm_emulator {
 
 // ARM instruction opcodes
-enum class Opcode {
+enum class Opcode : uint8_t {
     // Data processing - register
     ADD,
     SUB,
@@ -14,12 +15,23 @@ enum class Opcode {
     ORR,
     EOR,
     
+    // Flag-setting forms (CMP and TST are SUBS and ANDS to XZR)
+    ADDS,
+    SUBS,
+    ANDS,
+    
+    // Conditional select: rd = cond ? rn : rm
+    CSEL,
+    
     // Data processing - immediate
     ADDI,
     SUBI,
     ANDI,
     ORRI,
     EORI,
+    ADDSI,
+    SUBSI,
+    ANDSI,
     
     // Load/Store
     LDUR,
@@ -31,17 +43,60 @@ enum class Opcode {
     BR,
     BLR,
     RET,
+    B_COND,  // B.cond: branch if cond holds
     
     // Compare and branch
     CBZ,
     CBNZ,
     
+    // Advanced SIMD: integer, logical (16B) and floating-point (4S, 2D)
+    // arithmetic on V registers
+    VADD,
+    VSUB,
+    VMUL,
+    VAND,
+    VORR,
+    VEOR,
+    FADD,
+    FSUB,
+    FMUL,
+    
+    // Advanced SIMD permutes: EXT Vd, Vn, Vm, #imm and TBL Vd, {Vn}, Vm
+    EXT,
+    TBL,
+    
+    // Advanced SIMD moves between X and V registers
+    DUP,   // Every element of Vd = Xn
+    UMOV,  // Xd = element imm of Vn
+    
+    // Advanced SIMD reductions across lanes
+    ADDV,
+    UMAXV,
+    UMINV,
+    
+    // Advanced SIMD load/store of one register, post-indexed by 16 if wback
+    LD1,
+    ST1,
+    
     // Invalid/unknown opcode
     INVALID
 };
 
+// LSL amount applied to rm by a register-form ALU opcode. The shift field
+// (bits 22-23) is also part of the opcode, so each opcode has exactly one.
+constexpr uint8_t register_shift(Opcode opcode) noexcept {
+    switch (opcode) {
+        case Opcode::ADD:
+        case Opcode::ADDS: return 2;
+        case Opcode::SUB:
+        case Opcode::SUBS:
+        case Opcode::ORR:  return 1;
+        default:           return 0;
+    }
+}
+
 // Addressing mode for memory operations
-enum class AddrMode {
+enum class AddrMode : uint8_t {
     OFFSET,     // Base + offset
     PRE_INDEX,  // Pre-indexed
     POST_INDEX, // Post-indexed
@@ -49,7 +104,7 @@ enum class AddrMode {
 };
 
 // Condition codes for conditional execution
-enum class Condition {
+enum class Condition : uint8_t {
     EQ, // Equal
     NE, // Not equal
     CS, // Carry set (HS - unsigned higher or same)
@@ -68,8 +123,13 @@ enum class Condition {
     NV  // Never (reserved)
 };
 
-// Structure representing a single ARM instruction
+// A decoded ARM instruction. It is kept small and trivially copyable so
+// that decoded-instruction caches hold many of them; disassembly text is
+// produced on demand by to_string.
 struct Instruction {
+    // Immediate value; every encoding's immediate fits in 32 bits
+    int32_t imm{0};
+    
     Opcode opcode{Opcode::INVALID};
     Condition cond{Condition::AL};  // Default to always execute
     
@@ -79,24 +139,26 @@ struct Instruction {
     uint8_t rm{0};
     uint8_t ra{0};  // For some instructions like MADD
     
-    // Immediate values
-    int64_t imm{0};
-    uint8_t shift{0};  // Shift amount
+    uint8_t shift{0};  // LSL amount applied to rm (0-3, see register_shift)
+    uint8_t esize{0};  // Vector element size: log2 of its bytes (0 = B ... 3 = D)
     
     // Memory addressing
     AddrMode addr_mode{AddrMode::OFFSET};
     bool wback{false};  // Writeback flag for pre/post-indexed addressing
     
-    // Original assembly text (for debugging)
-    std::string raw_text;
-    
     // Helper methods
     bool is_branch() const;
     bool is_memory_op() const;
+    bool is_vector() const { return opcode >= Opcode::VADD && opcode <= Opcode::ST1; }
     bool is_conditional() const { return cond != Condition::AL; }
     
-    // Convert instruction to string for debugging
+    // Convert instruction to string for debugging. The text is remembered
+    // in a table shared by all instructions, so showing the same
+    // instruction again does not format it again.
     std::string to_string() const;
 };
 
+static_assert(std::is_trivially_copyable_v<Instruction>, "Instruction must stay trivially copyable");
+static_assert(sizeof(Instruction) <= 16, "Instruction must stay within 16 bytes");
+
 } // namespace arm_emulator
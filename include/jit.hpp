@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace arm_emulator {
+
+class CPU;
+struct BasicBlock;
+
+// Native code for one basic block. Runs the block against the register array
+// and returns a JitStatus; the guest PC is stored in the register array on exit.
+using JitFunction = int (*)(uint64_t* registers, CPU* cpu);
+
+enum JitStatus : int {
+    JIT_OK = 0,          // Block completed
+    JIT_FAULT = 1,       // An instruction faulted; PC is the faulting instruction
+    JIT_EXIT = 2         // Cached code was written or a watchpoint hit; PC is the following instruction
+};
+
+// Number of interpreted executions before a block is compiled
+constexpr uint32_t JIT_HOT_THRESHOLD = 64;
+
+// Translates hot basic blocks to x86-64 machine code. On other hosts
+// compile() always returns nullptr and blocks stay interpreted.
+class JitCompiler {
+public:
+    // Size of the executable code arena in bytes
+    static constexpr size_t ARENA_SIZE = 16 * 1024 * 1024;
+
+    JitCompiler();
+    ~JitCompiler();
+
+    JitCompiler(const JitCompiler&) = delete;
+    JitCompiler& operator=(const JitCompiler&) = delete;
+
+    // True if native code can be generated on this host
+    bool available() const noexcept { return arena != nullptr; }
+
+    // Compile a block; returns nullptr if the arena is full or the host is unsupported
+    JitFunction compile(const BasicBlock& block);
+
+    // Discard all generated code; no compiled block may run afterwards
+    void reset() noexcept { used = 0; }
+
+private:
+    uint8_t* arena{nullptr};
+    size_t used{0};
+};
+
+} // namespace arm_emulator
\ No newline at end of file
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "cpu.hpp"
+#include "batch_runner.hpp"
+#include "decode_cache.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace arm_emulator {
+
+// Runs one guest program on many inputs at once. Each lane is a full CPU
+// whose memory starts out shared copy-on-write with the others; while the
+// lanes agree on the PC their X registers live in a structure-of-arrays
+// file (one row per register, one column per lane) and each instruction is
+// executed for all lanes by a vector kernel (flag-setting instructions and
+// conditions are evaluated lane by lane). Lanes that branch away from
+// the group, or fault, leave it and finish on their own CPU.
+class LockstepEngine {
+public:
+    // Vector kernels for the ALU instructions, picked from what the host supports
+    enum class Kernel { Scalar, AVX2, AVX512 };
+
+    static Kernel best_kernel() noexcept;
+    static const char* to_string(Kernel kernel) noexcept;
+
+    // Lanes run split-off work on scalar_engine
+    explicit LockstepEngine(size_t lanes,
+                            ExecutionEngine scalar_engine = ExecutionEngine::Switch,
+                            uint64_t memory_size = Memory::DEFAULT_SIZE,
+                            Kernel kernel = best_kernel());
+
+    // Load a program image into every lane (see CPU::load_program_file)
+    bool load_program_file(const std::string& path, uint64_t address = 0);
+    bool load_program(const std::vector<uint8_t>& program, uint64_t address = 0);
+
+    // Per-lane state, e.g. to give each lane its own input before run()
+    size_t lane_count() const noexcept { return lanes.size(); }
+    CPU& lane(size_t index) { return *lanes[index]; }
+    const CPU& lane(size_t index) const { return *lanes[index]; }
+
+    Kernel get_kernel() const noexcept { return kernel; }
+
+    // Run every lane until it halts, faults or has retired max_instructions.
+    // Lanes that do not start at lane 0's PC run on their own from the start.
+    std::vector<BatchResult> run(uint64_t max_instructions = ~0ULL);
+
+private:
+    // Rows X0-X30 plus a row of zeros for XZR
+    static constexpr size_t ROWS = 32;
+
+    std::vector<std::unique_ptr<CPU>> lanes;
+    Kernel kernel;
+
+    // Structure-of-arrays register file; register r of lane i is at
+    // file[r * stride + i], with stride a multiple of the widest vector
+    std::vector<uint64_t> file;
+    size_t stride{0};
+    
+    // Condition flags of each lane
+    std::vector<ConditionFlags> flags;
+
+    // Instructions decoded while in lockstep. Their pages are marked as code
+    // in every lane's memory, and writes to them invalidate the entries
+    // through the memory's code-write callback.
+    DecodeCache decoded;
+
+    // Lanes running together, and lanes to finish on their own CPU
+    std::vector<size_t> active;
+    std::vector<size_t> scalar;
+
+    // Scratch space for filtering active and resolving branch targets
+    std::vector<size_t> kept;
+    std::vector<std::pair<size_t, uint64_t>> targets;
+
+    uint64_t* row(size_t reg) noexcept { return file.data() + reg * stride; }
+
+    // Fetch the instruction at pc for the active lanes. Lanes that fault or
+    // hold a different word there leave; nullptr if none are left.
+    const DecodedEntry* fetch(uint64_t pc, std::vector<BatchResult>& results, uint64_t retired);
+
+    // Copy a lane's registers out of the file, with PC at the instruction it
+    // has yet to execute, and hand it over to scalar execution
+    void leave(size_t lane, uint64_t pc, uint64_t retired, std::vector<BatchResult>& results);
+
+    // Finish a lane on its own CPU
+    void run_scalar(size_t lane, BatchResult& result, uint64_t max_instructions);
+};
+
+} // namespace arm_emulator
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace arm_emulator {
+
+// A file mapped privately into host memory. Writes through data() are
+// copy-on-write and never reach the file. On hosts without mmap the file
+// is read into a heap buffer instead.
+class MappedFile {
+public:
+    // Map the whole file; throws std::runtime_error on failure
+    static std::shared_ptr<MappedFile> open(const std::string& path);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    uint8_t* data() noexcept { return base; }
+    const uint8_t* data() const noexcept { return base; }
+    size_t size() const noexcept { return length; }
+
+private:
+    MappedFile() = default;
+
+    uint8_t* base{nullptr};
+    size_t length{0};
+    bool mapped{false};               // base came from mmap
+    std::vector<uint8_t> fallback;    // Owns the data when mmap is unavailable
+};
+
+} // namespace arm_emulator
\ No newline at end of file
@@ -1,43 +1,366 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <stdexcept>
 #include <string>
 
 namespace arm_emulator {
 
+class MappedFile;
+
+// Sparse guest memory. The address space is split into pages that are
+// allocated on first write; unwritten pages read as zero. A small direct-mapped
+// software TLB in front of the page table maps guest pages to host pointers.
+//
+// Pages written since the last snapshot live in a private overlay. Taking a
+// snapshot freezes the overlay into an immutable layer shared with the
+// snapshot, and later writes copy a frozen page into the overlay first, so
+// both snapshot() and restore() cost O(pages touched since the snapshot).
 class Memory {
+    struct Page;
+    struct PageLayer;
+    struct LazyRegion;
+    using PageMap = std::unordered_map<uint64_t, Page>;
+    using LazyRegionMap = std::map<uint64_t, LazyRegion>;
+
 public:
-    // Initialize memory with the specified size in bytes
-    explicit Memory(size_t size = 1024 * 1024);  // Default to 1MB
-    
-    // Reset all memory to zero
+    static constexpr unsigned PAGE_SHIFT = 12;
+    static constexpr uint64_t PAGE_SIZE = 1ULL << PAGE_SHIFT;
+    static constexpr uint64_t PAGE_MASK = PAGE_SIZE - 1;
+
+    // Number of TLB entries (must be a power of two)
+    static constexpr size_t TLB_ENTRIES = 64;
+
+    // Default address space: 4GB, enough for the load address and initial SP
+    static constexpr uint64_t DEFAULT_SIZE = 1ULL << 32;
+
+    // Initialize an address space of the specified size in bytes
+    explicit Memory(uint64_t size = DEFAULT_SIZE);
+
+    // Reset all memory to zero (releases every page)
     void reset() noexcept;
+
+    // Memory access methods with bounds checking; throw std::runtime_error
+    // on addresses outside the address space
+    uint8_t read8(uint64_t address) const { return read<uint8_t>(address); }
+    uint32_t read32(uint64_t address) const { return read<uint32_t>(address); }
+    uint64_t read64(uint64_t address) const { return read<uint64_t>(address); }
+
+    void write8(uint64_t address, uint8_t value) { write<uint8_t>(address, value); }
+    void write32(uint64_t address, uint32_t value) { write<uint32_t>(address, value); }
+    void write64(uint64_t address, uint64_t value) { write<uint64_t>(address, value); }
+    
+    // Guest accesses for the execution engines: return false instead of
+    // throwing when out of bounds, leaving value and memory unchanged
+    bool try_read64(uint64_t address, uint64_t& value) const {
+        return try_read<uint64_t, true>(address, value);
+    }
+    bool try_write64(uint64_t address, uint64_t value) { return try_write<uint64_t>(address, value); }
     
-    // Memory access methods with bounds checking
-    uint8_t read8(uint64_t address) const;
-    uint32_t read32(uint64_t address) const;
-    uint64_t read64(uint64_t address) const;
+    // 16-byte guest accesses for the SIMD loads and stores, in memory order
+    bool try_read128(uint64_t address, uint8_t* bytes) const {
+        uint64_t page = address >> PAGE_SHIFT;
+        uint64_t offset = address & PAGE_MASK;
+        const TlbEntry& entry = read_tlb[tlb_index(page)];
+        if (entry.tag == page && offset <= PAGE_SIZE - 16) {
+            std::memcpy(bytes, entry.host + offset, 16);
+            return true;
+        }
+        return read_bytes_slow(address, 16, true, bytes);
+    }
+    bool try_write128(uint64_t address, const uint8_t* bytes) {
+        uint64_t page = address >> PAGE_SHIFT;
+        uint64_t offset = address & PAGE_MASK;
+        const TlbEntry& entry = write_tlb[tlb_index(page)];
+        if (entry.tag == page && offset <= PAGE_SIZE - 16) {
+            std::memcpy(entry.host + offset, bytes, 16);
+            return true;
+        }
+        return write_bytes_slow(address, bytes, 16);
+    }
     
-    void write8(uint64_t address, uint8_t value);
-    void write32(uint64_t address, uint32_t value);
-    void write64(uint64_t address, uint64_t value);
+    // Instruction fetch: like try_read, but never triggers watchpoints
+    bool try_fetch32(uint64_t address, uint32_t& value) const {
+        return try_read<uint32_t, false>(address, value);
+    }
     
+    // True if [address, address + size) lies inside the address space
+    bool contains(uint64_t address, uint64_t size) const noexcept {
+        return address + size <= limit && address + size >= address;
+    }
+
     // Load binary data into memory at the specified address
     void load_binary(uint64_t address, const std::vector<uint8_t>& data);
     
-    // Get the size of the memory in bytes
-    size_t size() const noexcept { return memory.size(); }
+    // Map length bytes of a file, starting at offset, to the given address without
+    // copying. Pages point straight into the mapping and are copied on first
+    // write. Falls back to copying if address and offset are not both
+    // page-aligned.
+    void map_file(uint64_t address, const std::shared_ptr<MappedFile>& file,
+                  uint64_t offset, uint64_t length);
     
+    // Make [address, address + mem_size) available on demand: each page is filled
+    // from the file (file_size bytes starting at offset) or zero-filled past it,
+    // only when first accessed. Used for ELF segments, including .bss.
+    void map_file_lazy(uint64_t address, uint64_t mem_size,
+                       const std::shared_ptr<MappedFile>& file,
+                       uint64_t offset, uint64_t file_size);
+
+    // Get the size of the address space in bytes
+    uint64_t size() const noexcept { return limit; }
+
+    // Number of pages held privately, i.e. touched since the last snapshot
+    size_t dirty_pages() const noexcept { return pages.size(); }
+
+    // An immutable view of the address space contents. Copies are cheap and
+    // share pages with each other and with every Memory they are restored into.
+    class Snapshot {
+    public:
+        Snapshot() = default;
+
+    private:
+        friend class Memory;
+        std::shared_ptr<const PageLayer> layer;
+        std::shared_ptr<const LazyRegionMap> lazy_regions;
+        uint64_t limit{0};
+    };
+
+    // Capture the current contents. Pages touched since the previous snapshot
+    // become shared with the returned snapshot and are copied again on write.
+    Snapshot snapshot();
+
+    // Return to the contents captured by a snapshot of an address space of the
+    // same size. Cached code on pages that may change is reported through the
+    // code-write callback.
+    void restore(const Snapshot& snapshot);
+
+    // Call visit(address, data) for each page with contents, in ascending
+    // address order. Pages never written read as zero and are skipped, as
+    // are untouched lazy pages past their region's file data (.bss). data is
+    // only valid during the call.
+    void for_each_page(const std::function<void(uint64_t, const uint8_t*)>& visit) const;
+
     // Dump memory region to string (for debugging)
     std::string dump_memory(uint64_t start, uint64_t end) const;
 
+    // Mark the page containing address as holding cached decoded instructions.
+    // Writes that touch a marked page are reported through the code-write callback.
+    void mark_code_page(uint64_t address);
+
+    // The callback invoked with (address, size) when a write hits a code page
+    void set_code_write_callback(std::function<void(uint64_t, size_t)> callback) {
+        on_code_write = std::move(callback);
+    }
+    const std::function<void(uint64_t, size_t)>& get_code_write_callback() const noexcept {
+        return on_code_write;
+    }
+
+    // Data watchpoints. Pages holding a watched range are kept out of the
+    // TLB for the watched kind of access, so accesses to every other page
+    // take the fast path exactly as when nothing is watched.
+    enum class WatchKind : uint8_t { Read = 1, Write = 2, Access = 3 };
+
+    struct Watchpoint {
+        uint64_t address;
+        uint64_t size;
+        WatchKind kind;
+    };
+
+    struct WatchHit {
+        uint64_t address;  // Start of the access
+        size_t size;
+        bool write;
+    };
+
+    // Watch [address, address + size); replaces a watchpoint at the same address
+    void add_watchpoint(uint64_t address, uint64_t size, WatchKind kind);
+
+    // Remove the watchpoint starting at address; false if there was none
+    bool remove_watchpoint(uint64_t address);
+
+    // Remove every watchpoint
+    void clear_watchpoints() noexcept;
+
+    const std::vector<Watchpoint>& get_watchpoints() const noexcept { return watchpoints; }
+
+    // Set the callback invoked before a read or write that overlaps a watchpoint
+    // is performed. Instruction fetches and dump_memory() do not trigger it.
+    void set_watch_callback(std::function<void(const WatchHit&)> callback) {
+        on_watch = std::move(callback);
+    }
+
 private:
-    std::vector<uint8_t> memory;
+    struct Page {
+        // Heap-allocated, or aliasing a MappedFile that it keeps alive. A null
+        // pointer hides older layers so the page comes from the lazy regions.
+        std::shared_ptr<uint8_t> data;
+        bool owned{false};  // Private to this Memory and writable in place
+    };
+
+    // Pages frozen by a snapshot, over the older layers they shadow. Layers
+    // are merged as they are pushed so chains stay logarithmically short.
+    struct PageLayer {
+        PageMap pages;
+        std::shared_ptr<const PageLayer> parent;
+    };
+
+    // A range populated from a file on first touch
+    struct LazyRegion {
+        uint64_t end;  // One past the last address
+        std::shared_ptr<MappedFile> file;
+        uint64_t offset;
+        uint64_t file_size;
+    };
+
+    struct TlbEntry {
+        uint64_t tag{~0ULL};  // Guest page number
+        uint8_t* host{nullptr};
+    };
+
+    uint64_t limit;
+    
+    // Private overlay. Populating a lazy page is invisible to the guest, so
+    // reads may do it.
+    mutable PageMap pages;
+    std::shared_ptr<const PageLayer> base;            // Shared with snapshots
+    std::shared_ptr<const LazyRegionMap> lazy_regions;  // Keyed by start address
+    
+    // Pages holding cached decoded instructions
+    std::unordered_set<uint64_t> code_pages;
+    std::function<void(uint64_t, size_t)> on_code_write;
+    
+    // Watchpoints and the pages they cover for each kind of access
+    std::vector<Watchpoint> watchpoints;
+    std::unordered_set<uint64_t> read_watch_pages;
+    std::unordered_set<uint64_t> write_watch_pages;
+    std::function<void(const WatchHit&)> on_watch;
+
+    // Reads may map unallocated pages to the shared zero page; writes only
+    // map owned pages without cached code, so the fast path never has to
+    // allocate, copy or notify. Neither maps pages watched for its kind of
+    // access.
+    mutable std::array<TlbEntry, TLB_ENTRIES> read_tlb;
+    std::array<TlbEntry, TLB_ENTRIES> write_tlb;
+
+    static size_t tlb_index(uint64_t page) noexcept { return page & (TLB_ENTRIES - 1); }
+
+    // Fast path: one tag compare and a copy when the access stays inside a mapped page
+    template <typename T, bool Watched>
+    bool try_read(uint64_t address, T& value) const {
+        uint64_t page = address >> PAGE_SHIFT;
+        uint64_t offset = address & PAGE_MASK;
+        const TlbEntry& entry = read_tlb[tlb_index(page)];
+        if (entry.tag == page && offset <= PAGE_SIZE - sizeof(T)) {
+            T raw;
+            std::memcpy(&raw, entry.host + offset, sizeof(T));
+            value = from_little_endian(raw);
+            return true;
+        }
+        uint64_t wide = 0;
+        if (!read_slow(address, sizeof(T), Watched, wide)) return false;
+        value = static_cast<T>(wide);
+        return true;
+    }
+
+    template <typename T>
+    bool try_write(uint64_t address, T value) {
+        uint64_t page = address >> PAGE_SHIFT;
+        uint64_t offset = address & PAGE_MASK;
+        const TlbEntry& entry = write_tlb[tlb_index(page)];
+        if (entry.tag == page && offset <= PAGE_SIZE - sizeof(T)) {
+            value = from_little_endian(value);
+            std::memcpy(entry.host + offset, &value, sizeof(T));
+            return true;
+        }
+        return write_slow(address, value, sizeof(T));
+    }
+
+    template <typename T, bool Watched = true>
+    T read(uint64_t address) const {
+        T value;
+        if (!try_read<T, Watched>(address, value)) throw_out_of_bounds(address, sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    void write(uint64_t address, T value) {
+        if (!try_write<T>(address, value)) throw_out_of_bounds(address, sizeof(T));
+    }
+
+    // Guest memory is little-endian
+    template <typename T>
+    static T from_little_endian(T value) noexcept {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        T swapped = 0;
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            swapped = static_cast<T>((swapped << 8) | ((value >> (i * 8)) & 0xFF));
+        }
+        return swapped;
+#else
+        return value;
+#endif
+    }
+
+    // Bounds-checked accesses that may cross pages and refill the TLB; false
+    // if out of bounds. Reads check watchpoints only if watched is set.
+    bool read_slow(uint64_t address, size_t size, bool watched, uint64_t& value) const;
+    bool write_slow(uint64_t address, uint64_t value, size_t size);
+    
+    // The same for size bytes in memory order
+    bool read_bytes_slow(uint64_t address, size_t size, bool watched, uint8_t* bytes) const;
+    bool write_bytes_slow(uint64_t address, const uint8_t* bytes, size_t size);
+    
+    // Report an access to the watch callback if it overlaps a watchpoint
+    void check_watch(uint64_t address, size_t size, bool write) const;
+    
+    // Recompute the watched page sets and drop their TLB entries
+    void update_watch_pages();
+
+    // Look up a page's contents without allocating; nullptr if it has never
+    // been written. Pages of lazy regions are populated here on first access.
+    const uint8_t* find_page(uint64_t page) const;
+    
+    // Search the overlay and the frozen layers; nullptr if no layer has the page
+    const Page* find_layered(uint64_t page) const;
+    
+    // Build a page from the lazy regions covering it; nullptr if there are none
+    const uint8_t* populate_lazy(uint64_t page) const;
     
+    // Lazy regions overlapping a page, as (start, region) pairs
+    using LazyCover = std::vector<std::pair<uint64_t, const LazyRegion*>>;
+    LazyCover lazy_cover(uint64_t page) const;
+    
+    // The page's bytes inside the mapping if it lies wholly in one region's
+    // page-aligned file data, else nullptr
+    static uint8_t* lazy_alias(uint64_t page, const LazyCover& cover);
+    
+    // Copy the file-backed parts of the covering regions into a zeroed page
+    static void fill_lazy(uint64_t page, const LazyCover& cover, uint8_t* data);
+
+    // Look up a page for writing, allocating or copying it into the overlay
+    uint8_t* get_page(uint64_t page);
+    
+    // Replace the backing of a page with shared data that is copied on write
+    void install_page(uint64_t page, std::shared_ptr<uint8_t> data);
+
+    // Drop a page from both TLBs
+    void evict_tlb(uint64_t page) noexcept;
+    void flush_tlb() noexcept;
+
+    // Notify the code-write callback if [address, address + size) touches a code page
+    void check_code_write(uint64_t address, size_t size);
+
     // Helper method to check if an address is valid
     void check_address(uint64_t address, size_t size) const;
+    [[noreturn]] static void throw_out_of_bounds(uint64_t address, size_t size);
 };
 
-} // namespace arm_emulator
+} // namespace arm_emulator
\ No newline at end of file
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "cpu.hpp"
+#include "symbol_table.hpp"
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <unordered_map>
+#include <utility>
+
+namespace arm_emulator {
+
+// Sampling profiler. The guest runs in chunks of `period` instructions on
+// whichever engine the CPU uses, and the PC and link register are recorded
+// between chunks, so the engines themselves pay nothing for profiling.
+// Reports name addresses with a symbol table when one is available.
+class Profiler {
+public:
+    explicit Profiler(uint64_t period = 1000, SymbolTable symbols = SymbolTable());
+    
+    // Run like CPU::run_for, sampling every period retired instructions. The
+    // sampling phase carries over between calls.
+    RunResult run(CPU& cpu, uint64_t max_instructions = ~0ULL);
+    
+    uint64_t get_period() const noexcept { return period; }
+    uint64_t sample_count() const noexcept { return samples; }
+    
+    // Forget every sample
+    void clear() noexcept;
+    
+    // Samples per function, then per address, each limited to the top entries
+    void write_flat(std::ostream& out, size_t top = 20) const;
+    
+    // One "caller;function count" line per stack, as taken by flamegraph.pl
+    // and speedscope. The caller is the symbol holding X30 - 4 (the BL that
+    // made the call); it is left out when there is no such symbol or it is
+    // the sampled function itself.
+    void write_collapsed(std::ostream& out) const;
+
+private:
+    uint64_t period;
+    uint64_t until_sample;  // Instructions left before the next sample
+    uint64_t samples{0};
+    SymbolTable symbols;
+    
+    // Sample counts by PC, and by (PC, link register) for the stacks
+    std::unordered_map<uint64_t, uint64_t> hot_addresses;
+    std::map<std::pair<uint64_t, uint64_t>, uint64_t> stacks;
+    
+    void sample(const CPU& cpu);
+    
+    // Function name for a report; unsymbolized addresses stand for themselves
+    std::string function_name(uint64_t address) const;
+};
+
+} // namespace arm_emulator
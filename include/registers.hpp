@@ -1,7 +1,10 @@
 #pragma once
 
+#include "condition_flags.hpp"
+
 #include <array>
 #include <cstdint>
+#include <cstring>
 #include <stdexcept>
 #include <string>
 
@@ -10,12 +13,35 @@ namespace arm_emulator {
 // Number of general-purpose registers (X0-X30)
 constexpr size_t NUM_REGISTERS = 31;
 
+// Number of SIMD&FP registers (V0-V31)
+constexpr size_t NUM_VECTOR_REGISTERS = 32;
+
+// A 128-bit SIMD&FP register. Bytes are in guest (little-endian) order, so
+// element i of any arrangement starts at byte i * element size; the element
+// accessors assume a little-endian host, as the SIMD kernels do.
+struct alignas(16) VectorRegister {
+    uint8_t bytes[16];
+    
+    template <typename T>
+    T get(size_t index) const noexcept {
+        T value;
+        std::memcpy(&value, bytes + index * sizeof(T), sizeof(T));
+        return value;
+    }
+    
+    template <typename T>
+    void set(size_t index, T value) noexcept {
+        std::memcpy(bytes + index * sizeof(T), &value, sizeof(T));
+    }
+};
+
 // Special register indices
 enum class SpecialRegister {
     XZR = 31,  // Zero register (reads as 0, writes ignored)
     SP = 32,    // Stack pointer
     PC = 33,    // Program counter
-    NUM_SPECIAL_REGISTERS = 34
+    NZCV = 34,  // Condition flags in bits 31-28
+    NUM_SPECIAL_REGISTERS = 35
 };
 
 // Total number of registers including special ones
@@ -28,22 +54,51 @@ public:
     // Reset all registers to zero
     void reset() noexcept;
     
-    // Register access by index (0-30 for X0-X30, 31 for XZR, 32 for SP, 33 for PC)
+    // Register access by index (0-30 for X0-X30, 31 for XZR, 32 for SP, 33 for
+    // PC, 34 for NZCV)
     uint64_t get_register(size_t index) const;
     void set_register(size_t index, uint64_t value) noexcept;
     
+    // Unchecked access for the execution hot path (index 0-31 as decoded from an
+    // instruction). Slot 31 is never written, so reading it yields XZR's zero.
+    uint64_t read_x(size_t index) const noexcept { return registers[index]; }
+    void write_x(size_t index, uint64_t value) noexcept {
+        if (index != static_cast<size_t>(SpecialRegister::XZR)) registers[index] = value;
+    }
+    
+    // Base of the register array; generated code addresses registers at
+    // fixed offsets (index * 8) from it
+    uint64_t* data() noexcept { return registers.data(); }
+    
     // Convenience methods for special registers
-    uint64_t get_pc() const { return get_register(static_cast<size_t>(SpecialRegister::PC)); }
-    void set_pc(uint64_t value) { set_register(static_cast<size_t>(SpecialRegister::PC), value); }
+    uint64_t get_pc() const noexcept { return registers[static_cast<size_t>(SpecialRegister::PC)]; }
+    void set_pc(uint64_t value) noexcept { registers[static_cast<size_t>(SpecialRegister::PC)] = value; }
+    
+    uint64_t get_sp() const noexcept { return registers[static_cast<size_t>(SpecialRegister::SP)]; }
+    void set_sp(uint64_t value) noexcept { registers[static_cast<size_t>(SpecialRegister::SP)] = value; }
+    
+    // Condition flags, recorded by flag-setting instructions
+    ConditionFlags& flags() noexcept { return condition_flags; }
+    const ConditionFlags& flags() const noexcept { return condition_flags; }
+    
+    // Offset of the condition flags from data(), for generated code
+    static size_t flags_offset() noexcept;
+    
+    // SIMD&FP registers V0-V31 (index 0-31 as decoded from an instruction)
+    VectorRegister& vector(size_t index) noexcept { return vector_registers[index]; }
+    const VectorRegister& vector(size_t index) const noexcept { return vector_registers[index]; }
     
-    uint64_t get_sp() const { return get_register(static_cast<size_t>(SpecialRegister::SP)); }
-    void set_sp(uint64_t value) { set_register(static_cast<size_t>(SpecialRegister::SP), value); }
+    // Offset of V0 from data(), for generated code
+    static size_t vector_offset() noexcept;
     
     // Dump all registers to string for debugging
     std::string to_string() const;
 
 private:
-    std::array<uint64_t, TOTAL_REGISTERS> registers;
+    // X0-X30, XZR, SP and PC; NZCV is computed from condition_flags
+    std::array<uint64_t, static_cast<size_t>(SpecialRegister::PC) + 1> registers;
+    ConditionFlags condition_flags;
+    std::array<VectorRegister, NUM_VECTOR_REGISTERS> vector_registers;
 };
 
 } // namespace arm_emulator
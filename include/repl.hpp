@@ -2,6 +2,12 @@
 #pragma once
 
 #include "cpu.hpp"
+#include "branch_predictor.hpp"
+#include "cache_model.hpp"
+#include "history.hpp"
+#include "symbol_table.hpp"
+#include "trace.hpp"
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -14,21 +20,56 @@ public:
     // Start the REPL
     void run();
     
+    // Symbols of the loaded program, used to label profiles
+    void set_symbols(SymbolTable table) { symbols = std::move(table); }
+    
+    // Cache model attached to the CPU, reported by the cache command
+    void set_cache_model(const CacheHierarchy* model) { cache_model = model; }
+    
+    // Branch predictor models attached to the CPU, reported by the branches command
+    void set_branch_models(std::vector<const BranchModel*> models) { branch_models = std::move(models); }
+    
 private:
     CPU& cpu;
+    SymbolTable symbols;
+    
+    // Runs and steps are recorded so they can be undone
+    ExecutionHistory history;
+    
+    const CacheHierarchy* cache_model{nullptr};
+    std::vector<const BranchModel*> branch_models;
+    
+    // Trace started with the trace command
+    std::unique_ptr<TraceWriter> trace;
     
     // Process a single command
     bool process_command(const std::string& line);
     
     // Command handlers
     void handle_step();
-    void handle_run();
+    void handle_run(const std::vector<std::string>& args);
+    void handle_until(const std::vector<std::string>& args);
+    void handle_reverse_step(const std::vector<std::string>& args);
+    void handle_reverse_continue();
     void handle_break(const std::vector<std::string>& args);
+    void handle_delete(const std::vector<std::string>& args);
+    void handle_watch(const std::vector<std::string>& args);
+    void handle_unwatch(const std::vector<std::string>& args);
     void handle_register(const std::vector<std::string>& args);
     void handle_memory(const std::vector<std::string>& args);
+    void handle_save(const std::vector<std::string>& args);
+    void handle_load(const std::vector<std::string>& args);
+    void handle_profile(const std::vector<std::string>& args);
+    void handle_trace(const std::vector<std::string>& args);
+    void handle_cache() const;
+    void handle_branches() const;
     void handle_help() const;
     
     // Helper methods
+    void stop_trace();
+    void report_stop(const RunResult& result) const;
+    void report_reverse(const RunResult& result) const;
+    void report_cause(StopReason reason) const;
     void print_state() const;
     std::vector<std::string> split_line(const std::string& line) const;
 };
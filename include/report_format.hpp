@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+namespace arm_emulator {
+
+// part / whole as a percentage with two decimals, e.g. "12.50%"; "0.00%"
+// when whole is 0. Shared by the cache and branch predictor reports.
+inline std::string percent(uint64_t part, uint64_t whole) {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(2)
+        << (whole ? 100.0 * static_cast<double>(part) / static_cast<double>(whole) : 0.0) << "%";
+    return oss.str();
+}
+
+} // namespace arm_emulator
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "registers.hpp"
+#include "memory.hpp"
+
+#include <cstdint>
+#include <string>
+
+namespace arm_emulator {
+
+// Saves and loads machine state as a versioned little-endian file:
+//
+//   header         magic "ARMSNAP\0", version, flags, address space size,
+//                  register count, page size, page count, table offsets
+//   registers      register count x u64: X0-X30, XZR, SP, PC, then NZCV
+//                  from version 2
+//   vectors        from version 3: V0-V31, each as its low then high u64
+//   page table     page count x u64 guest address, ascending
+//   page data      page count x page size bytes, starting on a page boundary
+//
+// Only pages that are not entirely zero are stored. Because page data is
+// page-aligned, loading maps the file and points guest pages straight into
+// it; nothing is parsed or copied until the guest writes a page.
+class SnapshotFile {
+public:
+    // Version 2 added NZCV and version 3 the vector registers. Older files
+    // still load, with whatever they lack cleared.
+    static constexpr uint32_t VERSION = 3;
+
+    // Write registers and memory contents to path. Throws std::runtime_error on failure.
+    static void save(const std::string& path, const Registers& registers,
+                     const Memory& memory, bool running);
+
+    // Replace registers and memory with the contents of a snapshot file and
+    // return its running flag. The address space size must match. Throws
+    // std::runtime_error if the file is malformed.
+    static bool load(const std::string& path, Registers& registers, Memory& memory);
+};
+
+} // namespace arm_emulator
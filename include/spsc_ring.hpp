@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace arm_emulator {
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+// Each side owns one index and only reads the other's, so neither side ever
+// waits for the other while there is room or data.
+template <typename T>
+class SpscRing {
+public:
+    // Capacity is rounded up to a power of two
+    explicit SpscRing(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        slots.resize(size);
+        mask = size - 1;
+    }
+    
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+    
+    // Producer: false if the ring is full
+    bool try_push(const T& value) noexcept {
+        size_t head = write_index.load(std::memory_order_relaxed);
+        if (head - cached_read_index > mask) {
+            cached_read_index = read_index.load(std::memory_order_acquire);
+            if (head - cached_read_index > mask) return false;
+        }
+        slots[head & mask] = value;
+        write_index.store(head + 1, std::memory_order_release);
+        return true;
+    }
+    
+    // Consumer: move up to max elements into out; returns how many
+    size_t pop(T* out, size_t max) noexcept {
+        size_t tail = read_index.load(std::memory_order_relaxed);
+        size_t available = write_index.load(std::memory_order_acquire) - tail;
+        size_t count = available < max ? available : max;
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = slots[(tail + i) & mask];
+        }
+        read_index.store(tail + count, std::memory_order_release);
+        return count;
+    }
+    
+    size_t capacity() const noexcept { return mask + 1; }
+
+private:
+    std::vector<T> slots;
+    size_t mask{0};
+    
+    // Indices grow without wrapping; each sits on its own cache line
+    alignas(64) std::atomic<size_t> write_index{0};
+    size_t cached_read_index{0};  // Producer's last view of read_index
+    alignas(64) std::atomic<size_t> read_index{0};
+};
+
+} // namespace arm_emulator
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace arm_emulator {
+
+struct Symbol {
+    uint64_t address{0};
+    uint64_t size{0};  // 0 if unknown; the symbol then extends to the next one
+    std::string name;
+};
+
+// Address-to-symbol index. Start addresses are kept in their own sorted
+// array, so a lookup is a binary search over contiguous integers.
+class SymbolTable {
+public:
+    SymbolTable() = default;
+    explicit SymbolTable(std::vector<Symbol> symbols);
+    
+    // Symbols of an ELF executable's .symtab; empty for other files or
+    // stripped executables. Throws std::runtime_error if the file can't be read.
+    static SymbolTable from_file(const std::string& path);
+    
+    // The symbol containing address, or nullptr
+    const Symbol* find(uint64_t address) const noexcept;
+    
+    // "name+0x10" for addresses inside a symbol, otherwise "0x..."
+    std::string describe(uint64_t address) const;
+    
+    bool empty() const noexcept { return symbols.empty(); }
+    size_t size() const noexcept { return symbols.size(); }
+
+private:
+    std::vector<uint64_t> starts;  // symbols[i].address, for the search
+    std::vector<Symbol> symbols;   // Sorted by address
+};
+
+} // namespace arm_emulator
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "execution_observer.hpp"
+#include "spsc_ring.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace arm_emulator {
+
+// Binary execution traces. After an 8-byte magic, each record is a flags
+// byte followed by only what the flags say cannot be predicted from the
+// previous records: the PC unless it follows on from the last one, the
+// next PC unless it is PC + 4, the word unless the last record at a nearby
+// PC had the same one, and register and memory values as variable-length
+// deltas. A loop body typically costs a few bytes per instruction.
+struct TraceContext {
+    static constexpr size_t WORD_SLOTS = 4096;
+    
+    uint64_t next_pc{0};
+    std::array<uint32_t, WORD_SLOTS> words{};  // Last word seen, by PC
+    std::array<uint64_t, 31> registers{};      // Last value written, by register
+    uint64_t address{0};
+    uint64_t value{0};
+    
+    static size_t slot(uint64_t pc) noexcept { return (pc >> 2) & (WORD_SLOTS - 1); }
+};
+
+// Writes the instructions a CPU retires to a trace file. The CPU thread
+// only copies each record into a lock-free ring; a background thread
+// encodes and writes them. The CPU waits only if the writer falls a whole
+// ring behind.
+class TraceWriter : public ExecutionObserver {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 1 << 16;
+    
+    // Throws std::runtime_error if the file cannot be created
+    explicit TraceWriter(const std::string& path, size_t capacity = DEFAULT_CAPACITY);
+    ~TraceWriter() override;
+    
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+    
+    void on_retire(const RetiredInstruction& retired) override;
+    
+    // Write out everything recorded and close the file; no records may be
+    // added afterwards. Throws std::runtime_error if writing failed.
+    void close();
+    
+    // Records handed to the writer so far
+    uint64_t record_count() const noexcept { return records; }
+
+private:
+    SpscRing<RetiredInstruction> ring;
+    std::ofstream out;
+    std::thread writer;
+    std::atomic<bool> closing{false};
+    uint64_t records{0};
+    
+    // Writer thread: drain the ring until closing, then once more
+    void drain();
+};
+
+// Reads a trace file back, one record at a time
+class TraceReader {
+public:
+    // Throws std::runtime_error if the file cannot be opened or is not a trace
+    explicit TraceReader(const std::string& path);
+    
+    // False at the end of the trace. Throws std::runtime_error if the trace
+    // is truncated or corrupt.
+    bool next(RetiredInstruction& retired);
+
+private:
+    std::ifstream in;
+    TraceContext context;
+};
+
+} // namespace arm_emulator
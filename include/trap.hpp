@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace arm_emulator {
+
+// Guest faults. The execution engines record them in a Trap and stop
+// instead of throwing, so a faulting guest is as cheap as a halting one.
+enum class FaultKind : uint8_t {
+    None,
+    MemoryOutOfBounds,     // Load or store outside the address space
+    FetchOutOfBounds,      // Instruction fetch outside the address space
+    UndefinedInstruction,  // Word that decodes to no implemented instruction
+};
+
+const char* to_string(FaultKind kind) noexcept;
+
+// The fault that stopped a CPU. PC is left at the faulting instruction.
+struct Trap {
+    FaultKind kind{FaultKind::None};
+    uint64_t pc{0};        // Faulting instruction
+    uint64_t address{0};   // Address accessed (the PC for fetches and undefined instructions)
+    uint32_t size{0};      // Access size in bytes
+    bool write{false};     // Store rather than load or fetch
+    
+    explicit operator bool() const noexcept { return kind != FaultKind::None; }
+    
+    // Human-readable description; only built when someone asks for it
+    std::string to_string() const;
+};
+
+} // namespace arm_emulator
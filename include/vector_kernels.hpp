@@ -0,0 +1,80 @@
+#pragma once
+
+#include "instruction.hpp"
+#include "registers.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace arm_emulator {
+
+// Host implementations of the Advanced SIMD instructions: one function per
+// operation and element size, where the element size is log2 of its bytes
+// (0 = B, 1 = H, 2 = S, 3 = D). Sizes an instruction does not have are null.
+// Destinations may alias sources.
+struct VectorKernels {
+    // Two-source operations (Vd = Vn op Vm)
+    enum Op : uint8_t { Add, Sub, Mul, And, Orr, Eor, FAdd, FSub, FMul, Tbl, BINARY_OPS };
+
+    // Across-lanes reductions into element 0 of Vd; the other elements are cleared
+    enum Reduction : uint8_t { AddV, UMaxV, UMinV, REDUCTIONS };
+
+    using Binary = void (*)(VectorRegister& d, const VectorRegister& n, const VectorRegister& m);
+    using Reduce = void (*)(VectorRegister& d, const VectorRegister& n);
+    using Dup = void (*)(VectorRegister& d, uint64_t value);
+    using Extract = void (*)(VectorRegister& d, const VectorRegister& n, const VectorRegister& m,
+                             unsigned index);
+
+    Binary binary[BINARY_OPS][4];
+    Reduce reduce[REDUCTIONS][4];
+    Dup dup[4];
+    Extract ext;  // Bytes index..15 of Vn, then bytes 0..index-1 of Vm
+
+    // Kernel sets; SSE41 needs an x86-64 host with SSSE3 and SSE4.1
+    enum class Set { Scalar, SSE41 };
+
+    static bool is_supported(Set set) noexcept;
+    static Set best_set() noexcept;
+    static const char* to_string(Set set) noexcept;
+    static const VectorKernels& get(Set set) noexcept;
+
+    // The best set for this host, chosen on first use
+    static const VectorKernels& host() noexcept;
+};
+
+// Kernel operation of a two-source vector opcode (VADD ... TBL)
+constexpr VectorKernels::Op vector_op(Opcode opcode) noexcept {
+    switch (opcode) {
+        case Opcode::VSUB: return VectorKernels::Sub;
+        case Opcode::VMUL: return VectorKernels::Mul;
+        case Opcode::VAND: return VectorKernels::And;
+        case Opcode::VORR: return VectorKernels::Orr;
+        case Opcode::VEOR: return VectorKernels::Eor;
+        case Opcode::FADD: return VectorKernels::FAdd;
+        case Opcode::FSUB: return VectorKernels::FSub;
+        case Opcode::FMUL: return VectorKernels::FMul;
+        case Opcode::TBL:  return VectorKernels::Tbl;
+        default:           return VectorKernels::Add;
+    }
+}
+
+// Kernel reduction of an across-lanes opcode (ADDV, UMAXV, UMINV)
+constexpr VectorKernels::Reduction vector_reduction(Opcode opcode) noexcept {
+    switch (opcode) {
+        case Opcode::UMAXV: return VectorKernels::UMaxV;
+        case Opcode::UMINV: return VectorKernels::UMinV;
+        default:            return VectorKernels::AddV;
+    }
+}
+
+// Element index of a vector register, zero-extended (UMOV)
+inline uint64_t vector_element(const VectorRegister& v, unsigned esize, size_t index) noexcept {
+    switch (esize) {
+        case 0: return v.get<uint8_t>(index);
+        case 1: return v.get<uint16_t>(index);
+        case 2: return v.get<uint32_t>(index);
+        default: return v.get<uint64_t>(index);
+    }
+}
+
+} // namespace arm_emulator
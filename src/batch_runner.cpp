@@ -0,0 +1,193 @@
+#include "batch_runner.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace arm_emulator {
+
+BatchRunner::BatchRunner(unsigned threads, ExecutionEngine engine, uint64_t memory_size)
+    : threads(threads), engine(engine), memory_size(memory_size) {
+    if (this->threads == 0) {
+        this->threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+std::vector<BatchResult> BatchRunner::run(const std::vector<BatchJob>& jobs) {
+    std::vector<BatchResult> results(jobs.size());
+    if (jobs.empty()) return results;
+    
+    // Deal out contiguous ranges so neighbouring jobs tend to share a worker
+    unsigned workers = static_cast<unsigned>(std::min<size_t>(threads, jobs.size()));
+    std::vector<WorkQueue> queues(workers);
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        queues[i * workers / jobs.size()].jobs.push_back(i);
+    }
+    
+    std::vector<std::thread> pool;
+    pool.reserve(workers - 1);
+    for (unsigned w = 1; w < workers; ++w) {
+        pool.emplace_back([&, w] { work(w, queues, jobs, results); });
+    }
+    work(0, queues, jobs, results);
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    return results;
+}
+
+void BatchRunner::work(unsigned self, std::vector<WorkQueue>& queues,
+                       const std::vector<BatchJob>& jobs, std::vector<BatchResult>& results) const {
+    size_t count = queues.size();
+    while (true) {
+        size_t job = 0;
+        bool found = false;
+        
+        {
+            std::lock_guard<std::mutex> guard(queues[self].lock);
+            if (!queues[self].jobs.empty()) {
+                job = queues[self].jobs.back();
+                queues[self].jobs.pop_back();
+                found = true;
+            }
+        }
+        
+        // Jobs never spawn jobs, so once a full sweep finds nothing we are done
+        for (size_t k = 1; k < count && !found; ++k) {
+            WorkQueue& victim = queues[(self + k) % count];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.jobs.empty()) {
+                job = victim.jobs.front();
+                victim.jobs.pop_front();
+                found = true;
+            }
+        }
+        if (!found) return;
+        
+        // Each job writes only its own slot
+        results[job] = run_job(jobs[job]);
+    }
+}
+
+BatchResult BatchRunner::run_job(const BatchJob& job) const {
+    BatchResult result;
+    try {
+        CPU cpu(memory_size, engine);
+        if (!cpu.load_program_file(job.image, job.load_address)) {
+            return result;
+        }
+        for (const auto& [index, value] : job.registers) {
+            cpu.get_registers().set_register(index, value);
+        }
+        
+        RunResult run = cpu.run_for(job.max_instructions);
+        result.reason = run.reason;
+        result.instructions = run.instructions;
+        result.trap = cpu.get_trap();
+        result.registers = cpu.get_registers();
+    } catch (const std::exception& e) {
+        std::cerr << "Job " << job.image << ": " << e.what() << std::endl;
+        result.reason = StopReason::Fault;
+    }
+    return result;
+}
+
+namespace {
+
+// Register index for X0-X30, SP, PC or NZCV (case-insensitive); -1 if unknown
+int parse_register(std::string name) {
+    std::transform(name.begin(), name.end(), name.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+    if (name == "SP") return static_cast<int>(SpecialRegister::SP);
+    if (name == "PC") return static_cast<int>(SpecialRegister::PC);
+    if (name == "NZCV") return static_cast<int>(SpecialRegister::NZCV);
+    if (name.size() >= 2 && name[0] == 'X' &&
+        std::all_of(name.begin() + 1, name.end(), [](unsigned char c) { return std::isdigit(c); })) {
+        int index = std::stoi(name.substr(1));
+        if (index < static_cast<int>(NUM_REGISTERS)) return index;
+    }
+    return -1;
+}
+
+// A whole token as a number in any base std::stoull accepts; throws
+// std::invalid_argument on anything else, including trailing characters
+uint64_t parse_number(const std::string& text) {
+    size_t end = 0;
+    uint64_t value = std::stoull(text, &end, 0);
+    if (end != text.size()) throw std::invalid_argument(text);
+    return value;
+}
+
+} // namespace
+
+std::vector<BatchJob> read_batch_jobs(std::istream& in) {
+    std::vector<BatchJob> jobs;
+    std::string line;
+    size_t line_number = 0;
+    
+    while (std::getline(in, line)) {
+        ++line_number;
+        std::istringstream fields(line);
+        std::string token;
+        if (!(fields >> token) || token[0] == '#') continue;
+        
+        BatchJob job;
+        job.image = token;
+        try {
+            bool first = true;
+            while (fields >> token) {
+                auto eq = token.find('=');
+                if (eq == std::string::npos) {
+                    if (!first) throw std::invalid_argument(token);
+                    job.load_address = parse_number(token);
+                } else {
+                    std::string key = token.substr(0, eq);
+                    uint64_t value = parse_number(token.substr(eq + 1));
+                    if (key == "max") {
+                        job.max_instructions = value;
+                    } else {
+                        int index = parse_register(key);
+                        if (index < 0) throw std::invalid_argument(key);
+                        job.registers.emplace_back(static_cast<size_t>(index), value);
+                    }
+                }
+                first = false;
+            }
+        } catch (const std::exception&) {
+            throw std::runtime_error("Invalid job on line " + std::to_string(line_number) +
+                                     ": " + token);
+        }
+        jobs.push_back(std::move(job));
+    }
+    
+    return jobs;
+}
+
+void write_batch_results(std::ostream& out, const std::vector<BatchJob>& jobs,
+                         const std::vector<BatchResult>& results) {
+    std::ostringstream line;
+    for (size_t i = 0; i < jobs.size() && i < results.size(); ++i) {
+        const BatchResult& result = results[i];
+        line.str("");
+        line << std::dec << i << " " << jobs[i].image << " " << to_string(result.reason)
+             << " " << result.instructions << std::hex
+             << " PC=0x" << result.registers.get_pc()
+             << " SP=0x" << result.registers.get_sp();
+        for (size_t r = 0; r < NUM_REGISTERS; ++r) {
+            uint64_t value = result.registers.get_register(r);
+            if (value != 0) line << " X" << std::dec << r << "=0x" << std::hex << value;
+        }
+        if (uint64_t nzcv = result.registers.get_register(static_cast<size_t>(SpecialRegister::NZCV))) {
+            line << " NZCV=0x" << nzcv;
+        }
+        if (result.trap) {
+            line << " trap=" << to_string(result.trap.kind) << "@0x" << result.trap.address;
+        }
+        out << line.str() << "\n";
+    }
+}
+
+} // namespace arm_emulator
@@ -0,0 +1,39 @@
+#include "block_cache.hpp"
+
+namespace arm_emulator {
+
+BasicBlock* BlockCache::find(uint64_t pc) const {
+    auto it = blocks.find(pc);
+    return it != blocks.end() ? it->second.get() : nullptr;
+}
+
+BasicBlock* BlockCache::insert(std::unique_ptr<BasicBlock> block) {
+    BasicBlock* raw = block.get();
+    blocks[raw->start_pc] = std::move(block);
+    return raw;
+}
+
+void BlockCache::invalidate(uint64_t address, size_t size) noexcept {
+    if (stale || size == 0 || blocks.empty()) return;
+
+    // Blocks are bounded in length, so only those starting shortly before
+    // the write can reach into it
+    constexpr uint64_t max_span = MAX_BLOCK_INSTRUCTIONS * sizeof(uint32_t);
+    uint64_t lower = address > max_span ? address - max_span : 0;
+    for (auto it = blocks.lower_bound(lower);
+         it != blocks.end() && it->first < address + size; ++it) {
+        if (it->second->end_pc > address) {
+            stale = true;
+            return;
+        }
+    }
+}
+
+bool BlockCache::flush_if_stale() {
+    if (!stale) return false;
+    blocks.clear();
+    stale = false;
+    return true;
+}
+
+} // namespace arm_emulator
\ No newline at end of file
@@ -0,0 +1,321 @@
+#include "branch_predictor.hpp"
+#include "decoder.hpp"
+#include "report_format.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace arm_emulator {
+
+namespace {
+
+// Two-bit saturating counter: 0-1 predict not taken, 2-3 predict taken
+void train(uint8_t& counter, bool taken) noexcept {
+    if (taken) {
+        if (counter < 3) ++counter;
+    } else if (counter > 0) {
+        --counter;
+    }
+}
+
+// XOR-folds the low `length` bits of the history into `bits` bits
+uint64_t fold(uint64_t history, unsigned length, unsigned bits) noexcept {
+    if (length < 64) history &= (uint64_t{1} << length) - 1;
+    uint64_t folded = 0;
+    for (; history != 0; history >>= bits) {
+        folded ^= history & ((uint64_t{1} << bits) - 1);
+    }
+    return folded;
+}
+
+} // namespace
+
+std::unique_ptr<BranchPredictor> BranchPredictor::create(const std::string& spec) {
+    std::vector<unsigned> fields;
+    std::istringstream in(spec);
+    std::string kind;
+    std::getline(in, kind, ':');
+    try {
+        for (std::string field; std::getline(in, field, ':');) {
+            fields.push_back(static_cast<unsigned>(std::stoul(field)));
+        }
+    } catch (const std::logic_error&) {
+        throw std::invalid_argument("Bad branch predictor spec: " + spec);
+    }
+    for (unsigned bits : fields) {
+        if (bits == 0 || bits > 28) {
+            throw std::invalid_argument("Branch predictor table and history bits must be 1-28: " + spec);
+        }
+    }
+    
+    if (kind == "bimodal" && fields.size() <= 1) {
+        return std::make_unique<BimodalPredictor>(fields.empty() ? 12 : fields[0]);
+    }
+    if (kind == "gshare" && fields.size() <= 2) {
+        unsigned index_bits = fields.empty() ? 14 : fields[0];
+        return std::make_unique<GsharePredictor>(index_bits, fields.size() > 1 ? fields[1] : index_bits);
+    }
+    if (kind == "tage" && fields.empty()) {
+        return std::make_unique<TagePredictor>();
+    }
+    throw std::invalid_argument("Branch predictor must be bimodal[:bits], gshare[:bits[:history]] or tage: " + spec);
+}
+
+BimodalPredictor::BimodalPredictor(unsigned index_bits)
+    : counters(size_t{1} << index_bits, 1), mask((uint64_t{1} << index_bits) - 1) {}
+
+bool BimodalPredictor::predict(uint64_t pc) {
+    return counters[(pc >> 2) & mask] >= 2;
+}
+
+void BimodalPredictor::update(uint64_t pc, bool taken) {
+    train(counters[(pc >> 2) & mask], taken);
+}
+
+std::string BimodalPredictor::name() const {
+    unsigned bits = 0;
+    while ((uint64_t{1} << bits) < counters.size()) ++bits;
+    return "bimodal:" + std::to_string(bits);
+}
+
+GsharePredictor::GsharePredictor(unsigned index_bits, unsigned history_bits_)
+    : counters(size_t{1} << index_bits, 1), mask((uint64_t{1} << index_bits) - 1),
+      history_bits(history_bits_) {}
+
+size_t GsharePredictor::index(uint64_t pc) const noexcept {
+    return ((pc >> 2) ^ history) & mask;
+}
+
+bool GsharePredictor::predict(uint64_t pc) {
+    return counters[index(pc)] >= 2;
+}
+
+void GsharePredictor::update(uint64_t pc, bool taken) {
+    train(counters[index(pc)], taken);
+    history = ((history << 1) | (taken ? 1 : 0)) & ((uint64_t{1} << history_bits) - 1);
+}
+
+std::string GsharePredictor::name() const {
+    unsigned bits = 0;
+    while ((uint64_t{1} << bits) < counters.size()) ++bits;
+    return "gshare:" + std::to_string(bits) + ":" + std::to_string(history_bits);
+}
+
+TagePredictor::TagePredictor() : base(12) {
+    for (auto& table : tables) {
+        table.resize(size_t{1} << INDEX_BITS);
+    }
+}
+
+bool TagePredictor::predict(uint64_t pc) {
+    uint64_t address = pc >> 2;
+    for (unsigned t = 0; t < TABLES; ++t) {
+        unsigned length = HISTORY_LENGTHS[t];
+        indices[t] = (address ^ (address >> INDEX_BITS) ^ fold(history, length, INDEX_BITS)) &
+                     ((size_t{1} << INDEX_BITS) - 1);
+        tags[t] = static_cast<uint16_t>((address ^ fold(history, length, TAG_BITS) ^
+                                         (fold(history, length, TAG_BITS - 1) << 1)) &
+                                        ((1u << TAG_BITS) - 1));
+    }
+    
+    // The longest matching history provides the prediction and the next
+    // longest (or the base predictor) the alternate
+    provider = -1;
+    int alternate = -1;
+    for (int t = TABLES - 1; t >= 0; --t) {
+        if (tables[t][indices[t]].tag == tags[t]) {
+            if (provider < 0) {
+                provider = t;
+            } else {
+                alternate = t;
+                break;
+            }
+        }
+    }
+    
+    bool base_prediction = base.predict(pc);
+    alternate_prediction = alternate >= 0 ? tables[alternate][indices[alternate]].counter >= 0
+                                          : base_prediction;
+    provider_prediction = provider >= 0 ? tables[provider][indices[provider]].counter >= 0
+                                        : base_prediction;
+    return provider_prediction;
+}
+
+void TagePredictor::update(uint64_t pc, bool taken) {
+    if (provider >= 0) {
+        Entry& entry = tables[provider][indices[provider]];
+        if (provider_prediction != alternate_prediction) {
+            if (provider_prediction == taken) {
+                if (entry.useful < 3) ++entry.useful;
+            } else if (entry.useful > 0) {
+                --entry.useful;
+            }
+        }
+        if (taken) {
+            if (entry.counter < 3) ++entry.counter;
+        } else if (entry.counter > -4) {
+            --entry.counter;
+        }
+    } else {
+        base.update(pc, taken);
+    }
+    
+    // On a misprediction, take over an entry no longer useful in a table with
+    // longer history, or age the candidates so one frees up later
+    if (provider_prediction != taken && provider < static_cast<int>(TABLES) - 1) {
+        bool allocated = false;
+        for (unsigned t = static_cast<unsigned>(provider + 1); t < TABLES; ++t) {
+            Entry& entry = tables[t][indices[t]];
+            if (entry.useful == 0) {
+                entry = Entry{tags[t], static_cast<int8_t>(taken ? 0 : -1), 0};
+                allocated = true;
+                break;
+            }
+        }
+        if (!allocated) {
+            for (unsigned t = static_cast<unsigned>(provider + 1); t < TABLES; ++t) {
+                Entry& entry = tables[t][indices[t]];
+                if (entry.useful > 0) --entry.useful;
+            }
+        }
+    }
+    
+    if (++updates % USEFUL_RESET_PERIOD == 0) {
+        for (auto& table : tables) {
+            for (auto& entry : table) {
+                entry.useful >>= 1;
+            }
+        }
+    }
+    history = (history << 1) | (taken ? 1 : 0);
+}
+
+BranchModel::BranchModel(std::unique_ptr<BranchPredictor> predictor_, size_t ras_depth)
+    : predictor(std::move(predictor_)), predictor_name(predictor->name()), ras(ras_depth) {
+    if (ras_depth == 0) {
+        throw std::invalid_argument("Return-address stack depth must be at least 1");
+    }
+}
+
+void BranchModel::on_retire(const RetiredInstruction& retired) {
+    on_branch(Decoder::decode(retired.word).opcode, retired.pc, retired.next_pc);
+}
+
+void BranchModel::on_branch(Opcode opcode, uint64_t pc, uint64_t target) {
+    Kind kind;
+    switch (opcode) {
+        case Opcode::B_COND:
+        case Opcode::CBZ:
+        case Opcode::CBNZ:
+            kind = Conditional;
+            break;
+        case Opcode::B:
+        case Opcode::BL:
+            kind = Direct;
+            break;
+        case Opcode::BR:
+        case Opcode::BLR:
+            kind = Indirect;
+            break;
+        case Opcode::RET:
+            kind = Return;
+            break;
+        default:
+            return;
+    }
+    
+    bool taken = target != pc + 4;
+    bool mispredicted = false;
+    
+    if (kind == Conditional) {
+        mispredicted = predictor->predict(pc) != taken;
+        predictor->update(pc, taken);
+    } else if (kind == Indirect) {
+        auto [it, inserted] = targets.try_emplace(pc, target);
+        mispredicted = inserted || it->second != target;
+        it->second = target;
+    } else if (kind == Return) {
+        if (ras_size == 0) {
+            mispredicted = true;
+        } else {
+            ras_top = (ras_top + ras.size() - 1) % ras.size();
+            --ras_size;
+            mispredicted = ras[ras_top] != target;
+        }
+    }
+    
+    if (opcode == Opcode::BL || opcode == Opcode::BLR) {
+        ras[ras_top] = pc + 4;
+        ras_top = (ras_top + 1) % ras.size();
+        ras_size = std::min(ras_size + 1, ras.size());
+    }
+    
+    Site& site = sites.try_emplace(pc, Site{kind, {}}).first->second;
+    for (Stats* stats : {&site.stats, &totals[kind]}) {
+        ++stats->executed;
+        stats->taken += taken;
+        stats->mispredicted += mispredicted;
+    }
+}
+
+uint64_t BranchModel::executed() const noexcept {
+    uint64_t count = 0;
+    for (const Stats& stats : totals) count += stats.executed;
+    return count;
+}
+
+uint64_t BranchModel::mispredicted() const noexcept {
+    uint64_t count = 0;
+    for (const Stats& stats : totals) count += stats.mispredicted;
+    return count;
+}
+
+const char* BranchModel::kind_name(Kind kind) noexcept {
+    switch (kind) {
+        case Conditional: return "conditional";
+        case Direct: return "direct";
+        case Indirect: return "indirect";
+        case Return: return "return";
+        default: return "?";
+    }
+}
+
+void BranchModel::write_report(std::ostream& out, const SymbolTable& symbols, size_t top) const {
+    out << std::dec << "branch predictor " << predictor_name << ", " << ras.size()
+        << "-entry return-address stack\n"
+        << "kind            executed   mispredicts  mispredict rate\n";
+    Stats all;
+    for (int kind = 0; kind < KINDS; ++kind) {
+        const Stats& s = totals[kind];
+        out << std::left << std::setw(12) << kind_name(static_cast<Kind>(kind)) << std::right
+            << std::setw(12) << s.executed << std::setw(14) << s.mispredicted << std::setw(17)
+            << percent(s.mispredicted, s.executed) << "\n";
+        all.executed += s.executed;
+        all.mispredicted += s.mispredicted;
+    }
+    out << std::left << std::setw(12) << "total" << std::right << std::setw(12) << all.executed
+        << std::setw(14) << all.mispredicted << std::setw(17)
+        << percent(all.mispredicted, all.executed) << "\n";
+    
+    std::vector<std::pair<uint64_t, Site>> by_pc(sites.begin(), sites.end());
+    std::sort(by_pc.begin(), by_pc.end(), [](const auto& a, const auto& b) {
+        return a.second.stats.mispredicted != b.second.stats.mispredicted
+                   ? a.second.stats.mispredicted > b.second.stats.mispredicted
+                   : a.first < b.first;
+    });
+    out << "\npc          kind            executed     taken   mispredicts  mispredict rate\n";
+    for (size_t i = 0; i < by_pc.size() && i < top && by_pc[i].second.stats.mispredicted > 0; ++i) {
+        const auto& [pc, site] = by_pc[i];
+        const Stats& s = site.stats;
+        out << "0x" << std::hex << std::setw(8) << std::setfill('0') << pc << std::dec
+            << std::setfill(' ') << "  " << std::left << std::setw(12) << kind_name(site.kind)
+            << std::right << std::setw(12) << s.executed << std::setw(10) << percent(s.taken, s.executed)
+            << std::setw(14) << s.mispredicted << std::setw(17) << percent(s.mispredicted, s.executed);
+        if (!symbols.empty()) out << "  " << symbols.describe(pc);
+        out << "\n";
+    }
+}
+
+} // namespace arm_emulator
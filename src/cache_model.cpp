@@ -0,0 +1,226 @@
+#include "cache_model.hpp"
+#include "report_format.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace arm_emulator {
+
+namespace {
+
+bool is_power_of_two(uint64_t value) noexcept {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+uint64_t parse_size(const std::string& text) {
+    size_t end = 0;
+    uint64_t value = std::stoull(text, &end, 0);
+    std::string suffix = text.substr(end);
+    if (suffix == "k" || suffix == "K") return value << 10;
+    if (suffix == "m" || suffix == "M") return value << 20;
+    if (!suffix.empty()) throw std::invalid_argument("Bad size: " + text);
+    return value;
+}
+
+std::vector<std::string> split(const std::string& text, char separator) {
+    std::vector<std::string> parts;
+    std::istringstream in(text);
+    std::string part;
+    while (std::getline(in, part, separator)) {
+        parts.push_back(part);
+    }
+    return parts;
+}
+
+} // namespace
+
+CacheConfig CacheConfig::parse(const std::string& spec) {
+    auto fields = split(spec, ':');
+    if (fields.size() < 3 || fields.size() > 4) {
+        throw std::invalid_argument("Cache spec must be size:ways:line[:policy]: " + spec);
+    }
+    
+    CacheConfig config;
+    try {
+        config.size = parse_size(fields[0]);
+        config.associativity = static_cast<unsigned>(std::stoul(fields[1]));
+        config.line_size = static_cast<unsigned>(std::stoul(fields[2]));
+    } catch (const std::logic_error&) {
+        throw std::invalid_argument("Bad cache spec: " + spec);
+    }
+    if (fields.size() == 4) {
+        if (fields[3] == "lru") {
+            config.policy = ReplacementPolicy::LRU;
+        } else if (fields[3] == "fifo") {
+            config.policy = ReplacementPolicy::FIFO;
+        } else if (fields[3] == "random") {
+            config.policy = ReplacementPolicy::Random;
+        } else {
+            throw std::invalid_argument("Replacement policy must be lru, fifo or random: " + spec);
+        }
+    }
+    return config;
+}
+
+Cache::Cache(const CacheConfig& config_) : config(config_) {
+    uint64_t set_bytes = static_cast<uint64_t>(config.associativity) * config.line_size;
+    if (!is_power_of_two(config.line_size) || config.associativity == 0 ||
+        config.size % set_bytes != 0 || !is_power_of_two(config.size / set_bytes)) {
+        throw std::invalid_argument("Cache line size and number of sets must be powers of two");
+    }
+    
+    lines.resize(config.size / config.line_size);
+    line_mask = config.line_size - 1;
+    line_shift = 0;
+    while ((1ULL << line_shift) < config.line_size) ++line_shift;
+    set_mask = config.size / set_bytes - 1;
+}
+
+Cache::Result Cache::access(uint64_t address, bool write) {
+    uint64_t line_number = address >> line_shift;
+    uint64_t tag = line_number;  // The full line number, so victims' addresses can be rebuilt
+    Line* set = &lines[(line_number & set_mask) * config.associativity];
+    ++clock;
+    
+    Line* victim = set;
+    for (unsigned way = 0; way < config.associativity; ++way) {
+        Line& line = set[way];
+        if (line.valid && line.tag == tag) {
+            ++hits;
+            if (config.policy == ReplacementPolicy::LRU) line.stamp = clock;
+            line.dirty |= write;
+            return Result{true, false, 0};
+        }
+        // Prefer an empty way, then the oldest stamp
+        if (!victim->valid) continue;
+        if (!line.valid || line.stamp < victim->stamp) victim = &line;
+    }
+    
+    ++misses;
+    if (config.policy == ReplacementPolicy::Random && victim->valid) {
+        random_state ^= random_state << 13;
+        random_state ^= random_state >> 7;
+        random_state ^= random_state << 17;
+        victim = &set[random_state % config.associativity];
+    }
+    
+    Result result{false, victim->valid && victim->dirty, victim->tag << line_shift};
+    if (result.writeback) ++writebacks;
+    *victim = Line{tag, clock, true, write};
+    return result;
+}
+
+CacheHierarchy::Config CacheHierarchy::Config::parse(const std::string& spec) {
+    Config config;
+    if (spec == "default" || spec.empty()) return config;
+    
+    for (const std::string& item : split(spec, ',')) {
+        size_t equals = item.find('=');
+        if (equals == std::string::npos) {
+            throw std::invalid_argument("Expected level=spec: " + item);
+        }
+        std::string level = item.substr(0, equals);
+        std::string value = item.substr(equals + 1);
+        if (level == "l1i") {
+            config.l1i = CacheConfig::parse(value);
+        } else if (level == "l1d") {
+            config.l1d = CacheConfig::parse(value);
+        } else if (level == "l2") {
+            config.l2 = CacheConfig::parse(value);
+        } else if (level == "region") {
+            config.region_size = parse_size(value);
+            if (!is_power_of_two(config.region_size)) {
+                throw std::invalid_argument("Region size must be a power of two: " + value);
+            }
+        } else {
+            throw std::invalid_argument("Unknown cache level: " + level);
+        }
+    }
+    return config;
+}
+
+CacheHierarchy::CacheHierarchy(const Config& config)
+    : l1i_cache(config.l1i), l1d_cache(config.l1d), l2_cache(config.l2),
+      region_size(config.region_size) {}
+
+unsigned CacheHierarchy::access(Cache& l1, uint64_t address, size_t size, bool write) {
+    unsigned l1_misses = 0;
+    uint64_t first = l1.line_address(address);
+    uint64_t last = l1.line_address(address + size - 1);
+    for (uint64_t line = first;; line += l1.get_config().line_size) {
+        Cache::Result result = l1.access(line, write);
+        if (!result.hit) {
+            ++l1_misses;
+            l2_cache.access(line, false);
+        }
+        if (result.writeback) {
+            l2_cache.access(result.victim_address, true);
+        }
+        if (line == last) break;
+    }
+    return l1_misses;
+}
+
+void CacheHierarchy::on_retire(const RetiredInstruction& retired) {
+    PcStats& stats = pcs[retired.pc];
+    ++stats.fetches;
+    stats.fetch_misses += access(l1i_cache, retired.pc, sizeof(uint32_t), false);
+    
+    if (retired.memory) {
+        unsigned misses = access(l1d_cache, retired.address, retired.size, retired.write);
+        ++stats.data_accesses;
+        stats.data_misses += misses;
+        
+        RegionStats& region = regions[retired.address & ~(region_size - 1)];
+        ++region.accesses;
+        region.misses += misses;
+    }
+}
+
+void CacheHierarchy::write_report(std::ostream& out, const SymbolTable& symbols, size_t top) const {
+    out << std::dec << "cache    accesses        misses   miss rate  writebacks\n";
+    auto level = [&](const char* name, const Cache& cache) {
+        uint64_t accesses = cache.hits + cache.misses;
+        out << std::left << std::setw(5) << name << std::right << std::setw(12) << accesses
+            << std::setw(14) << cache.misses << std::setw(12) << percent(cache.misses, accesses)
+            << std::setw(12) << cache.writebacks << "\n";
+    };
+    level("L1I", l1i_cache);
+    level("L1D", l1d_cache);
+    level("L2", l2_cache);
+    
+    // PCs by total L1 misses
+    std::vector<std::pair<uint64_t, PcStats>> by_pc(pcs.begin(), pcs.end());
+    auto pc_misses = [](const PcStats& s) { return s.fetch_misses + s.data_misses; };
+    std::sort(by_pc.begin(), by_pc.end(), [&](const auto& a, const auto& b) {
+        return pc_misses(a.second) != pc_misses(b.second) ? pc_misses(a.second) > pc_misses(b.second)
+                                                          : a.first < b.first;
+    });
+    out << "\npc                fetches  I-misses  accesses  D-misses  D-miss rate\n";
+    for (size_t i = 0; i < by_pc.size() && i < top && pc_misses(by_pc[i].second) > 0; ++i) {
+        const auto& [pc, s] = by_pc[i];
+        out << "0x" << std::hex << std::setw(8) << std::setfill('0') << pc << std::dec
+            << std::setfill(' ') << std::setw(14) << s.fetches << std::setw(10) << s.fetch_misses
+            << std::setw(10) << s.data_accesses << std::setw(10) << s.data_misses << std::setw(13)
+            << percent(s.data_misses, s.data_accesses);
+        if (!symbols.empty()) out << "  " << symbols.describe(pc);
+        out << "\n";
+    }
+    
+    std::vector<std::pair<uint64_t, RegionStats>> by_region(regions.begin(), regions.end());
+    std::sort(by_region.begin(), by_region.end(), [](const auto& a, const auto& b) {
+        return a.second.misses != b.second.misses ? a.second.misses > b.second.misses
+                                                  : a.first < b.first;
+    });
+    out << "\nregion (" << region_size << " bytes)    accesses    misses  miss rate\n";
+    for (size_t i = 0; i < by_region.size() && i < top; ++i) {
+        const auto& [base, s] = by_region[i];
+        out << "0x" << std::hex << std::setw(16) << std::setfill('0') << base << std::dec
+            << std::setfill(' ') << std::setw(14) << s.accesses << std::setw(10) << s.misses
+            << std::setw(11) << percent(s.misses, s.accesses) << "\n";
+    }
+}
+
+} // namespace arm_emulator
@@ -1,27 +1,170 @@
 #include "cpu.hpp"
 #include "decoder.hpp"
 #include "instruction.hpp"
+#include "mapped_file.hpp"
+#include "elf_loader.hpp"
+#include "snapshot_file.hpp"
+#include <algorithm>
 #include <sstream>
 #include <iostream>
 
 namespace arm_emulator {
 
-CPU::CPU(size_t memory_size) : memory(std::make_unique<Memory>(memory_size)) {
+namespace {
+
+// X register an instruction writes, if any
+uint8_t destination_register(const Instruction& instr) noexcept {
+    switch (instr.opcode) {
+        case Opcode::ADD:
+        case Opcode::SUB:
+        case Opcode::AND:
+        case Opcode::ORR:
+        case Opcode::EOR:
+        case Opcode::ADDS:
+        case Opcode::SUBS:
+        case Opcode::ANDS:
+        case Opcode::CSEL:
+        case Opcode::ADDI:
+        case Opcode::SUBI:
+        case Opcode::ANDI:
+        case Opcode::ORRI:
+        case Opcode::EORI:
+        case Opcode::ADDSI:
+        case Opcode::SUBSI:
+        case Opcode::ANDSI:
+        case Opcode::LDUR:
+        case Opcode::UMOV:
+            return instr.rd == static_cast<uint8_t>(SpecialRegister::XZR)
+                       ? RetiredInstruction::NO_REGISTER : instr.rd;
+        case Opcode::BL:
+        case Opcode::BLR:
+            return 30;
+        default:
+            return RetiredInstruction::NO_REGISTER;
+    }
+}
+
+} // namespace
+
+CPU::CPU(uint64_t memory_size, ExecutionEngine engine)
+    : memory(std::make_unique<Memory>(memory_size)), engine(engine),
+      vector_kernels(VectorKernels::host()) {
+    memory->set_code_write_callback([this](uint64_t address, size_t size) {
+        decode_cache.invalidate(address, size);
+        block_cache.invalidate(address, size);
+        if (block_cache.is_stale()) leave_block = true;
+    });
+    memory->set_watch_callback([this](const Memory::WatchHit& hit) {
+        // The access completes; execution stops before the next instruction
+        watch_hit = hit;
+        watch_stop = true;
+        running = false;
+        leave_block = true;
+        stop_reason = StopReason::Watchpoint;
+    });
     reset();
 }
 
 void CPU::reset() noexcept {
     registers.reset();
     running = true;
+    trap = Trap{};
     breakpoints.clear();
+    breakpoint_stop_pc = NO_PC;
+    watch_stop = false;
+    memory->clear_watchpoints();
+    decode_cache.flush();
+    block_cache.mark_stale();
+}
+
+void CPU::set_breakpoint(uint64_t address) {
+    breakpoints.insert(address);
+    decode_cache.invalidate(address, sizeof(uint32_t));
+    block_cache.invalidate(address, sizeof(uint32_t));
+}
+
+void CPU::clear_breakpoint(uint64_t address) {
+    breakpoints.erase(address);
+    decode_cache.invalidate(address, sizeof(uint32_t));
+    block_cache.invalidate(address, sizeof(uint32_t));
+}
+
+void CPU::add_observer(ExecutionObserver* observer) {
+    if (std::find(observers.begin(), observers.end(), observer) == observers.end()) {
+        observers.push_back(observer);
+    }
+}
+
+void CPU::remove_observer(ExecutionObserver* observer) {
+    observers.erase(std::remove(observers.begin(), observers.end(), observer), observers.end());
+}
+
+void CPU::resume() noexcept {
+    if (watch_stop) {
+        watch_stop = false;
+        running = true;
+    }
+    uint64_t pc = registers.get_pc();
+    breakpoint_skip_pc = (pc == breakpoint_stop_pc && breakpoints.count(pc)) ? pc : NO_PC;
+    breakpoint_stop_pc = NO_PC;
+}
+
+bool CPU::stop_at_breakpoint(uint64_t pc) noexcept {
+    if (pc == breakpoint_skip_pc) {
+        breakpoint_skip_pc = NO_PC;
+        return false;
+    }
+    breakpoint_stop_pc = pc;
+    stop_reason = pc == until_pc ? StopReason::AddressReached : StopReason::Breakpoint;
+    return true;
+}
+
+CPU::Snapshot CPU::snapshot() {
+    return Snapshot{registers, memory->snapshot(), running};
+}
+
+void CPU::restore(const Snapshot& snapshot) {
+    // Cached code on pages that differ is invalidated through the callback
+    memory->restore(snapshot.memory);
+    registers = snapshot.registers;
+    running = snapshot.running;
+    trap = Trap{};
+    breakpoint_stop_pc = NO_PC;
+    watch_stop = false;
+}
+
+std::unique_ptr<CPU> CPU::fork() {
+    auto child = std::make_unique<CPU>(memory->size(), engine);
+    for (uint64_t address : breakpoints) {
+        child->set_breakpoint(address);
+    }
+    for (const auto& watch : memory->get_watchpoints()) {
+        child->set_watchpoint(watch.address, watch.size, watch.kind);
+    }
+    child->restore(snapshot());
+    return child;
 }
 
 bool CPU::load_program(const std::vector<uint8_t>& program, uint64_t address) {
     try {
         // Write the program to memory
-        for (size_t i = 0; i < program.size(); i++) {
-            memory->write8(address + i, program[i]);
+        memory->load_binary(address, program);
+        registers.set_pc(address);
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to load program: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool CPU::load_program_file(const std::string& path, uint64_t address) {
+    try {
+        auto file = MappedFile::open(path);
+        if (ElfLoader::is_elf(*file)) {
+            registers.set_pc(ElfLoader::load(file, *memory));
+            return true;
         }
+        memory->map_file(address, file, 0, file->size());
         registers.set_pc(address);
         return true;
     } catch (const std::exception& e) {
@@ -30,46 +173,212 @@ bool CPU::load_program(const std::vector<uint8_t>& program, uint64_t address) {
     }
 }
 
+bool CPU::save_snapshot(const std::string& path) const {
+    try {
+        SnapshotFile::save(path, registers, *memory, running);
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to save snapshot: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool CPU::load_snapshot(const std::string& path) {
+    try {
+        running = SnapshotFile::load(path, registers, *memory);
+        trap = Trap{};
+        breakpoint_stop_pc = NO_PC;
+        watch_stop = false;
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to load snapshot: " << e.what() << std::endl;
+        return false;
+    }
+}
+
 bool CPU::step_instruction() {
+    resume();
+    if (observed()) {
+        return run_observed(1) == 1;
+    }
+    return execute_step();
+}
+
+bool CPU::execute_step() {
     if (!running) return false;
     
-    // Check for breakpoint
     uint64_t pc = registers.get_pc();
-    if (breakpoints.count(pc)) {
-        std::cout << "Breakpoint hit at 0x" << std::hex << pc << std::dec << std::endl;
+    
+    // Fetch and decode (cached); breakpoints are flagged on the entry
+    const DecodedEntry* entry = fetch_decoded(pc);
+    if (!entry) {
+        raise_fault(FaultKind::FetchOutOfBounds, pc, sizeof(uint32_t), false);
+        return false;
+    }
+    if (entry->breakpoint && stop_at_breakpoint(pc)) {
         return false;
     }
     
-    try {
-        // Fetch
-        uint32_t instruction_word = memory->read32(pc);
-        
-        // Decode
-        Instruction instr = Decoder::decode(instruction_word);
+    // Handlers used by the threaded and block engines update the PC themselves
+    if (engine != ExecutionEngine::Switch) {
+        entry->handler(*this, entry->instr);
+        return !trap;
+    }
+    
+    // Execute
+    const Instruction& instr = entry->instr;
+    if (!execute_instruction(instr)) {
+        return false;
+    }
+    
+    // Update PC (if not a branch instruction)
+    if (!instr.is_branch()) {
+        registers.set_pc(pc + 4);
+    }
+    
+    return true;
+}
+
+const DecodedEntry* CPU::fetch_decoded(uint64_t pc) {
+    if (const DecodedEntry* entry = decode_cache.lookup(pc)) {
+        return entry;
+    }
+    
+    uint32_t instruction_word = 0;
+    if (!memory->try_fetch32(pc, instruction_word)) {
+        return nullptr;
+    }
+    memory->mark_code_page(pc);
+    memory->mark_code_page(pc + sizeof(uint32_t) - 1);
+    return &decode_cache.insert(pc, instruction_word, Decoder::decode(instruction_word),
+                                !breakpoints.empty() && breakpoints.count(pc) != 0);
+}
+
+RunResult CPU::run_for(uint64_t max_instructions) {
+    resume();
+    return run_engine(max_instructions);
+}
+
+RunResult CPU::run_until(uint64_t address, uint64_t max_instructions) {
+    resume();
+    if (registers.get_pc() == address) {
+        breakpoint_skip_pc = address;
+    }
+    
+    // The target is a breakpoint for the length of the run
+    bool temporary = breakpoints.count(address) == 0;
+    if (temporary) set_breakpoint(address);
+    until_pc = address;
+    RunResult result = run_engine(max_instructions);
+    until_pc = NO_PC;
+    if (temporary) clear_breakpoint(address);
+    return result;
+}
+
+RunResult CPU::run_engine(uint64_t max_instructions) {
+    if (!running) {
+        return RunResult{trap ? StopReason::Fault : StopReason::Halted, 0};
+    }
+    
+    // Anything that stops the run early overwrites this
+    stop_reason = StopReason::InstructionLimit;
+    uint64_t retired = 0;
+    if (observed()) {
+        retired = run_observed(max_instructions);
+        return RunResult{stop_reason, retired};
+    }
+    switch (engine) {
+        case ExecutionEngine::Threaded:
+            retired = run_threaded(max_instructions);
+            break;
+        case ExecutionEngine::Block:
+        case ExecutionEngine::Jit:
+            retired = run_blocks(max_instructions);
+            break;
+        case ExecutionEngine::Switch:
+            retired = run_switch(max_instructions);
+            break;
+    }
+    return RunResult{stop_reason, retired};
+}
+
+uint64_t CPU::run_switch(uint64_t max_instructions) {
+    uint64_t retired = 0;
+    while (running && retired < max_instructions) {
+        if (!execute_step()) {
+            break;
+        }
+        ++retired;
+    }
+    return retired;
+}
+
+uint64_t CPU::run_observed(uint64_t max_instructions) {
+    uint64_t retired = 0;
+    while (running && retired < max_instructions) {
+        RetiredInstruction record;
+        record.pc = registers.get_pc();
         
-        // Execute
-        execute_instruction(instr);
+        // Capture the operands before the instruction can overwrite them
+        // (or its own cache entry); the step finds the entry cached again
+        uint8_t load_register = RetiredInstruction::NO_REGISTER;
+        uint8_t vector_register = RetiredInstruction::NO_REGISTER;
+        if (const DecodedEntry* entry = fetch_decoded(record.pc)) {
+            const Instruction& instr = entry->instr;
+            record.word = entry->word;
+            record.dest = destination_register(instr);
+            if (instr.is_memory_op()) {
+                record.memory = true;
+                record.write = instr.opcode == Opcode::STUR || instr.opcode == Opcode::ST1;
+                record.address = registers.read_x(instr.rn) + instr.imm;
+                if (instr.is_vector()) {
+                    record.size = sizeof(VectorRegister);
+                    vector_register = instr.rd;
+                    if (record.write) {
+                        record.value = registers.vector(instr.rd).get<uint64_t>(0);
+                    }
+                } else if (record.write) {
+                    record.value = registers.read_x(instr.rd);
+                } else {
+                    load_register = record.dest;
+                }
+            }
+        }
         
-        // Update PC (if not a branch instruction)
-        if (!instr.is_branch()) {
-            registers.set_pc(pc + 4);
+        if (!execute_step()) {
+            break;
         }
+        ++retired;
         
-        return true;
-    } catch (const std::exception& e) {
-        std::cerr << "Error executing instruction at 0x" << std::hex << pc 
-                  << ": " << e.what() << std::endl;
-        running = false;
-        return false;
+        record.next_pc = registers.get_pc();
+        if (record.dest != RetiredInstruction::NO_REGISTER) {
+            record.dest_value = registers.read_x(record.dest);
+        }
+        if (load_register != RetiredInstruction::NO_REGISTER) {
+            record.value = record.dest_value;
+        }
+        if (vector_register != RetiredInstruction::NO_REGISTER && !record.write) {
+            record.value = registers.vector(vector_register).get<uint64_t>(0);
+        }
+        for (ExecutionObserver* observer : observers) {
+            observer->on_retire(record);
+        }
     }
+    return retired;
 }
 
-void CPU::run() {
-    while (running) {
-        if (!step_instruction()) {
-            break;
-        }
+const char* to_string(StopReason reason) noexcept {
+    switch (reason) {
+        case StopReason::Halted: return "halted";
+        case StopReason::Fault: return "fault";
+        case StopReason::InstructionLimit: return "limit";
+        case StopReason::Breakpoint: return "breakpoint";
+        case StopReason::Watchpoint: return "watchpoint";
+        case StopReason::AddressReached: return "address-reached";
+        case StopReason::LoadFailed: return "load-failed";
+        case StopReason::HistoryStart: return "history-start";
     }
+    return "unknown";
 }
 
 std::string CPU::get_state() const {
@@ -78,21 +387,240 @@ std::string CPU::get_state() const {
     return oss.str();
 }
 
-void CPU::execute_instruction(const Instruction& instr) {
-    // Implementation of instruction execution
-    // This is a simplified version - you'll need to expand this
+bool CPU::execute_instruction(const Instruction& instr) {
     switch (instr.opcode) {
         case Opcode::ADD:
-            // Implement ADD logic
+        case Opcode::SUB:
+        case Opcode::AND:
+        case Opcode::ORR:
+        case Opcode::EOR:
+        case Opcode::ADDS:
+        case Opcode::SUBS:
+        case Opcode::ANDS:
+        case Opcode::CSEL:
+        case Opcode::ADDI:
+        case Opcode::SUBI:
+        case Opcode::ANDI:
+        case Opcode::ORRI:
+        case Opcode::EORI:
+        case Opcode::ADDSI:
+        case Opcode::SUBSI:
+        case Opcode::ANDSI:
+            execute_data_processing(instr);
+            break;
+        case Opcode::LDUR:
+        case Opcode::STUR:
+            return execute_load_store(instr);
+        case Opcode::B:
+        case Opcode::BL:
+        case Opcode::BR:
+        case Opcode::BLR:
+        case Opcode::RET:
+        case Opcode::B_COND:
+        case Opcode::CBZ:
+        case Opcode::CBNZ:
+            execute_branch(instr);
             break;
+        case Opcode::VADD:
+        case Opcode::VSUB:
+        case Opcode::VMUL:
+        case Opcode::VAND:
+        case Opcode::VORR:
+        case Opcode::VEOR:
+        case Opcode::FADD:
+        case Opcode::FSUB:
+        case Opcode::FMUL:
+        case Opcode::EXT:
+        case Opcode::TBL:
+        case Opcode::DUP:
+        case Opcode::UMOV:
+        case Opcode::ADDV:
+        case Opcode::UMAXV:
+        case Opcode::UMINV:
+        case Opcode::LD1:
+        case Opcode::ST1:
+            return execute_vector(instr);
+        default:
+            raise_fault(FaultKind::UndefinedInstruction, registers.get_pc(), sizeof(uint32_t), false);
+            return false;
+    }
+    return true;
+}
+
+void CPU::execute_data_processing(const Instruction& instr) {
+    uint64_t operand1 = registers.read_x(instr.rn);
+    uint64_t operand2 = static_cast<uint64_t>(instr.imm);
+    
+    // Register forms take a shifted second operand
+    switch (instr.opcode) {
+        case Opcode::ADD:
         case Opcode::SUB:
-            // Implement SUB logic
+        case Opcode::AND:
+        case Opcode::ORR:
+        case Opcode::EOR:
+        case Opcode::ADDS:
+        case Opcode::SUBS:
+        case Opcode::ANDS:
+            operand2 = get_shifted_operand(registers.read_x(instr.rm), 0, instr.shift);
+            break;
+        case Opcode::CSEL:
+            operand2 = registers.read_x(instr.rm);
             break;
-        // Add other instructions...
         default:
-            std::ostringstream oss;
-            oss << "Unimplemented instruction: " << static_cast<int>(instr.opcode);
-            throw std::runtime_error(oss.str());
+            break;
+    }
+    
+    // Flag-setting forms record their operands; the flags are worked out
+    // only if a condition is tested
+    uint64_t result = 0;
+    switch (instr.opcode) {
+        case Opcode::ADD:
+        case Opcode::ADDI: result = operand1 + operand2; break;
+        case Opcode::SUB:
+        case Opcode::SUBI: result = operand1 - operand2; break;
+        case Opcode::AND:
+        case Opcode::ANDI: result = operand1 & operand2; break;
+        case Opcode::ORR:
+        case Opcode::ORRI: result = operand1 | operand2; break;
+        case Opcode::EOR:
+        case Opcode::EORI: result = operand1 ^ operand2; break;
+        case Opcode::ADDS:
+        case Opcode::ADDSI:
+            result = operand1 + operand2;
+            registers.flags().set_add(operand1, operand2);
+            break;
+        case Opcode::SUBS:
+        case Opcode::SUBSI:
+            result = operand1 - operand2;
+            registers.flags().set_sub(operand1, operand2);
+            break;
+        case Opcode::ANDS:
+        case Opcode::ANDSI:
+            result = operand1 & operand2;
+            registers.flags().set_logic(result);
+            break;
+        case Opcode::CSEL:
+            result = check_condition(instr.cond) ? operand1 : operand2;
+            break;
+        default: break;
+    }
+    
+    registers.write_x(instr.rd, result);
+}
+
+void CPU::execute_branch(const Instruction& instr) {
+    uint64_t pc = registers.get_pc();
+    uint64_t target = pc + 4;
+    
+    switch (instr.opcode) {
+        case Opcode::B:
+            target = pc + instr.imm;
+            break;
+        case Opcode::BL:
+            registers.write_x(30, pc + 4);
+            target = pc + instr.imm;
+            break;
+        case Opcode::BR:
+        case Opcode::RET:
+            target = registers.read_x(instr.rn);
+            break;
+        case Opcode::BLR:
+            // Read the target before writing the link register (BLR X30)
+            target = registers.read_x(instr.rn);
+            registers.write_x(30, pc + 4);
+            break;
+        case Opcode::B_COND:
+            if (check_condition(instr.cond)) target = pc + instr.imm;
+            break;
+        case Opcode::CBZ:
+            if (registers.read_x(instr.rd) == 0) target = pc + instr.imm;
+            break;
+        case Opcode::CBNZ:
+            if (registers.read_x(instr.rd) != 0) target = pc + instr.imm;
+            break;
+        default:
+            break;
+    }
+    
+    branch_to(pc, target);
+}
+
+bool CPU::execute_load_store(const Instruction& instr) {
+    uint64_t address = registers.read_x(instr.rn) + instr.imm;
+    
+    if (instr.opcode == Opcode::LDUR) {
+        uint64_t value = 0;
+        if (!memory->try_read64(address, value)) {
+            raise_fault(FaultKind::MemoryOutOfBounds, address, sizeof(uint64_t), false);
+            return false;
+        }
+        registers.write_x(instr.rd, value);
+    } else if (!memory->try_write64(address, registers.read_x(instr.rd))) {
+        raise_fault(FaultKind::MemoryOutOfBounds, address, sizeof(uint64_t), true);
+        return false;
+    }
+    return true;
+}
+
+bool CPU::execute_vector(const Instruction& instr) {
+    switch (instr.opcode) {
+        case Opcode::EXT:
+            vector_kernels.ext(registers.vector(instr.rd), registers.vector(instr.rn),
+                               registers.vector(instr.rm), static_cast<unsigned>(instr.imm));
+            break;
+        case Opcode::DUP:
+            vector_kernels.dup[instr.esize](registers.vector(instr.rd), registers.read_x(instr.rn));
+            break;
+        case Opcode::UMOV:
+            registers.write_x(instr.rd, vector_element(registers.vector(instr.rn), instr.esize,
+                                                       static_cast<size_t>(instr.imm)));
+            break;
+        case Opcode::ADDV:
+        case Opcode::UMAXV:
+        case Opcode::UMINV:
+            vector_kernels.reduce[vector_reduction(instr.opcode)][instr.esize](
+                registers.vector(instr.rd), registers.vector(instr.rn));
+            break;
+        case Opcode::LD1:
+        case Opcode::ST1: {
+            uint64_t address = registers.read_x(instr.rn);
+            VectorRegister& vt = registers.vector(instr.rd);
+            if (instr.opcode == Opcode::LD1) {
+                if (!memory->try_read128(address, vt.bytes)) {
+                    raise_fault(FaultKind::MemoryOutOfBounds, address, sizeof(VectorRegister), false);
+                    return false;
+                }
+            } else if (!memory->try_write128(address, vt.bytes)) {
+                raise_fault(FaultKind::MemoryOutOfBounds, address, sizeof(VectorRegister), true);
+                return false;
+            }
+            if (instr.wback) {
+                registers.write_x(instr.rn, address + sizeof(VectorRegister));
+            }
+            break;
+        }
+        default:
+            // Two-source operations; the decoder only produces sizes with a kernel
+            vector_kernels.binary[vector_op(instr.opcode)][instr.esize](
+                registers.vector(instr.rd), registers.vector(instr.rn), registers.vector(instr.rm));
+            break;
+    }
+    return true;
+}
+
+uint64_t CPU::get_shifted_operand(uint64_t value, uint8_t shift_type, uint8_t shift_amount) const {
+    shift_amount &= 63;
+    if (shift_amount == 0) return value;
+    
+    switch (shift_type) {
+        case 0:  // LSL
+            return value << shift_amount;
+        case 1:  // LSR
+            return value >> shift_amount;
+        case 2:  // ASR
+            return static_cast<uint64_t>(static_cast<int64_t>(value) >> shift_amount);
+        default: // ROR
+            return (value >> shift_amount) | (value << (64 - shift_amount));
     }
 }
 
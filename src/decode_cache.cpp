@@ -0,0 +1,46 @@
+#include "decode_cache.hpp"
+
+namespace arm_emulator {
+
+DecodeCache::DecodeCache() : entries(NUM_ENTRIES) {
+    flush();
+}
+
+const DecodedEntry& DecodeCache::insert(uint64_t pc, uint32_t word, const Instruction& instr,
+                                        bool breakpoint) {
+    DecodedEntry& entry = entries[index(pc)];
+    entry.pc = pc;
+    entry.word = word;
+    entry.handler = resolve_handler(instr.opcode);
+    entry.breakpoint = breakpoint;
+    entry.instr = instr;
+    return entry;
+}
+
+void DecodeCache::invalidate(uint64_t address, size_t size) noexcept {
+    if (size == 0) return;
+
+    // Large writes (program loads, memory resets) touch every slot anyway
+    if (size >= NUM_ENTRIES * sizeof(uint32_t)) {
+        flush();
+        return;
+    }
+
+    // An instruction at pc overlaps the write if pc lies in [address - 3, address + size)
+    uint64_t first = address >= 3 ? address - 3 : 0;
+    uint64_t last = address + size;
+    for (uint64_t pc = first; pc < last; ++pc) {
+        DecodedEntry& entry = entries[index(pc)];
+        if (entry.pc == pc) {
+            entry.pc = empty_tag(index(pc));
+        }
+    }
+}
+
+void DecodeCache::flush() noexcept {
+    for (size_t slot = 0; slot < entries.size(); ++slot) {
+        entries[slot].pc = empty_tag(slot);
+    }
+}
+
+} // namespace arm_emulator
\ No newline at end of file
@@ -1,10 +1,251 @@
 #include "decoder.hpp"
-#include <stdexcept>
+#include <array>
 #include <cassert>
+#include <cstddef>
+#include <stdexcept>
 
 namespace arm_emulator {
 
+namespace {
+
+// How the operands of an instruction are laid out
+enum class Form : uint8_t {
+    None,            // Invalid: no operands
+    Register,        // rd, rn, rm and shift (bits 22-23)
+    Immediate,       // rd, rn and a signed 12-bit immediate
+    LoadStore,       // rt, rn and a signed 21-bit offset
+    Branch,          // Signed 26-bit word offset
+    BranchRegister,  // rn
+    Return,          // rn, X30 if zero
+    CompareBranch,   // rt and a signed 19-bit word offset
+    ConditionalSelect,  // rd, rn, rm and the condition in bits 12-15
+    ConditionalBranch,  // Condition in bits 0-3 and a signed 19-bit word offset in bits 5-23
+    VectorThree,     // Vd, Vn, Vm and the element size in bits 10-11
+    VectorLogical,   // Vd, Vn, Vm on bytes
+    VectorFloat,     // Vd, Vn, Vm; bit 10 selects 2D over 4S
+    VectorMultiply,  // VectorThree without 64-bit elements
+    VectorExtract,   // Vd, Vn, Vm and a byte index in bits 10-13
+    VectorTable,     // Vd, Vn (table), Vm (indices)
+    VectorDup,       // Vd, Xn and the element size in bits 10-11
+    VectorMove,      // Xd, Vn, the element size in bits 10-11 and index in bits 12-15
+    VectorReduce,    // Vd, Vn and the element size in bits 10-11, 64-bit excluded
+    VectorLoadStore, // Vt, Xn; bit 23 post-indexes Xn by 16
+};
+
+// One instruction form: words with (word & mask) == value. The first match
+// in ENCODINGS wins.
+struct Encoding {
+    uint32_t mask;
+    uint32_t value;
+    Opcode opcode;
+    Form form;
+};
+
+// op0 is bits 25-27. Data processing (register) has op0 = 2 and the opcode
+// in bits 21-24; data processing (immediate) has op0 = 1 or 3 and the opcode
+// in bits 23-24; in both, bit 29 makes ADD, SUB and AND set the flags. Loads
+// and stores have op0 = 0 or 4 and bit 22 set for loads; branches have
+// op0 = 5. B, BL, BLR and RET would need bits 26-27 to differ from op0 = 5,
+// so no word decodes to them. Advanced SIMD data processing has op0 = 7,
+// with the opcode in bits 21-24 and bit 28; SIMD loads and stores have
+// op0 = 6 and bit 22 set for loads.
+constexpr Encoding ENCODINGS[] = {
+    {0x2FE00000, 0x24000000, Opcode::ANDS, Form::Register},
+    {0x2FE00000, 0x24400000, Opcode::SUBS, Form::Register},
+    {0x2FE00000, 0x24800000, Opcode::ADDS, Form::Register},
+    {0x0FE00000, 0x04C00000, Opcode::CSEL, Form::ConditionalSelect},
+    {0x0FE00000, 0x04000000, Opcode::AND, Form::Register},
+    {0x0FE00000, 0x04200000, Opcode::EOR, Form::Register},
+    {0x0FE00000, 0x04400000, Opcode::SUB, Form::Register},
+    {0x0FE00000, 0x04800000, Opcode::ADD, Form::Register},
+    {0x0FE00000, 0x05400000, Opcode::ORR, Form::Register},
+    
+    {0x2B800000, 0x22000000, Opcode::ADDSI, Form::Immediate},
+    {0x2B800000, 0x22800000, Opcode::SUBSI, Form::Immediate},
+    {0x2B800000, 0x23000000, Opcode::ANDSI, Form::Immediate},
+    {0x0B800000, 0x02000000, Opcode::ADDI, Form::Immediate},
+    {0x0B800000, 0x02800000, Opcode::SUBI, Form::Immediate},
+    {0x0B800000, 0x03000000, Opcode::ANDI, Form::Immediate},
+    {0x0B800000, 0x03800000, Opcode::ORRI, Form::Immediate},
+    
+    {0x06400000, 0x00000000, Opcode::STUR, Form::LoadStore},
+    {0x06400000, 0x00400000, Opcode::LDUR, Form::LoadStore},
+    
+    {0xFE000000, 0x0A000000, Opcode::BR, Form::BranchRegister},
+    {0xFF000000, 0x1A000000, Opcode::B_COND, Form::ConditionalBranch},
+    {0xFF000000, 0x9A000000, Opcode::CBZ, Form::CompareBranch},
+    {0xFF000000, 0x9B000000, Opcode::CBNZ, Form::CompareBranch},
+    
+    {0x1FE00000, 0x0E000000, Opcode::VADD, Form::VectorThree},
+    {0x1FE00000, 0x0E200000, Opcode::VSUB, Form::VectorThree},
+    {0x1FE00000, 0x0E400000, Opcode::VMUL, Form::VectorMultiply},
+    {0x1FE00000, 0x0E600000, Opcode::VAND, Form::VectorLogical},
+    {0x1FE00000, 0x0E800000, Opcode::VORR, Form::VectorLogical},
+    {0x1FE00000, 0x0EA00000, Opcode::VEOR, Form::VectorLogical},
+    {0x1FE00000, 0x0EC00000, Opcode::FADD, Form::VectorFloat},
+    {0x1FE00000, 0x0EE00000, Opcode::FSUB, Form::VectorFloat},
+    {0x1FE00000, 0x0F000000, Opcode::FMUL, Form::VectorFloat},
+    {0x1FE00000, 0x0F200000, Opcode::EXT, Form::VectorExtract},
+    {0x1FE00000, 0x0F400000, Opcode::TBL, Form::VectorTable},
+    {0x1FE00000, 0x1E000000, Opcode::DUP, Form::VectorDup},
+    {0x1FE00000, 0x1E200000, Opcode::UMOV, Form::VectorMove},
+    {0x1FE00000, 0x1E400000, Opcode::ADDV, Form::VectorReduce},
+    {0x1FE00000, 0x1E600000, Opcode::UMAXV, Form::VectorReduce},
+    {0x1FE00000, 0x1E800000, Opcode::UMINV, Form::VectorReduce},
+    
+    {0x0E400000, 0x0C000000, Opcode::ST1, Form::VectorLoadStore},
+    {0x0E400000, 0x0C400000, Opcode::LD1, Form::VectorLoadStore},
+};
+
+// Every field that selects the form lies in bits 21-31, so those 11 bits
+// index a table with the result for each combination
+constexpr unsigned INDEX_SHIFT = 21;
+constexpr size_t TABLE_SIZE = size_t{1} << (32 - INDEX_SHIFT);
+
+struct TableEntry {
+    Opcode opcode{Opcode::INVALID};
+    Form form{Form::None};
+};
+
+constexpr std::array<TableEntry, TABLE_SIZE> build_table() {
+    std::array<TableEntry, TABLE_SIZE> table{};
+    for (size_t index = 0; index < TABLE_SIZE; ++index) {
+        uint32_t word = static_cast<uint32_t>(index) << INDEX_SHIFT;
+        for (const Encoding& encoding : ENCODINGS) {
+            if ((word & encoding.mask) == encoding.value) {
+                table[index] = TableEntry{encoding.opcode, encoding.form};
+                break;
+            }
+        }
+    }
+    return table;
+}
+
+constexpr bool encodings_fit_index() {
+    for (const Encoding& encoding : ENCODINGS) {
+        if ((encoding.mask & ((1u << INDEX_SHIFT) - 1)) != 0 || (encoding.value & ~encoding.mask) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(encodings_fit_index(), "Encodings may only test bits 21-31");
+
+constexpr bool register_shifts_fixed() {
+    for (const Encoding& encoding : ENCODINGS) {
+        if (encoding.form == Form::Register &&
+            ((encoding.value >> 22) & 0x3) != register_shift(encoding.opcode)) {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(register_shifts_fixed(), "register_shift must match the register-form encodings");
+
+constexpr std::array<TableEntry, TABLE_SIZE> TABLE = build_table();
+
+// Sign-extends the low `bits` bits of value
+constexpr int32_t sign_extend(uint32_t value, unsigned bits) {
+    uint32_t sign = 1u << (bits - 1);
+    value &= (sign << 1) - 1;
+    return static_cast<int32_t>(value ^ sign) - static_cast<int32_t>(sign);
+}
+
+} // namespace
+
 Instruction Decoder::decode(uint32_t instruction) {
+    const TableEntry& entry = TABLE[instruction >> INDEX_SHIFT];
+    Instruction instr;
+    instr.opcode = entry.opcode;
+    
+    switch (entry.form) {
+        case Form::None:
+            break;
+        case Form::Register:
+            instr.rd = instruction & 0x1F;
+            instr.rn = (instruction >> 5) & 0x1F;
+            instr.rm = (instruction >> 16) & 0x1F;
+            instr.shift = (instruction >> 22) & 0x3;
+            break;
+        case Form::Immediate:
+            instr.rd = instruction & 0x1F;
+            instr.rn = (instruction >> 5) & 0x1F;
+            instr.imm = sign_extend(instruction >> 10, 12);
+            break;
+        case Form::LoadStore:
+            instr.rd = instruction & 0x1F;
+            instr.rn = (instruction >> 5) & 0x1F;
+            instr.imm = sign_extend(instruction >> 10, 21);
+            break;
+        case Form::Branch:
+            instr.imm = sign_extend(instruction, 26) * 4;
+            break;
+        case Form::BranchRegister:
+            instr.rn = instruction & 0x1F;
+            break;
+        case Form::Return:
+            instr.rn = (instruction & 0x1F) ? (instruction & 0x1F) : 30;
+            break;
+        case Form::CompareBranch:
+            instr.rd = instruction & 0x1F;
+            instr.imm = sign_extend(instruction >> 5, 19) * 4;
+            break;
+        case Form::ConditionalSelect:
+            instr.rd = instruction & 0x1F;
+            instr.rn = (instruction >> 5) & 0x1F;
+            instr.rm = (instruction >> 16) & 0x1F;
+            instr.cond = static_cast<Condition>((instruction >> 12) & 0xF);
+            break;
+        case Form::ConditionalBranch:
+            instr.cond = static_cast<Condition>(instruction & 0xF);
+            instr.imm = sign_extend(instruction >> 5, 19) * 4;
+            break;
+        case Form::VectorThree:
+        case Form::VectorLogical:
+        case Form::VectorFloat:
+        case Form::VectorMultiply:
+        case Form::VectorExtract:
+        case Form::VectorTable:
+            instr.rd = instruction & 0x1F;
+            instr.rn = (instruction >> 5) & 0x1F;
+            instr.rm = (instruction >> 16) & 0x1F;
+            if (entry.form == Form::VectorFloat) {
+                instr.esize = 2 + ((instruction >> 10) & 0x1);
+            } else if (entry.form == Form::VectorThree || entry.form == Form::VectorMultiply) {
+                instr.esize = (instruction >> 10) & 0x3;
+                if (entry.form == Form::VectorMultiply && instr.esize == 3) {
+                    return Instruction{};
+                }
+            } else if (entry.form == Form::VectorExtract) {
+                instr.imm = (instruction >> 10) & 0xF;
+            }
+            break;
+        case Form::VectorDup:
+        case Form::VectorMove:
+        case Form::VectorReduce:
+            instr.rd = instruction & 0x1F;
+            instr.rn = (instruction >> 5) & 0x1F;
+            instr.esize = (instruction >> 10) & 0x3;
+            if (entry.form == Form::VectorMove) {
+                // Indexes past the last element wrap around
+                instr.imm = ((instruction >> 12) & 0xF) & ((16 >> instr.esize) - 1);
+            } else if (entry.form == Form::VectorReduce && instr.esize == 3) {
+                return Instruction{};
+            }
+            break;
+        case Form::VectorLoadStore:
+            instr.rd = instruction & 0x1F;
+            instr.rn = (instruction >> 5) & 0x1F;
+            if ((instruction >> 23) & 0x1) {
+                instr.addr_mode = AddrMode::POST_INDEX;
+                instr.wback = true;
+            }
+            break;
+    }
+    return instr;
+}
+
+Instruction Decoder::decode_reference(uint32_t instruction) {
     Instruction instr;
     
     // Extract the opcode (bits 24-28)
@@ -31,6 +272,14 @@ Instruction Decoder::decode(uint32_t instruction) {
         return decode_branch(instruction);
     }
     
+    // Check for Advanced SIMD instructions (op0 == 0x7, or 0x6 for loads and stores)
+    if (op0 == 0x7) {
+        return decode_simd_data_processing(instruction);
+    }
+    if (op0 == 0x6) {
+        return decode_simd_load_store(instruction);
+    }
+    
     // If we get here, the instruction is not supported
     instr.opcode = Opcode::INVALID;
     return instr;
@@ -44,12 +293,16 @@ Instruction Decoder::decode_data_processing_register(uint32_t instruction) {
     // is_64bit is not currently used in the implementation
     // bool is_64bit = (instruction >> 31) & 0x1;
     
+    // Bit 29 selects the flag-setting forms of AND, SUB and ADD
+    bool set_flags = (instruction >> 29) & 0x1;
+    
     // Set the appropriate opcode
     switch (opcode) {
-        case 0x0: instr.opcode = Opcode::AND; break;
+        case 0x0: instr.opcode = set_flags ? Opcode::ANDS : Opcode::AND; break;
         case 0x1: instr.opcode = Opcode::EOR; break;
-        case 0x2: instr.opcode = Opcode::SUB; break;
-        case 0x4: instr.opcode = Opcode::ADD; break;
+        case 0x2: instr.opcode = set_flags ? Opcode::SUBS : Opcode::SUB; break;
+        case 0x4: instr.opcode = set_flags ? Opcode::ADDS : Opcode::ADD; break;
+        case 0x6: instr.opcode = Opcode::CSEL; break;
         case 0xA: instr.opcode = Opcode::ORR; break;
         default:
             instr.opcode = Opcode::INVALID;
@@ -61,6 +314,12 @@ Instruction Decoder::decode_data_processing_register(uint32_t instruction) {
     instr.rn = (instruction >> 5) & 0x1F;
     instr.rm = (instruction >> 16) & 0x1F;
     
+    // CSEL has a condition where the others have a shift
+    if (instr.opcode == Opcode::CSEL) {
+        instr.cond = static_cast<Condition>((instruction >> 12) & 0xF);
+        return instr;
+    }
+    
     // Set the shift amount (if any)
     uint8_t shift = (instruction >> 22) & 0x3;
     if (shift != 0) {
@@ -78,11 +337,14 @@ Instruction Decoder::decode_data_processing_immediate(uint32_t instruction) {
     // is_64bit is not currently used in the implementation
     // bool is_64bit = (instruction >> 31) & 0x1;
     
+    // Bit 29 selects the flag-setting forms of ADDI, SUBI and ANDI
+    bool set_flags = (instruction >> 29) & 0x1;
+    
     // Set the appropriate opcode
     switch (opcode) {
-        case 0x0: instr.opcode = Opcode::ADDI; break;
-        case 0x1: instr.opcode = Opcode::SUBI; break;
-        case 0x2: instr.opcode = Opcode::ANDI; break;
+        case 0x0: instr.opcode = set_flags ? Opcode::ADDSI : Opcode::ADDI; break;
+        case 0x1: instr.opcode = set_flags ? Opcode::SUBSI : Opcode::SUBI; break;
+        case 0x2: instr.opcode = set_flags ? Opcode::ANDSI : Opcode::ANDI; break;
         case 0x3: instr.opcode = Opcode::ORRI; break;
         default:
             instr.opcode = Opcode::INVALID;
@@ -158,6 +420,23 @@ Instruction Decoder::decode_branch(uint32_t instruction) {
             instr.rn = (instruction & 0x1F) ? (instruction & 0x1F) : 30;  // Default to X30 if not specified
             return instr;
             
+        case 0x6: {  // B.cond; bit 24 must be clear
+            if ((instruction >> 24) & 0x1) {
+                instr.opcode = Opcode::INVALID;
+                return instr;
+            }
+            instr.opcode = Opcode::B_COND;
+            instr.cond = static_cast<Condition>(instruction & 0xF);
+            
+            // Extract and sign-extend the offset
+            int32_t offset = (instruction >> 5) & 0x7FFFF;
+            if (offset & 0x40000) {  // Sign extend 19-bit offset
+                offset |= 0xFFF80000;
+            }
+            instr.imm = offset * 4;  // Scale by 4 for byte offset
+            return instr;
+        }
+            
         default:
             // Check for CBZ/CBNZ
             if ((opcode & 0x3C) == 0x24) {  // CBZ/CBNZ
@@ -190,4 +469,110 @@ Instruction Decoder::decode_branch(uint32_t instruction) {
     return instr;
 }
 
+Instruction Decoder::decode_simd_data_processing(uint32_t instruction) {
+    Instruction instr;
+    
+    // Bit 28 selects the group, bits 21-24 the operation within it
+    uint8_t opcode = (instruction >> 21) & 0xF;
+    bool across = (instruction >> 28) & 0x1;
+    uint8_t size = (instruction >> 10) & 0x3;
+    
+    if (!across) {
+        switch (opcode) {
+            case 0x0: instr.opcode = Opcode::VADD; break;
+            case 0x1: instr.opcode = Opcode::VSUB; break;
+            case 0x2: instr.opcode = Opcode::VMUL; break;
+            case 0x3: instr.opcode = Opcode::VAND; break;
+            case 0x4: instr.opcode = Opcode::VORR; break;
+            case 0x5: instr.opcode = Opcode::VEOR; break;
+            case 0x6: instr.opcode = Opcode::FADD; break;
+            case 0x7: instr.opcode = Opcode::FSUB; break;
+            case 0x8: instr.opcode = Opcode::FMUL; break;
+            case 0x9: instr.opcode = Opcode::EXT; break;
+            case 0xA: instr.opcode = Opcode::TBL; break;
+            default:
+                instr.opcode = Opcode::INVALID;
+                return instr;
+        }
+        
+        // There is no 64-bit element multiply
+        if (instr.opcode == Opcode::VMUL && size == 3) {
+            instr.opcode = Opcode::INVALID;
+            return instr;
+        }
+        
+        instr.rd = instruction & 0x1F;
+        instr.rn = (instruction >> 5) & 0x1F;
+        instr.rm = (instruction >> 16) & 0x1F;
+        
+        switch (instr.opcode) {
+            case Opcode::VADD:
+            case Opcode::VSUB:
+            case Opcode::VMUL:
+                instr.esize = size;
+                break;
+            case Opcode::FADD:
+            case Opcode::FSUB:
+            case Opcode::FMUL:
+                // Single (4S) or double (2D) precision
+                instr.esize = 2 + (size & 0x1);
+                break;
+            case Opcode::EXT:
+                instr.imm = (instruction >> 10) & 0xF;
+                break;
+            default:
+                break;
+        }
+        return instr;
+    }
+    
+    switch (opcode) {
+        case 0x0: instr.opcode = Opcode::DUP; break;
+        case 0x1: instr.opcode = Opcode::UMOV; break;
+        case 0x2: instr.opcode = Opcode::ADDV; break;
+        case 0x3: instr.opcode = Opcode::UMAXV; break;
+        case 0x4: instr.opcode = Opcode::UMINV; break;
+        default:
+            instr.opcode = Opcode::INVALID;
+            return instr;
+    }
+    
+    // Reductions have no 64-bit element form
+    if (instr.opcode != Opcode::DUP && instr.opcode != Opcode::UMOV && size == 3) {
+        instr.opcode = Opcode::INVALID;
+        return instr;
+    }
+    
+    instr.rd = instruction & 0x1F;
+    instr.rn = (instruction >> 5) & 0x1F;
+    instr.esize = size;
+    
+    // UMOV takes an element index; indexes past the last element wrap around
+    if (instr.opcode == Opcode::UMOV) {
+        uint8_t elements = static_cast<uint8_t>(16 >> size);
+        instr.imm = ((instruction >> 12) & 0xF) % elements;
+    }
+    
+    return instr;
+}
+
+Instruction Decoder::decode_simd_load_store(uint32_t instruction) {
+    Instruction instr;
+    
+    // Check if it's a load or store, and whether Xn is post-indexed
+    bool is_load = (instruction >> 22) & 0x1;
+    bool post_index = (instruction >> 23) & 0x1;
+    
+    instr.opcode = is_load ? Opcode::LD1 : Opcode::ST1;
+    instr.rd = instruction & 0x1F;  // Vector register
+    instr.rn = (instruction >> 5) & 0x1F;  // Base register
+    
+    if (post_index) {
+        instr.addr_mode = AddrMode::POST_INDEX;
+        instr.wback = true;
+    }
+    
+    return instr;
+}
+
 } // namespace arm_emulator
@@ -0,0 +1,404 @@
+#include "dispatch.hpp"
+#include "cpu.hpp"
+#include <exception>
+
+namespace arm_emulator {
+
+namespace {
+
+constexpr bool is_register_alu(Opcode op) {
+    return op == Opcode::ADD || op == Opcode::SUB || op == Opcode::AND ||
+           op == Opcode::ORR || op == Opcode::EOR || op == Opcode::ADDS ||
+           op == Opcode::SUBS || op == Opcode::ANDS;
+}
+
+constexpr bool is_immediate_alu(Opcode op) {
+    return op == Opcode::ADDI || op == Opcode::SUBI || op == Opcode::ANDI ||
+           op == Opcode::ORRI || op == Opcode::EORI || op == Opcode::ADDSI ||
+           op == Opcode::SUBSI || op == Opcode::ANDSI;
+}
+
+template <Opcode Op>
+constexpr uint64_t alu(uint64_t a, uint64_t b) {
+    if constexpr (Op == Opcode::ADD || Op == Opcode::ADDI || Op == Opcode::ADDS || Op == Opcode::ADDSI) return a + b;
+    else if constexpr (Op == Opcode::SUB || Op == Opcode::SUBI || Op == Opcode::SUBS || Op == Opcode::SUBSI) return a - b;
+    else if constexpr (Op == Opcode::AND || Op == Opcode::ANDI || Op == Opcode::ANDS || Op == Opcode::ANDSI) return a & b;
+    else if constexpr (Op == Opcode::ORR || Op == Opcode::ORRI) return a | b;
+    else return a ^ b;
+}
+
+constexpr bool is_vector_binary(Opcode op) {
+    return op == Opcode::VADD || op == Opcode::VSUB || op == Opcode::VMUL ||
+           op == Opcode::VAND || op == Opcode::VORR || op == Opcode::VEOR ||
+           op == Opcode::FADD || op == Opcode::FSUB || op == Opcode::FMUL ||
+           op == Opcode::TBL;
+}
+
+constexpr bool is_vector_reduction(Opcode op) {
+    return op == Opcode::ADDV || op == Opcode::UMAXV || op == Opcode::UMINV;
+}
+
+// Record the operands of a flag-setting instruction (nothing for the others)
+template <Opcode Op>
+void record_flags(ConditionFlags& flags, uint64_t a, uint64_t b, uint64_t result) {
+    if constexpr (Op == Opcode::ADDS || Op == Opcode::ADDSI) flags.set_add(a, b);
+    else if constexpr (Op == Opcode::SUBS || Op == Opcode::SUBSI) flags.set_sub(a, b);
+    else if constexpr (Op == Opcode::ANDS || Op == Opcode::ANDSI) flags.set_logic(result);
+}
+
+} // namespace
+
+// One handler per opcode, each a complete instruction including the PC update.
+// The opcode is a template parameter, so every handler is straight-line code;
+// register-form ALU handlers shift rm by the opcode's fixed amount.
+struct InstructionHandlers {
+    template <Opcode Op>
+    static void execute(CPU& cpu, const Instruction& instr) {
+        Registers& regs = cpu.registers;
+        uint64_t pc = regs.get_pc();
+
+        if constexpr (is_register_alu(Op) || is_immediate_alu(Op)) {
+            uint64_t operand1 = regs.read_x(instr.rn);
+            uint64_t operand2 = is_register_alu(Op)
+                ? regs.read_x(instr.rm) << register_shift(Op)
+                : static_cast<uint64_t>(instr.imm);
+            uint64_t result = alu<Op>(operand1, operand2);
+            record_flags<Op>(regs.flags(), operand1, operand2, result);
+            regs.write_x(instr.rd, result);
+            regs.set_pc(pc + 4);
+        } else if constexpr (Op == Opcode::CSEL) {
+            regs.write_x(instr.rd, cpu.check_condition(instr.cond) ? regs.read_x(instr.rn)
+                                                                   : regs.read_x(instr.rm));
+            regs.set_pc(pc + 4);
+        } else if constexpr (Op == Opcode::LDUR) {
+            uint64_t address = regs.read_x(instr.rn) + instr.imm;
+            uint64_t value = 0;
+            if (!cpu.memory->try_read64(address, value)) {
+                cpu.raise_fault(FaultKind::MemoryOutOfBounds, address, sizeof(uint64_t), false);
+                return;
+            }
+            regs.write_x(instr.rd, value);
+            regs.set_pc(pc + 4);
+        } else if constexpr (Op == Opcode::STUR) {
+            uint64_t address = regs.read_x(instr.rn) + instr.imm;
+            if (!cpu.memory->try_write64(address, regs.read_x(instr.rd))) {
+                cpu.raise_fault(FaultKind::MemoryOutOfBounds, address, sizeof(uint64_t), true);
+                return;
+            }
+            regs.set_pc(pc + 4);
+        } else if constexpr (is_vector_binary(Op)) {
+            cpu.vector_kernels.binary[vector_op(Op)][instr.esize](
+                regs.vector(instr.rd), regs.vector(instr.rn), regs.vector(instr.rm));
+            regs.set_pc(pc + 4);
+        } else if constexpr (is_vector_reduction(Op)) {
+            cpu.vector_kernels.reduce[vector_reduction(Op)][instr.esize](regs.vector(instr.rd),
+                                                                         regs.vector(instr.rn));
+            regs.set_pc(pc + 4);
+        } else if constexpr (Op == Opcode::EXT) {
+            cpu.vector_kernels.ext(regs.vector(instr.rd), regs.vector(instr.rn), regs.vector(instr.rm),
+                                   static_cast<unsigned>(instr.imm));
+            regs.set_pc(pc + 4);
+        } else if constexpr (Op == Opcode::DUP) {
+            cpu.vector_kernels.dup[instr.esize](regs.vector(instr.rd), regs.read_x(instr.rn));
+            regs.set_pc(pc + 4);
+        } else if constexpr (Op == Opcode::UMOV) {
+            regs.write_x(instr.rd, vector_element(regs.vector(instr.rn), instr.esize,
+                                                  static_cast<size_t>(instr.imm)));
+            regs.set_pc(pc + 4);
+        } else if constexpr (Op == Opcode::LD1 || Op == Opcode::ST1) {
+            uint64_t address = regs.read_x(instr.rn);
+            VectorRegister& vt = regs.vector(instr.rd);
+            bool done = Op == Opcode::LD1 ? cpu.memory->try_read128(address, vt.bytes)
+                                          : cpu.memory->try_write128(address, vt.bytes);
+            if (!done) {
+                cpu.raise_fault(FaultKind::MemoryOutOfBounds, address, sizeof(VectorRegister),
+                                Op == Opcode::ST1);
+                return;
+            }
+            if (instr.wback) {
+                regs.write_x(instr.rn, address + sizeof(VectorRegister));
+            }
+            regs.set_pc(pc + 4);
+        } else if constexpr (Op == Opcode::B) {
+            cpu.branch_to(pc, pc + instr.imm);
+        } else if constexpr (Op == Opcode::BL) {
+            regs.write_x(30, pc + 4);
+            cpu.branch_to(pc, pc + instr.imm);
+        } else if constexpr (Op == Opcode::BR || Op == Opcode::RET) {
+            cpu.branch_to(pc, regs.read_x(instr.rn));
+        } else if constexpr (Op == Opcode::BLR) {
+            uint64_t target = regs.read_x(instr.rn);
+            regs.write_x(30, pc + 4);
+            cpu.branch_to(pc, target);
+        } else if constexpr (Op == Opcode::B_COND) {
+            cpu.branch_to(pc, cpu.check_condition(instr.cond) ? pc + instr.imm : pc + 4);
+        } else if constexpr (Op == Opcode::CBZ) {
+            cpu.branch_to(pc, regs.read_x(instr.rd) == 0 ? pc + instr.imm : pc + 4);
+        } else if constexpr (Op == Opcode::CBNZ) {
+            cpu.branch_to(pc, regs.read_x(instr.rd) != 0 ? pc + instr.imm : pc + 4);
+        } else {
+            cpu.raise_fault(FaultKind::UndefinedInstruction, pc, sizeof(uint32_t), false);
+        }
+    }
+};
+
+// X-macro listing every opcode in enum order, with whether it may stop execution
+// (loads and stores stop on faults and at watchpoints)
+#define ARM_EMULATOR_OPCODES(X) \
+    X(ADD, false)  X(SUB, false)  X(AND, false)  X(ORR, false)  X(EOR, false) \
+    X(ADDS, false) X(SUBS, false) X(ANDS, false) X(CSEL, false) \
+    X(ADDI, false) X(SUBI, false) X(ANDI, false) X(ORRI, false) X(EORI, false) \
+    X(ADDSI, false) X(SUBSI, false) X(ANDSI, false) \
+    X(LDUR, true)  X(STUR, true)  \
+    X(B, true)     X(BL, true)    X(BR, true)    X(BLR, true)   X(RET, true) \
+    X(B_COND, true) X(CBZ, true)  X(CBNZ, true)  \
+    X(VADD, false) X(VSUB, false) X(VMUL, false) X(VAND, false) X(VORR, false) \
+    X(VEOR, false) X(FADD, false) X(FSUB, false) X(FMUL, false) X(EXT, false) \
+    X(TBL, false)  X(DUP, false)  X(UMOV, false) \
+    X(ADDV, false) X(UMAXV, false) X(UMINV, false) \
+    X(LD1, true)   X(ST1, true)   \
+    X(INVALID, true)
+
+namespace {
+
+constexpr size_t OPCODE_COUNT = static_cast<size_t>(Opcode::INVALID) + 1;
+
+#define ARM_EMULATOR_HANDLER_ENTRY(op, stops) &InstructionHandlers::execute<Opcode::op>,
+constexpr Handler handler_table[] = { ARM_EMULATOR_OPCODES(ARM_EMULATOR_HANDLER_ENTRY) };
+#undef ARM_EMULATOR_HANDLER_ENTRY
+
+static_assert(sizeof(handler_table) / sizeof(handler_table[0]) == OPCODE_COUNT,
+              "handler table must cover every opcode");
+
+// The tables are indexed by opcode, so the list must follow the enum
+#define ARM_EMULATOR_OPCODE_KEY(op, stops) Opcode::op,
+constexpr Opcode listed_opcodes[] = { ARM_EMULATOR_OPCODES(ARM_EMULATOR_OPCODE_KEY) };
+#undef ARM_EMULATOR_OPCODE_KEY
+
+constexpr bool opcodes_in_enum_order() {
+    for (size_t i = 0; i < OPCODE_COUNT; ++i) {
+        if (static_cast<size_t>(listed_opcodes[i]) != i) return false;
+    }
+    return true;
+}
+static_assert(opcodes_in_enum_order(), "ARM_EMULATOR_OPCODES must list opcodes in enum order");
+
+} // namespace
+
+Handler resolve_handler(Opcode opcode) noexcept {
+    return handler_table[static_cast<size_t>(opcode)];
+}
+
+#if defined(__GNUC__)
+// Computed goto ("labels as values") is a GNU extension
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+uint64_t CPU::run_threaded(uint64_t max_instructions) {
+    // Each handler ends in its own copy of the dispatch jump, so the host
+    // predictor sees one indirect branch per opcode rather than one shared site.
+#define ARM_EMULATOR_LABEL_ENTRY(op, stops) &&op_##op,
+    static void* const labels[] = { ARM_EMULATOR_OPCODES(ARM_EMULATOR_LABEL_ENTRY) };
+#undef ARM_EMULATOR_LABEL_ENTRY
+
+    const DecodedEntry* entry = nullptr;
+    uint64_t pc = 0;
+    uint64_t dispatched = 0;  // Including the instruction being executed
+
+#define DISPATCH()                                                              \
+    do {                                                                        \
+        if (dispatched == max_instructions) return dispatched;                  \
+        pc = registers.get_pc();                                                \
+        entry = fetch_decoded(pc);                                              \
+        if (!entry) goto fetch_fault;                                           \
+        if (entry->breakpoint && stop_at_breakpoint(pc)) return dispatched;     \
+        ++dispatched;                                                           \
+        goto *labels[static_cast<size_t>(entry->instr.opcode)];                 \
+    } while (0)
+
+    if (!running) return 0;
+    DISPATCH();
+
+    // A faulting instruction is not retired
+#define ARM_EMULATOR_LABEL_BODY(op, stops)                                \
+    op_##op:                                                              \
+        InstructionHandlers::execute<Opcode::op>(*this, entry->instr);    \
+        if (stops && !running) return trap ? dispatched - 1 : dispatched; \
+        DISPATCH();
+    ARM_EMULATOR_OPCODES(ARM_EMULATOR_LABEL_BODY)
+#undef ARM_EMULATOR_LABEL_BODY
+
+fetch_fault:
+    raise_fault(FaultKind::FetchOutOfBounds, pc, sizeof(uint32_t), false);
+    return dispatched;
+#undef DISPATCH
+}
+
+#pragma GCC diagnostic pop
+#else
+
+uint64_t CPU::run_threaded(uint64_t max_instructions) {
+    uint64_t retired = 0;
+    while (running && retired < max_instructions) {
+        uint64_t pc = registers.get_pc();
+        const DecodedEntry* entry = fetch_decoded(pc);
+        if (!entry) {
+            raise_fault(FaultKind::FetchOutOfBounds, pc, sizeof(uint32_t), false);
+            break;
+        }
+        if (entry->breakpoint && stop_at_breakpoint(pc)) break;
+        entry->handler(*this, entry->instr);
+        if (!trap) ++retired;
+    }
+    return retired;
+}
+
+#endif
+
+BasicBlock* CPU::lookup_block(uint64_t pc) {
+    if (BasicBlock* block = block_cache.find(pc)) {
+        return block;
+    }
+    
+    auto block = std::make_unique<BasicBlock>();
+    block->start_pc = pc;
+    
+    uint64_t address = pc;
+    while (block->instructions.size() < BlockCache::MAX_BLOCK_INSTRUCTIONS) {
+        const DecodedEntry* entry = fetch_decoded(address);
+        if (!entry) {
+            // A fault on the first instruction is a fault at pc. Later faults
+            // end the block; they are raised when execution gets there.
+            if (block->instructions.empty()) {
+                raise_fault(FaultKind::FetchOutOfBounds, pc, sizeof(uint32_t), false);
+                return nullptr;
+            }
+            break;
+        }
+        
+        block->instructions.push_back({entry->handler, entry->instr});
+        if (entry->breakpoint) {
+            block->has_breakpoint = true;
+        }
+        address += 4;
+        
+        if (entry->instr.is_branch() || entry->instr.opcode == Opcode::INVALID) {
+            break;
+        }
+    }
+    block->end_pc = address;
+    
+    const Instruction& last = block->instructions.back().instr;
+    uint64_t last_pc = address - 4;
+    switch (last.opcode) {
+        case Opcode::B:
+        case Opcode::BL:
+            block->taken_pc = last_pc + last.imm;
+            break;
+        case Opcode::B_COND:
+        case Opcode::CBZ:
+        case Opcode::CBNZ:
+            block->taken_pc = last_pc + last.imm;
+            block->fallthrough_pc = address;
+            break;
+        case Opcode::BR:
+        case Opcode::BLR:
+        case Opcode::RET:
+        case Opcode::INVALID:
+            break;
+        default:
+            block->fallthrough_pc = address;
+            break;
+    }
+    
+    return block_cache.insert(std::move(block));
+}
+
+void CPU::flush_blocks_if_stale() {
+    if (block_cache.flush_if_stale()) {
+        jit.reset();
+    }
+}
+
+uint64_t CPU::run_blocks(uint64_t max_instructions) {
+    // Faults, the running flag, breakpoints and the instruction budget are
+    // handled once per block; only blocks holding a breakpoint or the end of
+    // the budget are run one instruction at a time
+    uint64_t retired = 0;
+    leave_block = false;
+    flush_blocks_if_stale();
+    BasicBlock* block = running && max_instructions > 0 ? lookup_block(registers.get_pc()) : nullptr;
+    
+    while (block) {
+        const size_t count = block->instructions.size();
+        if (block->has_breakpoint || max_instructions - retired < count) {
+            for (const auto& insn : block->instructions) {
+                if (retired == max_instructions) return retired;
+                uint64_t pc = registers.get_pc();
+                if (block->has_breakpoint && breakpoints.count(pc) && stop_at_breakpoint(pc)) {
+                    return retired;
+                }
+                insn.handler(*this, insn.instr);
+                if (leave_block) break;
+                ++retired;
+            }
+            // A faulting instruction is not retired; one that wrote code or
+            // hit a watchpoint is
+            if (leave_block && !trap) ++retired;
+        } else if (block->jit_code) {
+            int status = block->jit_code(registers.data(), this);
+            if (status == JIT_FAULT && jit_exception) {
+                std::exception_ptr error = std::move(jit_exception);
+                jit_exception = nullptr;
+                std::rethrow_exception(error);
+            }
+            if (status == JIT_OK) {
+                retired += count;
+                // Compiled branches do not go through branch_to(); detect the halt here
+                if (registers.get_pc() == block->end_pc - 4 &&
+                    block->instructions.back().instr.is_branch()) {
+                    halt();
+                }
+            } else {
+                // Blocks are straight-line code, so the PC tells how far it got
+                retired += (registers.get_pc() - block->start_pc) / 4;
+            }
+        } else {
+            size_t executed = 0;
+            for (const auto& insn : block->instructions) {
+                insn.handler(*this, insn.instr);
+                // A store rewrote cached code, or an instruction faulted or
+                // hit a watchpoint; leave before running stale instructions
+                if (leave_block) break;
+                ++executed;
+            }
+            if (leave_block && !trap) ++executed;
+            retired += executed;
+            if (engine == ExecutionEngine::Jit && ++block->exec_count == JIT_HOT_THRESHOLD &&
+                !leave_block) {
+                block->jit_code = jit.compile(*block);
+            }
+        }
+        
+        // Finding the next block may fault, which must not happen past the budget
+        if (!running || retired == max_instructions) return retired;
+        
+        uint64_t pc = registers.get_pc();
+        if (leave_block) {
+            leave_block = false;
+            flush_blocks_if_stale();
+            block = lookup_block(pc);
+        } else if (pc == block->taken_pc) {
+            if (!block->taken) block->taken = lookup_block(pc);
+            block = block->taken;
+        } else if (pc == block->fallthrough_pc) {
+            if (!block->fallthrough) block->fallthrough = lookup_block(pc);
+            block = block->fallthrough;
+        } else {
+            block = lookup_block(pc);
+        }
+    }
+    return retired;
+}
+
+} // namespace arm_emulator
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include "elf_loader.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace arm_emulator {
+
+namespace {
+
+// ELF64 structures, declared here so the loader does not depend on <elf.h>
+struct Elf64Header {
+    uint8_t  ident[16];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t version;
+    uint64_t entry;
+    uint64_t phoff;
+    uint64_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+};
+
+struct Elf64ProgramHeader {
+    uint32_t type;
+    uint32_t flags;
+    uint64_t offset;
+    uint64_t vaddr;
+    uint64_t paddr;
+    uint64_t filesz;
+    uint64_t memsz;
+    uint64_t align;
+};
+
+struct Elf64SectionHeader {
+    uint32_t name;
+    uint32_t type;
+    uint64_t flags;
+    uint64_t addr;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t link;
+    uint32_t info;
+    uint64_t addralign;
+    uint64_t entsize;
+};
+
+struct Elf64Symbol {
+    uint32_t name;
+    uint8_t  info;
+    uint8_t  other;
+    uint16_t shndx;
+    uint64_t value;
+    uint64_t size;
+};
+
+constexpr uint8_t ELFCLASS64 = 2;
+constexpr uint8_t ELFDATA2LSB = 1;
+constexpr uint16_t ET_EXEC = 2;
+constexpr uint16_t ET_DYN = 3;
+constexpr uint16_t EM_AARCH64 = 183;
+constexpr uint32_t PT_LOAD = 1;
+constexpr uint32_t SHT_SYMTAB = 2;
+constexpr uint16_t SHN_UNDEF = 0;
+constexpr uint8_t STT_NOTYPE = 0;
+constexpr uint8_t STT_FUNC = 2;
+
+// Copy a structure out of the file, checking bounds (the mapping may be unaligned)
+template <typename T>
+T read_struct(const MappedFile& file, uint64_t offset) {
+    if (offset > file.size() || sizeof(T) > file.size() - offset) {
+        throw std::runtime_error("ELF: truncated file");
+    }
+    T value;
+    std::memcpy(&value, file.data() + offset, sizeof(T));
+    return value;
+}
+
+} // namespace
+
+bool ElfLoader::is_elf(const MappedFile& file) noexcept {
+    return file.size() >= 4 && std::memcmp(file.data(), "\x7f" "ELF", 4) == 0;
+}
+
+uint64_t ElfLoader::load(const std::shared_ptr<MappedFile>& file, Memory& memory) {
+    if (!is_elf(*file)) {
+        throw std::runtime_error("ELF: bad magic");
+    }
+
+    auto header = read_struct<Elf64Header>(*file, 0);
+    if (header.ident[4] != ELFCLASS64 || header.ident[5] != ELFDATA2LSB) {
+        throw std::runtime_error("ELF: not a 64-bit little-endian image");
+    }
+    if (header.machine != EM_AARCH64) {
+        throw std::runtime_error("ELF: not an AArch64 image");
+    }
+    if (header.type != ET_EXEC && header.type != ET_DYN) {
+        throw std::runtime_error("ELF: not an executable");
+    }
+    if (header.phentsize != sizeof(Elf64ProgramHeader)) {
+        throw std::runtime_error("ELF: unexpected program header size");
+    }
+
+    for (uint16_t i = 0; i < header.phnum; ++i) {
+        auto segment = read_struct<Elf64ProgramHeader>(
+            *file, header.phoff + static_cast<uint64_t>(i) * sizeof(Elf64ProgramHeader));
+        if (segment.type != PT_LOAD || segment.memsz == 0) continue;
+
+        if (segment.filesz > segment.memsz) {
+            throw std::runtime_error("ELF: segment file size exceeds memory size");
+        }
+        memory.map_file_lazy(segment.vaddr, segment.memsz, file, segment.offset, segment.filesz);
+    }
+
+    return header.entry;
+}
+
+std::vector<Symbol> ElfLoader::read_symbols(const MappedFile& file) {
+    std::vector<Symbol> symbols;
+    auto header = read_struct<Elf64Header>(file, 0);
+    if (header.shnum == 0) return symbols;
+    if (header.shentsize != sizeof(Elf64SectionHeader)) {
+        throw std::runtime_error("ELF: unexpected section header size");
+    }
+
+    auto section = [&](uint32_t index) {
+        if (index >= header.shnum) {
+            throw std::runtime_error("ELF: section index out of range");
+        }
+        return read_struct<Elf64SectionHeader>(
+            file, header.shoff + static_cast<uint64_t>(index) * sizeof(Elf64SectionHeader));
+    };
+
+    for (uint16_t i = 0; i < header.shnum; ++i) {
+        auto symtab = section(i);
+        if (symtab.type != SHT_SYMTAB) continue;
+
+        auto strtab = section(symtab.link);
+        if (strtab.offset > file.size() || strtab.size > file.size() - strtab.offset) {
+            throw std::runtime_error("ELF: truncated string table");
+        }
+        const char* strings = reinterpret_cast<const char*>(file.data() + strtab.offset);
+
+        for (uint64_t at = 0; at + sizeof(Elf64Symbol) <= symtab.size; at += sizeof(Elf64Symbol)) {
+            auto symbol = read_struct<Elf64Symbol>(file, symtab.offset + at);
+            uint8_t type = symbol.info & 0xF;
+            if ((type != STT_FUNC && type != STT_NOTYPE) || symbol.shndx == SHN_UNDEF ||
+                symbol.name == 0 || symbol.name >= strtab.size) {
+                continue;
+            }
+            // Names are NUL-terminated, but not necessarily before the section
+            // ends. Mapping symbols ($x, $d) only mark code and data.
+            const char* name = strings + symbol.name;
+            size_t length = strnlen(name, strtab.size - symbol.name);
+            if (name[0] == '$') continue;
+            symbols.push_back(Symbol{symbol.value, symbol.size, std::string(name, length)});
+        }
+    }
+    return symbols;
+}
+
+} // namespace arm_emulator
\ No newline at end of file
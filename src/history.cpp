@@ -0,0 +1,155 @@
+#include "history.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+namespace arm_emulator {
+
+namespace {
+
+// Replays re-execute instructions that observers (traces, cache and branch
+// models) have already been shown, so they are kept out of them
+class PausedObservers {
+public:
+    explicit PausedObservers(CPU& cpu_ref) : cpu(cpu_ref), was_paused(cpu.pause_observers(true)) {}
+    ~PausedObservers() { cpu.pause_observers(was_paused); }
+    
+    PausedObservers(const PausedObservers&) = delete;
+    PausedObservers& operator=(const PausedObservers&) = delete;
+
+private:
+    CPU& cpu;
+    bool was_paused;
+};
+
+} // namespace
+
+ExecutionHistory::ExecutionHistory(CPU& cpu_ref, uint64_t interval_, size_t max_checkpoints_)
+    : cpu(cpu_ref), interval(interval_), max_checkpoints(max_checkpoints_) {
+    if (interval == 0 || max_checkpoints < 2) {
+        throw std::invalid_argument("History needs a non-zero interval and two checkpoints");
+    }
+    reset();
+}
+
+void ExecutionHistory::reset() {
+    checkpoints.clear();
+    current = 0;
+    checkpoint();
+}
+
+RunResult ExecutionHistory::run_for(uint64_t max_instructions) {
+    return advance(max_instructions, nullptr);
+}
+
+RunResult ExecutionHistory::run_until(uint64_t address, uint64_t max_instructions) {
+    return advance(max_instructions, &address);
+}
+
+RunResult ExecutionHistory::advance(uint64_t max_instructions, const uint64_t* until) {
+    RunResult total{StopReason::InstructionLimit, 0};
+    while (total.instructions < max_instructions) {
+        uint64_t next = (current / interval + 1) * interval;
+        uint64_t chunk = std::min(max_instructions - total.instructions, next - current);
+        RunResult result = until ? cpu.run_until(*until, chunk) : cpu.run_for(chunk);
+        current += result.instructions;
+        total.instructions += result.instructions;
+        
+        if (current == next) {
+            checkpoint();
+        }
+        if (result.reason != StopReason::InstructionLimit) {
+            total.reason = result.reason;
+            break;
+        }
+        // The next chunk would start from the target and run past it
+        if (until && cpu.get_registers().get_pc() == *until && result.instructions > 0) {
+            total.reason = StopReason::AddressReached;
+            break;
+        }
+    }
+    return total;
+}
+
+void ExecutionHistory::checkpoint() {
+    if (checkpoints.count(current)) return;
+    checkpoints.emplace(current, cpu.snapshot());
+    
+    // Thin out to every other checkpoint by doubling the interval
+    if (checkpoints.size() > max_checkpoints) {
+        interval *= 2;
+        for (auto it = checkpoints.begin(); it != checkpoints.end();) {
+            it = it->first % interval != 0 ? checkpoints.erase(it) : std::next(it);
+        }
+    }
+}
+
+RunResult ExecutionHistory::replay_to(uint64_t target) {
+    PausedObservers paused(cpu);
+    auto it = std::prev(checkpoints.upper_bound(target));
+    cpu.restore(it->second);
+    current = it->first;
+    
+    RunResult last{StopReason::InstructionLimit, 0};
+    while (current < target) {
+        last = cpu.run_for(target - current);
+        current += last.instructions;
+        if (!cpu.is_running()) break;
+    }
+    return last;
+}
+
+RunResult ExecutionHistory::step_back(uint64_t count) {
+    uint64_t start = current;
+    uint64_t target = count < current ? current - count : 0;
+    replay_to(target);
+    return RunResult{count > start ? StopReason::HistoryStart : StopReason::InstructionLimit,
+                     start - target};
+}
+
+RunResult ExecutionHistory::reverse_continue() {
+    PausedObservers paused(cpu);
+    uint64_t start = current;
+    
+    // Replay the segments between checkpoints from the latest backwards,
+    // looking for the last stop before the current position. A stop right
+    // at a checkpoint is found by the segment starting there.
+    uint64_t segment_end = start;
+    auto it = checkpoints.lower_bound(start);
+    while (it != checkpoints.begin()) {
+        --it;
+        cpu.restore(it->second);
+        uint64_t position = it->first;
+        uint64_t found = start;
+        StopReason found_reason = StopReason::Breakpoint;
+        
+        while (position < segment_end) {
+            RunResult result = cpu.run_for(segment_end - position);
+            position += result.instructions;
+            if (result.reason != StopReason::Breakpoint && result.reason != StopReason::Watchpoint) {
+                break;
+            }
+            if (position < start) {
+                found = position;
+                found_reason = result.reason;
+            }
+        }
+        
+        if (found < start) {
+            RunResult last = replay_to(found);
+            // Arriving by instruction count leaves the breakpoint still to be
+            // hit; hit it, so the next run executes past it
+            if (found_reason == StopReason::Breakpoint && last.reason != StopReason::Breakpoint) {
+                cpu.run_for(1);
+            }
+            return RunResult{found_reason, start - found};
+        }
+        segment_end = it->first;
+    }
+    
+    replay_to(0);
+    return RunResult{StopReason::HistoryStart, start};
+}
+
+} // namespace arm_emulator
@@ -1,36 +1,105 @@
 #include "instruction.hpp"
 #include <sstream>
 #include <iomanip>
+#include <mutex>
 #include <stdexcept>
+#include <unordered_map>
 
 namespace arm_emulator {
 
-bool Instruction::is_branch() const {
-    return opcode == Opcode::B || opcode == Opcode::BL || 
-           opcode == Opcode::BR || opcode == Opcode::BLR ||
-           opcode == Opcode::RET || opcode == Opcode::CBZ ||
-           opcode == Opcode::CBNZ;
+namespace {
+
+// Every field of an instruction, packed for use as a table key
+struct InstructionKey {
+    uint64_t low;
+    uint64_t high;
+    
+    bool operator==(const InstructionKey& other) const { return low == other.low && high == other.high; }
+};
+
+InstructionKey key_of(const Instruction& instr) {
+    uint64_t low = static_cast<uint32_t>(instr.imm) |
+                   static_cast<uint64_t>(instr.opcode) << 32 |
+                   static_cast<uint64_t>(instr.cond) << 40 |
+                   static_cast<uint64_t>(instr.shift) << 48 |
+                   static_cast<uint64_t>(instr.addr_mode) << 56;
+    uint64_t high = instr.rd | static_cast<uint64_t>(instr.rn) << 8 |
+                    static_cast<uint64_t>(instr.rm) << 16 | static_cast<uint64_t>(instr.ra) << 24 |
+                    static_cast<uint64_t>(instr.wback) << 32 | static_cast<uint64_t>(instr.esize) << 40;
+    return {low, high};
 }
 
-bool Instruction::is_memory_op() const {
-    return opcode == Opcode::LDUR || opcode == Opcode::STUR;
+struct InstructionKeyHash {
+    size_t operator()(const InstructionKey& key) const {
+        return std::hash<uint64_t>()(key.low * 0x9E3779B97F4A7C15ULL ^ key.high);
+    }
+};
+
+// Disassembly of instructions already shown. Bounded, since arbitrary
+// words can be disassembled; past the limit text is formatted every time.
+constexpr size_t MAX_TEXTS = 1 << 16;
+std::mutex texts_mutex;
+std::unordered_map<InstructionKey, std::string, InstructionKeyHash> texts;
+
+// Arrangement of a full vector of esize elements
+const char* arrangement(uint8_t esize) {
+    switch (esize) {
+        case 0: return "16B";
+        case 1: return "8H";
+        case 2: return "4S";
+        default: return "2D";
+    }
 }
 
-std::string Instruction::to_string() const {
+// Element size letter (B, H, S or D)
+char element_name(uint8_t esize) {
+    return "BHSD"[esize & 3];
+}
+
+const char* condition_name(Condition cond) {
+    switch (cond) {
+        case Condition::EQ: return "EQ";
+        case Condition::NE: return "NE";
+        case Condition::CS: return "CS";
+        case Condition::CC: return "CC";
+        case Condition::MI: return "MI";
+        case Condition::PL: return "PL";
+        case Condition::VS: return "VS";
+        case Condition::VC: return "VC";
+        case Condition::HI: return "HI";
+        case Condition::LS: return "LS";
+        case Condition::GE: return "GE";
+        case Condition::LT: return "LT";
+        case Condition::GT: return "GT";
+        case Condition::LE: return "LE";
+        case Condition::AL: return "AL";
+        case Condition::NV: return "NV";
+    }
+    return "?";
+}
+
+std::string format(const Instruction& instr) {
     std::ostringstream oss;
     
     // Opcode
-    switch (opcode) {
+    switch (instr.opcode) {
         case Opcode::ADD:  oss << "ADD"; break;
         case Opcode::SUB:  oss << "SUB"; break;
         case Opcode::AND:  oss << "AND"; break;
         case Opcode::ORR:  oss << "ORR"; break;
         case Opcode::EOR:  oss << "EOR"; break;
+        case Opcode::ADDS: oss << "ADDS"; break;
+        case Opcode::SUBS: oss << "SUBS"; break;
+        case Opcode::ANDS: oss << "ANDS"; break;
+        case Opcode::CSEL: oss << "CSEL"; break;
         case Opcode::ADDI: oss << "ADDI"; break;
         case Opcode::SUBI: oss << "SUBI"; break;
         case Opcode::ANDI: oss << "ANDI"; break;
         case Opcode::ORRI: oss << "ORRI"; break;
         case Opcode::EORI: oss << "EORI"; break;
+        case Opcode::ADDSI: oss << "ADDSI"; break;
+        case Opcode::SUBSI: oss << "SUBSI"; break;
+        case Opcode::ANDSI: oss << "ANDSI"; break;
         case Opcode::LDUR: oss << "LDUR"; break;
         case Opcode::STUR: oss << "STUR"; break;
         case Opcode::B:    oss << "B"; break;
@@ -38,46 +107,51 @@ std::string Instruction::to_string() const {
         case Opcode::BR:   oss << "BR"; break;
         case Opcode::BLR:  oss << "BLR"; break;
         case Opcode::RET:  oss << "RET"; break;
+        case Opcode::B_COND: oss << "B"; break;
         case Opcode::CBZ:  oss << "CBZ"; break;
         case Opcode::CBNZ: oss << "CBNZ"; break;
+        case Opcode::VADD: oss << "ADD"; break;
+        case Opcode::VSUB: oss << "SUB"; break;
+        case Opcode::VMUL: oss << "MUL"; break;
+        case Opcode::VAND: oss << "AND"; break;
+        case Opcode::VORR: oss << "ORR"; break;
+        case Opcode::VEOR: oss << "EOR"; break;
+        case Opcode::FADD: oss << "FADD"; break;
+        case Opcode::FSUB: oss << "FSUB"; break;
+        case Opcode::FMUL: oss << "FMUL"; break;
+        case Opcode::EXT:  oss << "EXT"; break;
+        case Opcode::TBL:  oss << "TBL"; break;
+        case Opcode::DUP:  oss << "DUP"; break;
+        case Opcode::UMOV: oss << "UMOV"; break;
+        case Opcode::ADDV: oss << "ADDV"; break;
+        case Opcode::UMAXV: oss << "UMAXV"; break;
+        case Opcode::UMINV: oss << "UMINV"; break;
+        case Opcode::LD1:  oss << "LD1"; break;
+        case Opcode::ST1:  oss << "ST1"; break;
         case Opcode::INVALID: oss << "INVALID"; break;
     }
     
-    // Condition code (if conditional)
-    if (is_conditional()) {
-        switch (cond) {
-            case Condition::EQ: oss << ".EQ"; break;
-            case Condition::NE: oss << ".NE"; break;
-            case Condition::CS: oss << ".CS"; break;
-            case Condition::CC: oss << ".CC"; break;
-            case Condition::MI: oss << ".MI"; break;
-            case Condition::PL: oss << ".PL"; break;
-            case Condition::VS: oss << ".VS"; break;
-            case Condition::VC: oss << ".VC"; break;
-            case Condition::HI: oss << ".HI"; break;
-            case Condition::LS: oss << ".LS"; break;
-            case Condition::GE: oss << ".GE"; break;
-            case Condition::LT: oss << ".LT"; break;
-            case Condition::GT: oss << ".GT"; break;
-            case Condition::LE: oss << ".LE"; break;
-            case Condition::AL: break;  // No suffix for always
-            case Condition::NV: oss << ".NV"; break;
-        }
+    // Condition code (if conditional); CSEL takes it as an operand
+    if (instr.is_conditional() && instr.opcode != Opcode::CSEL) {
+        oss << "." << condition_name(instr.cond);
     }
     
     // Operands
-    switch (opcode) {
+    switch (instr.opcode) {
         // Format: OP Rd, Rn, Rm
         case Opcode::ADD:
         case Opcode::SUB:
         case Opcode::AND:
         case Opcode::ORR:
         case Opcode::EOR:
-            oss << " X" << static_cast<int>(rd) 
-                << ", X" << static_cast<int>(rn)
-                << ", X" << static_cast<int>(rm);
-            if (shift > 0) {
-                oss << ", LSL #" << static_cast<int>(shift);
+        case Opcode::ADDS:
+        case Opcode::SUBS:
+        case Opcode::ANDS:
+            oss << " X" << static_cast<int>(instr.rd) 
+                << ", X" << static_cast<int>(instr.rn)
+                << ", X" << static_cast<int>(instr.rm);
+            if (instr.shift > 0) {
+                oss << ", LSL #" << static_cast<int>(instr.shift);
             }
             break;
             
@@ -87,48 +161,119 @@ std::string Instruction::to_string() const {
         case Opcode::ANDI:
         case Opcode::ORRI:
         case Opcode::EORI:
-            oss << " X" << static_cast<int>(rd)
-                << ", X" << static_cast<int>(rn)
-                << ", #" << imm;
+        case Opcode::ADDSI:
+        case Opcode::SUBSI:
+        case Opcode::ANDSI:
+            oss << " X" << static_cast<int>(instr.rd)
+                << ", X" << static_cast<int>(instr.rn)
+                << ", #" << instr.imm;
             break;
             
         // Format: OP Xt, [Xn, #offset]
         case Opcode::LDUR:
         case Opcode::STUR: {
-            oss << (opcode == Opcode::LDUR ? " X" : " X") 
-                << static_cast<int>(rd)
-                << ", [X" << static_cast<int>(rn);
-            if (imm != 0) {
-                oss << ", #" << imm;
+            oss << (instr.opcode == Opcode::LDUR ? " X" : " X") 
+                << static_cast<int>(instr.rd)
+                << ", [X" << static_cast<int>(instr.rn);
+            if (instr.imm != 0) {
+                oss << ", #" << instr.imm;
             }
             oss << "]";
             break;
         }
             
+        // Format: CSEL Xd, Xn, Xm, cond
+        case Opcode::CSEL:
+            oss << " X" << static_cast<int>(instr.rd)
+                << ", X" << static_cast<int>(instr.rn)
+                << ", X" << static_cast<int>(instr.rm)
+                << ", " << condition_name(instr.cond);
+            break;
+            
         // Format: B #offset
         case Opcode::B:
         case Opcode::BL:
-            oss << " #" << imm;
+        case Opcode::B_COND:
+            oss << " #" << instr.imm;
             break;
             
         // Format: BR/BLR Xn
         case Opcode::BR:
         case Opcode::BLR:
-            oss << " X" << static_cast<int>(rn);
+            oss << " X" << static_cast<int>(instr.rn);
             break;
             
         // Format: RET [Xn]
         case Opcode::RET:
-            if (rn != 30) {  // Default is X30 if not specified
-                oss << " X" << static_cast<int>(rn);
+            if (instr.rn != 30) {  // Default is X30 if not specified
+                oss << " X" << static_cast<int>(instr.rn);
             }
             break;
             
         // Format: CBZ/CBNZ Xt, #offset
         case Opcode::CBZ:
         case Opcode::CBNZ:
-            oss << " X" << static_cast<int>(rd)
-                << ", #" << imm;
+            oss << " X" << static_cast<int>(instr.rd)
+                << ", #" << instr.imm;
+            break;
+            
+        // Format: OP Vd.T, Vn.T, Vm.T
+        case Opcode::VADD:
+        case Opcode::VSUB:
+        case Opcode::VMUL:
+        case Opcode::VAND:
+        case Opcode::VORR:
+        case Opcode::VEOR:
+        case Opcode::FADD:
+        case Opcode::FSUB:
+        case Opcode::FMUL:
+        case Opcode::EXT: {
+            const char* t = arrangement(instr.esize);
+            oss << " V" << static_cast<int>(instr.rd) << "." << t
+                << ", V" << static_cast<int>(instr.rn) << "." << t
+                << ", V" << static_cast<int>(instr.rm) << "." << t;
+            if (instr.opcode == Opcode::EXT) {
+                oss << ", #" << instr.imm;
+            }
+            break;
+        }
+            
+        // Format: TBL Vd.16B, {Vn.16B}, Vm.16B
+        case Opcode::TBL:
+            oss << " V" << static_cast<int>(instr.rd)
+                << ".16B, {V" << static_cast<int>(instr.rn)
+                << ".16B}, V" << static_cast<int>(instr.rm) << ".16B";
+            break;
+            
+        // Format: DUP Vd.T, Xn
+        case Opcode::DUP:
+            oss << " V" << static_cast<int>(instr.rd) << "." << arrangement(instr.esize)
+                << ", X" << static_cast<int>(instr.rn);
+            break;
+            
+        // Format: UMOV Xd, Vn.T[index]
+        case Opcode::UMOV:
+            oss << " X" << static_cast<int>(instr.rd)
+                << ", V" << static_cast<int>(instr.rn) << "." << element_name(instr.esize)
+                << "[" << instr.imm << "]";
+            break;
+            
+        // Format: OP <T>d, Vn.T
+        case Opcode::ADDV:
+        case Opcode::UMAXV:
+        case Opcode::UMINV:
+            oss << " " << element_name(instr.esize) << static_cast<int>(instr.rd)
+                << ", V" << static_cast<int>(instr.rn) << "." << arrangement(instr.esize);
+            break;
+            
+        // Format: LD1/ST1 {Vt.16B}, [Xn] or [Xn], #16
+        case Opcode::LD1:
+        case Opcode::ST1:
+            oss << " {V" << static_cast<int>(instr.rd)
+                << ".16B}, [X" << static_cast<int>(instr.rn) << "]";
+            if (instr.wback) {
+                oss << ", #16";
+            }
             break;
             
         case Opcode::INVALID:
@@ -136,12 +281,35 @@ std::string Instruction::to_string() const {
             break;
     }
     
-    // Add raw text if available
-    if (!raw_text.empty()) {
-        oss << " ; " << raw_text;
-    }
-    
     return oss.str();
 }
 
+} // namespace
+
+bool Instruction::is_branch() const {
+    return opcode == Opcode::B || opcode == Opcode::BL || 
+           opcode == Opcode::BR || opcode == Opcode::BLR ||
+           opcode == Opcode::RET || opcode == Opcode::B_COND ||
+           opcode == Opcode::CBZ || opcode == Opcode::CBNZ;
+}
+
+bool Instruction::is_memory_op() const {
+    return opcode == Opcode::LDUR || opcode == Opcode::STUR ||
+           opcode == Opcode::LD1 || opcode == Opcode::ST1;
+}
+
+std::string Instruction::to_string() const {
+    InstructionKey key = key_of(*this);
+    std::lock_guard<std::mutex> lock(texts_mutex);
+    auto it = texts.find(key);
+    if (it != texts.end()) {
+        return it->second;
+    }
+    std::string text = format(*this);
+    if (texts.size() < MAX_TEXTS) {
+        texts.emplace(key, text);
+    }
+    return text;
+}
+
 } // namespace arm_emulator
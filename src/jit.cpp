@@ -0,0 +1,442 @@
+#include "jit.hpp"
+#include "cpu.hpp"
+#include "block_cache.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__unix__)
+#define ARM_EMULATOR_JIT_X86_64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace arm_emulator {
+
+// Out-of-line operations called from generated code. They never throw:
+// guest faults are raised as traps, host exceptions (such as allocation
+// failures) are parked in the CPU, and both are reported as JIT_FAULT.
+struct JitHelpers {
+    static int load64(CPU* cpu, uint64_t address, uint64_t pc, uint64_t rd) noexcept {
+        try {
+            uint64_t value = 0;
+            if (!cpu->memory->try_read64(address, value)) {
+                return trap(cpu, pc, address, false);
+            }
+            cpu->registers.write_x(rd, value);
+        } catch (...) {
+            return fault(cpu, pc);
+        }
+        if (cpu->leave_block) {
+            cpu->registers.set_pc(pc + 4);
+            return JIT_EXIT;
+        }
+        return JIT_OK;
+    }
+
+    static int store64(CPU* cpu, uint64_t address, uint64_t pc, uint64_t value) noexcept {
+        try {
+            if (!cpu->memory->try_write64(address, value)) {
+                return trap(cpu, pc, address, true);
+            }
+        } catch (...) {
+            return fault(cpu, pc);
+        }
+        if (cpu->leave_block) {
+            cpu->registers.set_pc(pc + 4);
+            return JIT_EXIT;
+        }
+        return JIT_OK;
+    }
+
+    // Instructions the translator does not handle run through the switch interpreter
+    static int fallback(CPU* cpu, const Instruction* instr, uint64_t pc) noexcept {
+        cpu->registers.set_pc(pc);
+        try {
+            if (!cpu->execute_instruction(*instr)) {
+                return JIT_FAULT;
+            }
+        } catch (...) {
+            return fault(cpu, pc);
+        }
+        if (!instr->is_branch()) {
+            cpu->registers.set_pc(pc + 4);
+        }
+        if (cpu->leave_block) {
+            return JIT_EXIT;
+        }
+        return JIT_OK;
+    }
+
+private:
+    static int trap(CPU* cpu, uint64_t pc, uint64_t address, bool write) noexcept {
+        cpu->registers.set_pc(pc);
+        cpu->raise_fault(FaultKind::MemoryOutOfBounds, address, sizeof(uint64_t), write);
+        return JIT_FAULT;
+    }
+
+    static int fault(CPU* cpu, uint64_t pc) noexcept {
+        cpu->jit_exception = std::current_exception();
+        cpu->registers.set_pc(pc);
+        return JIT_FAULT;
+    }
+};
+
+#ifdef ARM_EMULATOR_JIT_X86_64
+
+namespace {
+
+// x86-64 general-purpose register numbers
+enum HostReg : uint8_t { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSI = 6, RDI = 7 };
+
+constexpr int32_t PC_OFFSET = static_cast<int32_t>(SpecialRegister::PC) * 8;
+
+// Minimal encoder for the handful of instruction forms the translator needs.
+// RBX holds the guest register array and R12 the CPU pointer.
+class Emitter {
+public:
+    std::vector<uint8_t> code;
+
+    void byte(uint8_t b) { code.push_back(b); }
+    void dword(uint32_t v) { for (int i = 0; i < 4; ++i) byte(static_cast<uint8_t>(v >> (i * 8))); }
+    void qword(uint64_t v) { for (int i = 0; i < 8; ++i) byte(static_cast<uint8_t>(v >> (i * 8))); }
+
+    // mov reg, [rbx + disp32]
+    void load(HostReg reg, int32_t disp) { byte(0x48); byte(0x8B); byte(0x83 | (reg << 3)); dword(disp); }
+    // mov [rbx + disp32], reg
+    void store(int32_t disp, HostReg reg) { byte(0x48); byte(0x89); byte(0x83 | (reg << 3)); dword(disp); }
+
+    void load_guest(HostReg reg, uint8_t index) { load(reg, index * 8); }
+    void store_guest(uint8_t index, HostReg reg) {
+        if (index != static_cast<uint8_t>(SpecialRegister::XZR)) store(index * 8, reg);
+    }
+
+    // mov reg, imm64
+    void mov_imm(HostReg reg, uint64_t value) { byte(0x48); byte(0xB8 + reg); qword(value); }
+    // <op> dst, src with the r/m64, r64 opcode
+    void alu_rr(uint8_t opcode, HostReg dst, HostReg src) { byte(0x48); byte(opcode); byte(0xC0 | (src << 3) | dst); }
+    // <op> dst, imm32 (sign-extended) with the 0x81 /digit group
+    void alu_ri(uint8_t digit, HostReg dst, int32_t imm) { byte(0x48); byte(0x81); byte(0xC0 | (digit << 3) | dst); dword(static_cast<uint32_t>(imm)); }
+    // shl reg, imm8
+    void shl(HostReg reg, uint8_t amount) { byte(0x48); byte(0xC1); byte(0xE0 | reg); byte(amount); }
+    // test reg, reg
+    void test(HostReg reg) { byte(0x48); byte(0x85); byte(0xC0 | (reg << 3) | reg); }
+    // cmov<cc> dst, src
+    void cmov(uint8_t cc, HostReg dst, HostReg src) { byte(0x48); byte(0x0F); byte(0x40 | cc); byte(0xC0 | (dst << 3) | src); }
+
+    // lea reg, [rbx + disp32]
+    void lea(HostReg reg, int32_t disp) { byte(0x48); byte(0x8D); byte(0x83 | (reg << 3)); dword(disp); }
+    // Zero-extending load of a 1, 2, 4 or 8 byte element at [rbx + disp32] (esize 0-3)
+    void load_element(HostReg reg, int32_t disp, uint8_t esize) {
+        switch (esize) {
+            case 0: byte(0x0F); byte(0xB6); break;  // movzx r32, byte
+            case 1: byte(0x0F); byte(0xB7); break;  // movzx r32, word
+            case 2: byte(0x8B); break;              // mov r32 (clears the upper half)
+            default: byte(0x48); byte(0x8B); break; // mov r64
+        }
+        byte(0x83 | (reg << 3)); dword(disp);
+    }
+
+    // Call a function that cannot fail, with arguments already in place
+    template <typename Fn>
+    void call(Fn* fn) {
+        mov_imm(RAX, reinterpret_cast<uintptr_t>(fn));
+        byte(0xFF); byte(0xD0);              // call rax
+    }
+
+    // Call a helper with (cpu, rsi, rdx, rcx) and leave the block if it reports non-zero
+    template <typename Fn>
+    void call_helper(Fn* fn) {
+        byte(0x4C); byte(0x89); byte(0xE7);  // mov rdi, r12
+        mov_imm(RAX, reinterpret_cast<uintptr_t>(fn));
+        byte(0xFF); byte(0xD0);              // call rax
+        byte(0x85); byte(0xC0);              // test eax, eax
+        byte(0x0F); byte(0x85);              // jnz epilogue
+        exits.push_back(code.size());
+        dword(0);
+    }
+
+    void prologue() {
+        byte(0x53);                          // push rbx
+        byte(0x41); byte(0x54);              // push r12
+        byte(0x41); byte(0x55);              // push r13 (keeps rsp 16-byte aligned for calls)
+        byte(0x48); byte(0x89); byte(0xFB);  // mov rbx, rdi
+        byte(0x49); byte(0x89); byte(0xF4);  // mov r12, rsi
+    }
+
+    void epilogue() {
+        byte(0x31); byte(0xC0);              // xor eax, eax
+        size_t label = code.size();
+        for (size_t at : exits) {
+            int32_t rel = static_cast<int32_t>(label - (at + 4));
+            std::memcpy(&code[at], &rel, sizeof(rel));
+        }
+        byte(0x41); byte(0x5D);              // pop r13
+        byte(0x41); byte(0x5C);              // pop r12
+        byte(0x5B);                          // pop rbx
+        byte(0xC3);                          // ret
+    }
+
+private:
+    std::vector<size_t> exits;  // rel32 fields of the jumps to the shared exit
+};
+
+// x86 opcodes for the register forms and /digit of the immediate forms
+uint8_t rr_opcode(Opcode op) {
+    switch (op) {
+        case Opcode::ADD: case Opcode::ADDI: case Opcode::ADDS: case Opcode::ADDSI: return 0x01;
+        case Opcode::SUB: case Opcode::SUBI: case Opcode::SUBS: case Opcode::SUBSI: return 0x29;
+        case Opcode::AND: case Opcode::ANDI: case Opcode::ANDS: case Opcode::ANDSI: return 0x21;
+        case Opcode::ORR: case Opcode::ORRI: return 0x09;
+        default:                             return 0x31;  // EOR
+    }
+}
+
+uint8_t ri_digit(Opcode op) {
+    switch (op) {
+        case Opcode::ADDI: return 0;
+        case Opcode::ORRI: return 1;
+        case Opcode::ANDI: return 4;
+        case Opcode::SUBI: return 5;
+        default:           return 6;  // EORI
+    }
+}
+
+// rd = RAX <op> RCX. Flag-setting forms also store what ConditionFlags
+// needs to work the flags out later.
+void emit_alu(Emitter& e, Opcode op, uint8_t rd) {
+    const int32_t flags = static_cast<int32_t>(Registers::flags_offset());
+    const int32_t kind_offset = flags + static_cast<int32_t>(offsetof(ConditionFlags, kind));
+    const int32_t a_offset = flags + static_cast<int32_t>(offsetof(ConditionFlags, a));
+    const int32_t b_offset = flags + static_cast<int32_t>(offsetof(ConditionFlags, b));
+    
+    ConditionFlags::Kind kind = ConditionFlags::Value;
+    switch (op) {
+        case Opcode::ADDS: case Opcode::ADDSI: kind = ConditionFlags::Add; break;
+        case Opcode::SUBS: case Opcode::SUBSI: kind = ConditionFlags::Sub; break;
+        case Opcode::ANDS: case Opcode::ANDSI: kind = ConditionFlags::Logic; break;
+        default: break;
+    }
+    
+    if (kind == ConditionFlags::Add || kind == ConditionFlags::Sub) {
+        e.store(a_offset, RAX);
+        e.store(b_offset, RCX);
+    }
+    e.alu_rr(rr_opcode(op), RAX, RCX);
+    if (kind == ConditionFlags::Logic) {
+        e.store(a_offset, RAX);
+    }
+    if (kind != ConditionFlags::Value) {
+        e.mov_imm(RDX, kind);
+        e.store(kind_offset, RDX);
+    }
+    e.store_guest(rd, RAX);
+}
+
+// Offset of a vector register from the guest register array
+int32_t vector_disp(uint8_t index) {
+    return static_cast<int32_t>(Registers::vector_offset() + index * sizeof(VectorRegister));
+}
+
+void emit_instruction(Emitter& e, const Instruction& instr, uint64_t pc) {
+    const VectorKernels& kernels = VectorKernels::host();
+    switch (instr.opcode) {
+        case Opcode::ADD:
+        case Opcode::SUB:
+        case Opcode::AND:
+        case Opcode::ORR:
+        case Opcode::EOR:
+        case Opcode::ADDS:
+        case Opcode::SUBS:
+        case Opcode::ANDS:
+            e.load_guest(RAX, instr.rn);
+            e.load_guest(RCX, instr.rm);
+            if (instr.shift & 63) e.shl(RCX, instr.shift & 63);
+            emit_alu(e, instr.opcode, instr.rd);
+            break;
+
+        case Opcode::ADDI:
+        case Opcode::SUBI:
+        case Opcode::ANDI:
+        case Opcode::ORRI:
+        case Opcode::EORI:
+            e.load_guest(RAX, instr.rn);
+            e.alu_ri(ri_digit(instr.opcode), RAX, static_cast<int32_t>(instr.imm));
+            e.store_guest(instr.rd, RAX);
+            break;
+
+        case Opcode::ADDSI:
+        case Opcode::SUBSI:
+        case Opcode::ANDSI:
+            e.load_guest(RAX, instr.rn);
+            e.mov_imm(RCX, static_cast<uint64_t>(static_cast<int64_t>(instr.imm)));
+            emit_alu(e, instr.opcode, instr.rd);
+            break;
+
+        case Opcode::LDUR:
+        case Opcode::STUR:
+            e.load_guest(RSI, instr.rn);
+            e.alu_ri(0, RSI, static_cast<int32_t>(instr.imm));
+            e.mov_imm(RDX, pc);
+            if (instr.opcode == Opcode::LDUR) {
+                e.mov_imm(RCX, instr.rd);
+                e.call_helper(&JitHelpers::load64);
+            } else {
+                e.load_guest(RCX, instr.rd);
+                e.call_helper(&JitHelpers::store64);
+            }
+            break;
+
+        case Opcode::B:
+        case Opcode::BL:
+            if (instr.opcode == Opcode::BL) {
+                e.mov_imm(RAX, pc + 4);
+                e.store_guest(30, RAX);
+            }
+            e.mov_imm(RAX, pc + instr.imm);
+            e.store(PC_OFFSET, RAX);
+            break;
+
+        case Opcode::BR:
+        case Opcode::RET:
+        case Opcode::BLR:
+            e.load_guest(RAX, instr.rn);
+            if (instr.opcode == Opcode::BLR) {
+                e.mov_imm(RCX, pc + 4);
+                e.store_guest(30, RCX);
+            }
+            e.store(PC_OFFSET, RAX);
+            break;
+
+        case Opcode::CBZ:
+        case Opcode::CBNZ:
+            e.load_guest(RAX, instr.rd);
+            e.mov_imm(RCX, pc + 4);
+            e.mov_imm(RDX, pc + instr.imm);
+            e.test(RAX);
+            e.cmov(instr.opcode == Opcode::CBZ ? 0x4 : 0x5, RCX, RDX);  // cmovz / cmovnz
+            e.store(PC_OFFSET, RCX);
+            break;
+
+        // Vector operations call their kernel with pointers to the registers
+        case Opcode::VADD:
+        case Opcode::VSUB:
+        case Opcode::VMUL:
+        case Opcode::VAND:
+        case Opcode::VORR:
+        case Opcode::VEOR:
+        case Opcode::FADD:
+        case Opcode::FSUB:
+        case Opcode::FMUL:
+        case Opcode::TBL:
+        case Opcode::EXT:
+            e.lea(RDI, vector_disp(instr.rd));
+            e.lea(RSI, vector_disp(instr.rn));
+            e.lea(RDX, vector_disp(instr.rm));
+            if (instr.opcode == Opcode::EXT) {
+                e.mov_imm(RCX, static_cast<uint64_t>(instr.imm));
+                e.call(kernels.ext);
+            } else {
+                e.call(kernels.binary[vector_op(instr.opcode)][instr.esize]);
+            }
+            break;
+
+        case Opcode::ADDV:
+        case Opcode::UMAXV:
+        case Opcode::UMINV:
+            e.lea(RDI, vector_disp(instr.rd));
+            e.lea(RSI, vector_disp(instr.rn));
+            e.call(kernels.reduce[vector_reduction(instr.opcode)][instr.esize]);
+            break;
+
+        case Opcode::DUP:
+            e.lea(RDI, vector_disp(instr.rd));
+            e.load_guest(RSI, instr.rn);
+            e.call(kernels.dup[instr.esize]);
+            break;
+
+        case Opcode::UMOV:
+            e.load_element(RAX, vector_disp(instr.rn) + static_cast<int32_t>(instr.imm << instr.esize),
+                           instr.esize);
+            e.store_guest(instr.rd, RAX);
+            break;
+
+        default:
+            // mov rsi, instr; mov rdx, pc; call fallback
+            e.mov_imm(RSI, reinterpret_cast<uintptr_t>(&instr));
+            e.mov_imm(RDX, pc);
+            e.call_helper(&JitHelpers::fallback);
+            break;
+    }
+}
+
+size_t page_size() {
+    static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+} // namespace
+
+JitCompiler::JitCompiler() {
+    void* mem = mmap(nullptr, ARENA_SIZE, PROT_READ | PROT_EXEC,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem != MAP_FAILED) {
+        arena = static_cast<uint8_t*>(mem);
+    }
+}
+
+JitCompiler::~JitCompiler() {
+    if (arena) {
+        munmap(arena, ARENA_SIZE);
+    }
+}
+
+JitFunction JitCompiler::compile(const BasicBlock& block) {
+    if (!arena) return nullptr;
+
+    Emitter e;
+    e.prologue();
+    uint64_t pc = block.start_pc;
+    for (const auto& insn : block.instructions) {
+        emit_instruction(e, insn.instr, pc);
+        pc += 4;
+    }
+    if (!block.instructions.back().instr.is_branch()) {
+        // Block was cut at the length limit or before an unreadable word
+        e.mov_imm(RAX, block.end_pc);
+        e.store(PC_OFFSET, RAX);
+    }
+    e.epilogue();
+
+    if (used + e.code.size() > ARENA_SIZE) return nullptr;
+
+    // Keep the arena W^X: open only the pages being written
+    uintptr_t begin = reinterpret_cast<uintptr_t>(arena + used) & ~(page_size() - 1);
+    uintptr_t end = reinterpret_cast<uintptr_t>(arena + used + e.code.size());
+    size_t length = end - begin;
+    if (mprotect(reinterpret_cast<void*>(begin), length, PROT_READ | PROT_WRITE) != 0) {
+        return nullptr;
+    }
+    uint8_t* code = arena + used;
+    std::memcpy(code, e.code.data(), e.code.size());
+    mprotect(reinterpret_cast<void*>(begin), length, PROT_READ | PROT_EXEC);
+
+    // Keep entry points 16-byte aligned
+    used += (e.code.size() + 15) & ~size_t{15};
+    return reinterpret_cast<JitFunction>(code);
+}
+
+#else
+
+JitCompiler::JitCompiler() = default;
+JitCompiler::~JitCompiler() = default;
+
+JitFunction JitCompiler::compile(const BasicBlock&) {
+    return nullptr;
+}
+
+#endif
+
+} // namespace arm_emulator
\ No newline at end of file
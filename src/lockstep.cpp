@@ -0,0 +1,558 @@
+#include "lockstep.hpp"
+#include "decoder.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define ARM_EMULATOR_X86_KERNELS 1
+#include <immintrin.h>
+#define ARM_EMULATOR_TARGET_AVX2 __attribute__((target("avx2")))
+#define ARM_EMULATOR_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+
+namespace arm_emulator {
+
+namespace {
+
+enum class AluOp { Add, Sub, And, Orr, Eor };
+constexpr size_t ALU_OPS = 5;
+
+// dst[i] = a[i] op (b[i] << shift), and dst[i] = a[i] op imm, over n lanes.
+// n is always a multiple of the widest vector, so there are no tails.
+using AluKernel = void (*)(uint64_t* dst, const uint64_t* a, const uint64_t* b,
+                           unsigned shift, size_t n);
+using AluImmKernel = void (*)(uint64_t* dst, const uint64_t* a, uint64_t imm, size_t n);
+
+struct KernelTable {
+    AluKernel alu[ALU_OPS];
+    AluImmKernel alu_imm[ALU_OPS];
+};
+
+// Lanes per column group; the register file stride is a multiple of this
+constexpr size_t MAX_VECTOR_LANES = 8;
+
+template <AluOp OP>
+uint64_t apply(uint64_t x, uint64_t y) {
+    if constexpr (OP == AluOp::Add) return x + y;
+    if constexpr (OP == AluOp::Sub) return x - y;
+    if constexpr (OP == AluOp::And) return x & y;
+    if constexpr (OP == AluOp::Orr) return x | y;
+    if constexpr (OP == AluOp::Eor) return x ^ y;
+}
+
+template <AluOp OP>
+void scalar_alu(uint64_t* dst, const uint64_t* a, const uint64_t* b, unsigned shift, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = apply<OP>(a[i], b[i] << shift);
+    }
+}
+
+template <AluOp OP>
+void scalar_alu_imm(uint64_t* dst, const uint64_t* a, uint64_t imm, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = apply<OP>(a[i], imm);
+    }
+}
+
+constexpr KernelTable scalar_kernels = {
+    {scalar_alu<AluOp::Add>, scalar_alu<AluOp::Sub>, scalar_alu<AluOp::And>,
+     scalar_alu<AluOp::Orr>, scalar_alu<AluOp::Eor>},
+    {scalar_alu_imm<AluOp::Add>, scalar_alu_imm<AluOp::Sub>, scalar_alu_imm<AluOp::And>,
+     scalar_alu_imm<AluOp::Orr>, scalar_alu_imm<AluOp::Eor>},
+};
+
+#ifdef ARM_EMULATOR_X86_KERNELS
+
+template <AluOp OP>
+ARM_EMULATOR_TARGET_AVX2 inline __m256i apply_avx2(__m256i x, __m256i y) {
+    if constexpr (OP == AluOp::Add) return _mm256_add_epi64(x, y);
+    if constexpr (OP == AluOp::Sub) return _mm256_sub_epi64(x, y);
+    if constexpr (OP == AluOp::And) return _mm256_and_si256(x, y);
+    if constexpr (OP == AluOp::Orr) return _mm256_or_si256(x, y);
+    if constexpr (OP == AluOp::Eor) return _mm256_xor_si256(x, y);
+}
+
+template <AluOp OP>
+ARM_EMULATOR_TARGET_AVX2 void avx2_alu(uint64_t* dst, const uint64_t* a, const uint64_t* b,
+                                       unsigned shift, size_t n) {
+    __m128i count = _mm_cvtsi32_si128(static_cast<int>(shift));
+    for (size_t i = 0; i < n; i += 4) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i y = _mm256_sll_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)), count);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), apply_avx2<OP>(x, y));
+    }
+}
+
+template <AluOp OP>
+ARM_EMULATOR_TARGET_AVX2 void avx2_alu_imm(uint64_t* dst, const uint64_t* a, uint64_t imm, size_t n) {
+    __m256i y = _mm256_set1_epi64x(static_cast<long long>(imm));
+    for (size_t i = 0; i < n; i += 4) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), apply_avx2<OP>(x, y));
+    }
+}
+
+template <AluOp OP>
+ARM_EMULATOR_TARGET_AVX512 inline __m512i apply_avx512(__m512i x, __m512i y) {
+    if constexpr (OP == AluOp::Add) return _mm512_add_epi64(x, y);
+    if constexpr (OP == AluOp::Sub) return _mm512_sub_epi64(x, y);
+    if constexpr (OP == AluOp::And) return _mm512_and_si512(x, y);
+    if constexpr (OP == AluOp::Orr) return _mm512_or_si512(x, y);
+    if constexpr (OP == AluOp::Eor) return _mm512_xor_si512(x, y);
+}
+
+template <AluOp OP>
+ARM_EMULATOR_TARGET_AVX512 void avx512_alu(uint64_t* dst, const uint64_t* a, const uint64_t* b,
+                                           unsigned shift, size_t n) {
+    // The zero-masking form with every lane selected: GCC 12 warns about the
+    // undefined merge source of _mm512_sll_epi64 in optimized builds
+    __m128i count = _mm_cvtsi32_si128(static_cast<int>(shift));
+    for (size_t i = 0; i < n; i += 8) {
+        __m512i x = _mm512_loadu_si512(a + i);
+        __m512i y = _mm512_maskz_sll_epi64(0xFF, _mm512_loadu_si512(b + i), count);
+        _mm512_storeu_si512(dst + i, apply_avx512<OP>(x, y));
+    }
+}
+
+template <AluOp OP>
+ARM_EMULATOR_TARGET_AVX512 void avx512_alu_imm(uint64_t* dst, const uint64_t* a, uint64_t imm, size_t n) {
+    __m512i y = _mm512_set1_epi64(static_cast<long long>(imm));
+    for (size_t i = 0; i < n; i += 8) {
+        __m512i x = _mm512_loadu_si512(a + i);
+        _mm512_storeu_si512(dst + i, apply_avx512<OP>(x, y));
+    }
+}
+
+constexpr KernelTable avx2_kernels = {
+    {avx2_alu<AluOp::Add>, avx2_alu<AluOp::Sub>, avx2_alu<AluOp::And>,
+     avx2_alu<AluOp::Orr>, avx2_alu<AluOp::Eor>},
+    {avx2_alu_imm<AluOp::Add>, avx2_alu_imm<AluOp::Sub>, avx2_alu_imm<AluOp::And>,
+     avx2_alu_imm<AluOp::Orr>, avx2_alu_imm<AluOp::Eor>},
+};
+
+constexpr KernelTable avx512_kernels = {
+    {avx512_alu<AluOp::Add>, avx512_alu<AluOp::Sub>, avx512_alu<AluOp::And>,
+     avx512_alu<AluOp::Orr>, avx512_alu<AluOp::Eor>},
+    {avx512_alu_imm<AluOp::Add>, avx512_alu_imm<AluOp::Sub>, avx512_alu_imm<AluOp::And>,
+     avx512_alu_imm<AluOp::Orr>, avx512_alu_imm<AluOp::Eor>},
+};
+
+#endif
+
+bool is_supported(LockstepEngine::Kernel kernel) noexcept {
+    switch (kernel) {
+        case LockstepEngine::Kernel::Scalar:
+            return true;
+#ifdef ARM_EMULATOR_X86_KERNELS
+        case LockstepEngine::Kernel::AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+        case LockstepEngine::Kernel::AVX512:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return false;
+    }
+}
+
+const KernelTable& kernels_for(LockstepEngine::Kernel kernel) noexcept {
+    switch (kernel) {
+#ifdef ARM_EMULATOR_X86_KERNELS
+        case LockstepEngine::Kernel::AVX2: return avx2_kernels;
+        case LockstepEngine::Kernel::AVX512: return avx512_kernels;
+#endif
+        default: return scalar_kernels;
+    }
+}
+
+// ALU operation of a data-processing opcode
+AluOp alu_op(Opcode opcode) noexcept {
+    switch (opcode) {
+        case Opcode::SUB: case Opcode::SUBI: return AluOp::Sub;
+        case Opcode::AND: case Opcode::ANDI: return AluOp::And;
+        case Opcode::ORR: case Opcode::ORRI: return AluOp::Orr;
+        case Opcode::EOR: case Opcode::EORI: return AluOp::Eor;
+        default: return AluOp::Add;
+    }
+}
+
+constexpr size_t XZR = static_cast<size_t>(SpecialRegister::XZR);
+
+// Adds a listener to the code-write callback of every lane's memory while in
+// lockstep; the lane's own CPU still sees each write first
+class CodeWriteHooks {
+public:
+    using Callback = std::function<void(uint64_t, size_t)>;
+
+    CodeWriteHooks(std::vector<std::unique_ptr<CPU>>& lanes_ref, const Callback& listener)
+        : lanes(lanes_ref) {
+        saved.reserve(lanes.size());
+        for (auto& lane : lanes) {
+            Memory& memory = lane->get_memory();
+            saved.push_back(memory.get_code_write_callback());
+            memory.set_code_write_callback([previous = saved.back(), listener](uint64_t address, size_t size) {
+                if (previous) previous(address, size);
+                listener(address, size);
+            });
+        }
+    }
+    ~CodeWriteHooks() { restore(); }
+
+    CodeWriteHooks(const CodeWriteHooks&) = delete;
+    CodeWriteHooks& operator=(const CodeWriteHooks&) = delete;
+
+    void restore() {
+        for (size_t i = 0; i < saved.size(); ++i) {
+            lanes[i]->get_memory().set_code_write_callback(std::move(saved[i]));
+        }
+        saved.clear();
+    }
+
+private:
+    std::vector<std::unique_ptr<CPU>>& lanes;
+    std::vector<Callback> saved;
+};
+
+} // namespace
+
+LockstepEngine::Kernel LockstepEngine::best_kernel() noexcept {
+    if (is_supported(Kernel::AVX512)) return Kernel::AVX512;
+    if (is_supported(Kernel::AVX2)) return Kernel::AVX2;
+    return Kernel::Scalar;
+}
+
+const char* LockstepEngine::to_string(Kernel kernel) noexcept {
+    switch (kernel) {
+        case Kernel::Scalar: return "scalar";
+        case Kernel::AVX2: return "avx2";
+        case Kernel::AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+LockstepEngine::LockstepEngine(size_t lane_count, ExecutionEngine scalar_engine,
+                               uint64_t memory_size, Kernel kernel)
+    : kernel(is_supported(kernel) ? kernel : best_kernel()) {
+    lanes.reserve(lane_count);
+    for (size_t i = 0; i < lane_count; ++i) {
+        lanes.push_back(std::make_unique<CPU>(memory_size, scalar_engine));
+    }
+    stride = (lane_count + MAX_VECTOR_LANES - 1) / MAX_VECTOR_LANES * MAX_VECTOR_LANES;
+}
+
+bool LockstepEngine::load_program_file(const std::string& path, uint64_t address) {
+    if (lanes.empty() || !lanes[0]->load_program_file(path, address)) return false;
+
+    // The other lanes share the image's pages until they write them
+    for (size_t i = 1; i < lanes.size(); ++i) {
+        lanes[i] = lanes[0]->fork();
+    }
+    return true;
+}
+
+bool LockstepEngine::load_program(const std::vector<uint8_t>& program, uint64_t address) {
+    if (lanes.empty() || !lanes[0]->load_program(program, address)) return false;
+    for (size_t i = 1; i < lanes.size(); ++i) {
+        lanes[i] = lanes[0]->fork();
+    }
+    return true;
+}
+
+void LockstepEngine::leave(size_t lane, uint64_t pc, uint64_t retired, std::vector<BatchResult>& results) {
+    Registers& registers = lanes[lane]->get_registers();
+    for (size_t r = 0; r < NUM_REGISTERS; ++r) {
+        registers.write_x(r, row(r)[lane]);
+    }
+    registers.flags() = flags[lane];
+    registers.set_pc(pc);
+    results[lane].instructions = retired;
+    scalar.push_back(lane);
+}
+
+const DecodedEntry* LockstepEngine::fetch(uint64_t pc, std::vector<BatchResult>& results,
+                                          uint64_t retired) {
+    if (const DecodedEntry* entry = decoded.lookup(pc)) return entry;
+
+    // Lanes may have rewritten their code differently; the group keeps the
+    // word the first lane sees. Lanes that see another word, or fault, leave.
+    uint32_t word = 0;
+    bool have_word = false;
+    kept.clear();
+    for (size_t lane : active) {
+        uint32_t lane_word = 0;
+        if (!lanes[lane]->get_memory().try_fetch32(pc, lane_word)) {
+            leave(lane, pc, retired, results);
+            continue;
+        }
+        if (!have_word) {
+            word = lane_word;
+            have_word = true;
+        }
+        if (lane_word == word) {
+            kept.push_back(lane);
+        } else {
+            leave(lane, pc, retired, results);
+        }
+    }
+    active.swap(kept);
+    if (active.empty()) return nullptr;
+
+    for (size_t lane : active) {
+        Memory& memory = lanes[lane]->get_memory();
+        memory.mark_code_page(pc);
+        memory.mark_code_page(pc + sizeof(uint32_t) - 1);
+    }
+    return &decoded.insert(pc, word, Decoder::decode(word));
+}
+
+void LockstepEngine::run_scalar(size_t lane, BatchResult& result, uint64_t max_instructions) {
+    CPU& cpu = *lanes[lane];
+    RunResult run = cpu.run_for(max_instructions - result.instructions);
+    result.reason = run.reason;
+    result.instructions += run.instructions;
+    result.trap = cpu.get_trap();
+}
+
+std::vector<BatchResult> LockstepEngine::run(uint64_t max_instructions) {
+    std::vector<BatchResult> results(lanes.size());
+    if (lanes.empty()) return results;
+    const KernelTable& alu = kernels_for(kernel);
+
+    // Guest memory may have changed since the last run
+    decoded.flush();
+    active.clear();
+    scalar.clear();
+
+    // Gather the lanes that start together into the register file
+    uint64_t pc = lanes[0]->get_registers().get_pc();
+    file.assign(ROWS * stride, 0);
+    flags.assign(lanes.size(), ConditionFlags{});
+    for (size_t lane = 0; lane < lanes.size(); ++lane) {
+        const Registers& registers = lanes[lane]->get_registers();
+        if (registers.get_pc() != pc || !lanes[lane]->is_running()) {
+            scalar.push_back(lane);
+            continue;
+        }
+        for (size_t r = 0; r < NUM_REGISTERS; ++r) {
+            row(r)[lane] = registers.read_x(r);
+        }
+        flags[lane] = registers.flags();
+        active.push_back(lane);
+    }
+
+    // Lanes that cannot go on in lockstep leave before the instruction at pc,
+    // and their own CPU executes it, so halts and faults behave exactly as
+    // in a scalar run
+    uint64_t retired = 0;
+    CodeWriteHooks hooks(lanes, [this](uint64_t address, size_t size) {
+        decoded.invalidate(address, size);
+    });
+    while (!active.empty() && retired < max_instructions) {
+        const DecodedEntry* fetched = fetch(pc, results, retired);
+        if (!fetched) break;
+        // A copy: a store may overwrite this very instruction and drop its entry
+        const Instruction instr = fetched->instr;
+
+        switch (instr.opcode) {
+            case Opcode::ADD:
+            case Opcode::SUB:
+            case Opcode::AND:
+            case Opcode::ORR:
+            case Opcode::EOR:
+                // Every column is computed; those of departed lanes are never read
+                if (instr.rd != XZR) {
+                    alu.alu[static_cast<size_t>(alu_op(instr.opcode))](
+                        row(instr.rd), row(instr.rn), row(instr.rm), instr.shift & 63, stride);
+                }
+                pc += 4;
+                break;
+
+            case Opcode::ADDI:
+            case Opcode::SUBI:
+            case Opcode::ANDI:
+            case Opcode::ORRI:
+            case Opcode::EORI:
+                if (instr.rd != XZR) {
+                    alu.alu_imm[static_cast<size_t>(alu_op(instr.opcode))](
+                        row(instr.rd), row(instr.rn), static_cast<uint64_t>(instr.imm), stride);
+                }
+                pc += 4;
+                break;
+
+            case Opcode::ADDS:
+            case Opcode::SUBS:
+            case Opcode::ANDS:
+            case Opcode::ADDSI:
+            case Opcode::SUBSI:
+            case Opcode::ANDSI:
+                // Each lane records its own flag operands
+                for (size_t lane : active) {
+                    uint64_t a = row(instr.rn)[lane];
+                    uint64_t b = instr.opcode == Opcode::ADDS || instr.opcode == Opcode::SUBS ||
+                                 instr.opcode == Opcode::ANDS
+                        ? row(instr.rm)[lane] << (instr.shift & 63)
+                        : static_cast<uint64_t>(instr.imm);
+                    uint64_t result = 0;
+                    if (instr.opcode == Opcode::ADDS || instr.opcode == Opcode::ADDSI) {
+                        result = a + b;
+                        flags[lane].set_add(a, b);
+                    } else if (instr.opcode == Opcode::SUBS || instr.opcode == Opcode::SUBSI) {
+                        result = a - b;
+                        flags[lane].set_sub(a, b);
+                    } else {
+                        result = a & b;
+                        flags[lane].set_logic(result);
+                    }
+                    if (instr.rd != XZR) row(instr.rd)[lane] = result;
+                }
+                pc += 4;
+                break;
+
+            case Opcode::CSEL:
+                if (instr.rd != XZR) {
+                    for (size_t lane : active) {
+                        row(instr.rd)[lane] = flags[lane].holds(instr.cond) ? row(instr.rn)[lane]
+                                                                             : row(instr.rm)[lane];
+                    }
+                }
+                pc += 4;
+                break;
+
+            case Opcode::LDUR:
+            case Opcode::STUR:
+                // Each lane has its own memory; a faulting access has no effect
+                kept.clear();
+                for (size_t lane : active) {
+                    uint64_t address = row(instr.rn)[lane] + static_cast<uint64_t>(instr.imm);
+                    Memory& memory = lanes[lane]->get_memory();
+                    if (instr.opcode == Opcode::LDUR) {
+                        uint64_t value = 0;
+                        if (!memory.try_read64(address, value)) {
+                            leave(lane, pc, retired, results);
+                            continue;
+                        }
+                        if (instr.rd != XZR) row(instr.rd)[lane] = value;
+                    } else {
+                        if (!memory.try_write64(address, row(instr.rd)[lane])) {
+                            leave(lane, pc, retired, results);
+                            continue;
+                        }
+                    }
+                    kept.push_back(lane);
+                }
+                active.swap(kept);
+                pc += 4;
+                break;
+
+            // The register file holds no vector registers; the lanes' own
+            // CPUs run SIMD code
+            case Opcode::VADD:
+            case Opcode::VSUB:
+            case Opcode::VMUL:
+            case Opcode::VAND:
+            case Opcode::VORR:
+            case Opcode::VEOR:
+            case Opcode::FADD:
+            case Opcode::FSUB:
+            case Opcode::FMUL:
+            case Opcode::EXT:
+            case Opcode::TBL:
+            case Opcode::DUP:
+            case Opcode::UMOV:
+            case Opcode::ADDV:
+            case Opcode::UMAXV:
+            case Opcode::UMINV:
+            case Opcode::LD1:
+            case Opcode::ST1:
+            case Opcode::INVALID:
+                for (size_t lane : active) {
+                    leave(lane, pc, retired, results);
+                }
+                active.clear();
+                continue;
+
+            default: {
+                // Branches: work out each lane's target and keep the most
+                // common one in lockstep
+                targets.clear();
+                for (size_t lane : active) {
+                    uint64_t target = pc + 4;
+                    switch (instr.opcode) {
+                        case Opcode::B:
+                        case Opcode::BL:
+                            target = pc + static_cast<uint64_t>(instr.imm);
+                            break;
+                        case Opcode::BR:
+                        case Opcode::BLR:
+                        case Opcode::RET:
+                            target = row(instr.rn)[lane];
+                            break;
+                        case Opcode::B_COND:
+                            if (flags[lane].holds(instr.cond)) target = pc + static_cast<uint64_t>(instr.imm);
+                            break;
+                        case Opcode::CBZ:
+                            if (row(instr.rd)[lane] == 0) target = pc + static_cast<uint64_t>(instr.imm);
+                            break;
+                        case Opcode::CBNZ:
+                            if (row(instr.rd)[lane] != 0) target = pc + static_cast<uint64_t>(instr.imm);
+                            break;
+                        default:
+                            break;
+                    }
+                    targets.emplace_back(lane, target);
+                }
+
+                uint64_t group_target = targets[0].second;
+                size_t best = 0;
+                for (const auto& candidate : targets) {
+                    if (best * 2 > targets.size()) break;
+                    size_t votes = static_cast<size_t>(std::count_if(
+                        targets.begin(), targets.end(),
+                        [&](const auto& other) { return other.second == candidate.second; }));
+                    if (votes > best) {
+                        best = votes;
+                        group_target = candidate.second;
+                    }
+                }
+
+                // A branch to itself halts, which the lanes' CPUs take care of
+                kept.clear();
+                for (const auto& [lane, target] : targets) {
+                    if (target == group_target && target != pc) {
+                        kept.push_back(lane);
+                    } else {
+                        leave(lane, pc, retired, results);
+                    }
+                }
+                active.swap(kept);
+
+                if (instr.opcode == Opcode::BL || instr.opcode == Opcode::BLR) {
+                    std::fill(row(30), row(30) + stride, pc + 4);
+                }
+                pc = group_target;
+                break;
+            }
+        }
+
+        ++retired;
+    }
+
+    // Lanes still together have used up the budget
+    for (size_t lane : active) {
+        leave(lane, pc, retired, results);
+    }
+    hooks.restore();
+
+    for (size_t lane : scalar) {
+        run_scalar(lane, results[lane], max_instructions);
+    }
+    for (size_t lane = 0; lane < lanes.size(); ++lane) {
+        results[lane].registers = lanes[lane]->get_registers();
+    }
+    return results;
+}
+
+} // namespace arm_emulator
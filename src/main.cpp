@@ -1,53 +1,203 @@
 // main.cpp
 #include "cpu.hpp"
 #include "repl.hpp"
-#include <iostream>
+#include "batch_runner.hpp"
+#include "branch_predictor.hpp"
+#include "cache_model.hpp"
+#include "lockstep.hpp"
+#include "profiler.hpp"
+#include "symbol_table.hpp"
+#include "trace.hpp"
+#include <filesystem>
 #include <fstream>
-#include <vector>
+#include <iostream>
+#include <sstream>
 #include <string>
+#include <vector>
 
-namespace arm_emulator {
+namespace {
 
-std::vector<uint8_t> read_binary_file(const std::string& filename) {
-    std::ifstream file(filename, std::ios::binary | std::ios::ate);
-    if (!file) {
-        throw std::runtime_error("Failed to open file: " + filename);
+void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [program [load_address]] [options]\n"
+              << "       " << program << " --batch <jobs> [--threads <n>]\n"
+              << "       " << program << " program [load_address] --lockstep <lanes>\n"
+              << "Options:\n"
+              << "  --load-snapshot <file>         Start from a saved snapshot\n"
+              << "  --save-snapshot <file> <addr>  Run until PC reaches addr, save a\n"
+              << "                                 snapshot and exit\n"
+              << "  --batch <jobs>                 Run every job in the file (one per line:\n"
+              << "                                 image [load_address] [max=N] [Xn|SP|PC|NZCV=value ...])\n"
+              << "                                 in parallel and print the final states\n"
+              << "  --threads <n>                  Worker threads for --batch (default: all)\n"
+              << "  --lockstep <lanes>             Run the program once per lane, with X0 set\n"
+              << "                                 to the lane number, using SIMD lockstep\n"
+              << "                                 execution, and print the final states\n"
+              << "  --profile <period>             Run the program, sampling the PC every\n"
+              << "                                 period instructions, print a profile and exit\n"
+              << "  --profile-out <file>           Also write collapsed stacks for flame graphs\n"
+              << "  --trace <file>                 Record every instruction executed to a\n"
+              << "                                 binary trace (read it with arm_trace)\n"
+              << "  --cache <spec>                 Simulate L1I/L1D/L2 caches on the executed\n"
+              << "                                 code and report hit rates; spec is \"default\"\n"
+              << "                                 or e.g. l1d=64k:8:64:lru,l2=2m:16:64,region=64k\n"
+              << "  --branch-predictor <list>      Model branch prediction with each predictor in\n"
+              << "                                 the comma-separated list (bimodal[:bits],\n"
+              << "                                 gshare[:bits[:history]], tage) and report\n"
+              << "                                 mispredict rates\n";
+}
+
+int run_batch(const std::string& path, unsigned threads) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Failed to open job file: " << path << "\n";
+        return 1;
     }
     
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
+    auto jobs = arm_emulator::read_batch_jobs(in);
+    arm_emulator::BatchRunner runner(threads);
+    auto results = runner.run(jobs);
+    arm_emulator::write_batch_results(std::cout, jobs, results);
+    return 0;
+}
+
+int run_profile(arm_emulator::CPU& cpu, const arm_emulator::SymbolTable& symbols,
+                uint64_t period, const std::string& collapsed_path) {
+    arm_emulator::Profiler profiler(period, symbols);
+    arm_emulator::RunResult result = profiler.run(cpu);
+    std::cout << "Stopped (" << arm_emulator::to_string(result.reason) << ") after "
+              << result.instructions << " instructions\n";
+    if (cpu.get_trap()) {
+        std::cerr << cpu.get_trap().to_string() << "\n";
+    }
+    profiler.write_flat(std::cout);
     
-    std::vector<uint8_t> buffer(size);
-    if (!file.read(reinterpret_cast<char*>(buffer.data()), size)) {
-        throw std::runtime_error("Failed to read file: " + filename);
+    if (!collapsed_path.empty()) {
+        std::ofstream out(collapsed_path);
+        if (!out) {
+            std::cerr << "Failed to open " << collapsed_path << "\n";
+            return 1;
+        }
+        profiler.write_collapsed(out);
+    }
+    return 0;
+}
+
+int run_lockstep(const std::string& path, uint64_t load_address, size_t lane_count) {
+    arm_emulator::LockstepEngine engine(lane_count);
+    if (!engine.load_program_file(path, load_address)) {
+        return 1;
+    }
+    for (size_t lane = 0; lane < lane_count; ++lane) {
+        engine.lane(lane).get_registers().set_register(0, lane);
     }
     
-    return buffer;
+    auto results = engine.run();
+    std::vector<arm_emulator::BatchJob> jobs(lane_count);
+    for (auto& job : jobs) {
+        job.image = path;
+    }
+    arm_emulator::write_batch_results(std::cout, jobs, results);
+    return 0;
 }
 
-} // namespace arm_emulator
+} // namespace
 
 int main(int argc, char* argv[]) {
     try {
         arm_emulator::CPU cpu;
-        
-        // If a filename was provided, load it into memory
-        if (argc > 1) {
+
+        std::vector<std::string> positional;
+        std::string load_snapshot;
+        std::string save_snapshot;
+        uint64_t save_address = 0;
+        std::string batch;
+        unsigned threads = 0;
+        size_t lockstep_lanes = 0;
+        uint64_t profile_period = 0;
+        std::string profile_out;
+        std::string trace_path;
+        std::string cache_spec;
+        std::string branch_spec;
+        arm_emulator::SymbolTable symbols;
+
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--load-snapshot" && i + 1 < argc) {
+                load_snapshot = argv[++i];
+            } else if (arg == "--save-snapshot" && i + 2 < argc) {
+                save_snapshot = argv[++i];
+                save_address = std::stoull(argv[++i], nullptr, 0);
+            } else if (arg == "--batch" && i + 1 < argc) {
+                batch = argv[++i];
+            } else if (arg == "--threads" && i + 1 < argc) {
+                threads = static_cast<unsigned>(std::stoul(argv[++i]));
+            } else if (arg == "--lockstep" && i + 1 < argc) {
+                lockstep_lanes = std::stoull(argv[++i]);
+                if (lockstep_lanes == 0) {
+                    print_usage(argv[0]);
+                    return 1;
+                }
+            } else if (arg == "--profile" && i + 1 < argc) {
+                profile_period = std::stoull(argv[++i], nullptr, 0);
+            } else if (arg == "--profile-out" && i + 1 < argc) {
+                profile_out = argv[++i];
+            } else if (arg == "--trace" && i + 1 < argc) {
+                trace_path = argv[++i];
+            } else if (arg == "--cache" && i + 1 < argc) {
+                cache_spec = argv[++i];
+            } else if (arg == "--branch-predictor" && i + 1 < argc) {
+                branch_spec = argv[++i];
+            } else if (arg.rfind("--", 0) == 0) {
+                print_usage(argv[0]);
+                return 1;
+            } else {
+                positional.push_back(arg);
+            }
+        }
+
+        if (!batch.empty()) {
+            return run_batch(batch, threads);
+        }
+
+        if (lockstep_lanes > 0) {
+            // Every lane starts from the program image, not from a snapshot
+            if (positional.empty() || !load_snapshot.empty()) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            uint64_t load_address = positional.size() > 1 ? std::stoull(positional[1], nullptr, 0) : 0x400000;
+            return run_lockstep(positional[0], load_address, lockstep_lanes);
+        }
+
+        if (!load_snapshot.empty()) {
+            if (!cpu.load_snapshot(load_snapshot)) {
+                return 1;
+            }
+            std::cout << "Restored snapshot at 0x" << std::hex << cpu.get_registers().get_pc()
+                      << std::dec << "\n";
+        } else if (!positional.empty()) {
+            // If a filename was provided, load it into memory
             try {
-                auto program = arm_emulator::read_binary_file(argv[1]);
                 uint64_t load_address = 0x400000;  // Default load address
-                
-                if (argc > 2) {
-                    load_address = std::stoull(argv[2], nullptr, 0);
+
+                if (positional.size() > 1) {
+                    load_address = std::stoull(positional[1], nullptr, 0);
                 }
-                
-                if (!cpu.load_program(program, load_address)) {
+
+                // The image is mapped, not copied, into guest memory; ELF
+                // executables choose their own addresses and entry point
+                if (!cpu.load_program_file(positional[0], load_address)) {
                     std::cerr << "Failed to load program\n";
                     return 1;
                 }
+
+                std::cout << "Loaded program at 0x" << std::hex << cpu.get_registers().get_pc()
+                          << std::dec << " (" << std::filesystem::file_size(positional[0]) << " bytes)\n";
                 
-                std::cout << "Loaded program at 0x" << std::hex << load_address 
-                          << " (" << program.size() << " bytes)\n";
+                symbols = arm_emulator::SymbolTable::from_file(positional[0]);
+                if (!symbols.empty()) {
+                    std::cout << "Read " << symbols.size() << " symbols\n";
+                }
             } catch (const std::exception& e) {
                 std::cerr << "Error: " << e.what() << "\n";
                 return 1;
@@ -55,15 +205,94 @@ int main(int argc, char* argv[]) {
         } else {
             std::cout << "No program loaded. Use the REPL to enter instructions.\n";
         }
-        
+
+        // Everything executed from here on is traced
+        std::unique_ptr<arm_emulator::TraceWriter> trace;
+        if (!trace_path.empty()) {
+            trace = std::make_unique<arm_emulator::TraceWriter>(trace_path);
+            cpu.add_observer(trace.get());
+        }
+
+        std::unique_ptr<arm_emulator::CacheHierarchy> cache_model;
+        if (!cache_spec.empty()) {
+            cache_model = std::make_unique<arm_emulator::CacheHierarchy>(
+                arm_emulator::CacheHierarchy::Config::parse(cache_spec));
+            cpu.add_observer(cache_model.get());
+        }
+
+        std::vector<std::unique_ptr<arm_emulator::BranchModel>> branch_models;
+        if (!branch_spec.empty()) {
+            std::istringstream specs(branch_spec);
+            for (std::string spec; std::getline(specs, spec, ',');) {
+                branch_models.push_back(std::make_unique<arm_emulator::BranchModel>(
+                    arm_emulator::BranchPredictor::create(spec)));
+                cpu.add_observer(branch_models.back().get());
+            }
+        }
+        auto report_branches = [&] {
+            for (const auto& model : branch_models) {
+                std::cout << "\n";
+                model->write_report(std::cout, symbols);
+            }
+        };
+
+        // Run the initialization code once and keep the warm state on disk
+        if (!save_snapshot.empty()) {
+            arm_emulator::RunResult result = cpu.run_until(save_address);
+            if (result.reason != arm_emulator::StopReason::AddressReached) {
+                std::cerr << "Program stopped at 0x" << std::hex << cpu.get_registers().get_pc()
+                          << " before reaching 0x" << save_address << std::dec;
+                if (cpu.get_trap()) {
+                    std::cerr << ": " << cpu.get_trap().to_string();
+                }
+                std::cerr << "\n";
+                return 1;
+            }
+            if (!cpu.save_snapshot(save_snapshot)) {
+                return 1;
+            }
+            std::cout << "Saved snapshot at 0x" << std::hex << save_address << std::dec
+                      << " to " << save_snapshot << "\n";
+            return 0;
+        }
+
+        if (profile_period > 0) {
+            int status = run_profile(cpu, symbols, profile_period, profile_out);
+            if (cache_model) {
+                std::cout << "\n";
+                cache_model->write_report(std::cout, symbols);
+            }
+            report_branches();
+            return status;
+        }
+
         // Start the REPL
         arm_emulator::REPL repl(cpu);
+        repl.set_symbols(symbols);
+        repl.set_cache_model(cache_model.get());
+        std::vector<const arm_emulator::BranchModel*> models;
+        for (const auto& model : branch_models) {
+            models.push_back(model.get());
+        }
+        repl.set_branch_models(models);
         repl.run();
-        
+
+        if (cache_model) {
+            cache_model->write_report(std::cout, symbols);
+        }
+        report_branches();
+
+        if (trace) {
+            cpu.remove_observer(trace.get());
+            trace->close();
+            std::cout << "Traced " << trace->record_count() << " instructions to "
+                      << trace_path << "\n";
+        }
+
     } catch (const std::exception& e) {
         std::cerr << "Fatal error: " << e.what() << "\n";
         return 1;
     }
-    
+
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,69 @@
+#include "mapped_file.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ARM_EMULATOR_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace arm_emulator {
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& path) {
+    std::shared_ptr<MappedFile> file(new MappedFile());
+
+#ifdef ARM_EMULATOR_HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Failed to read file: " + path);
+    }
+
+    file->length = static_cast<size_t>(st.st_size);
+    if (file->length > 0) {
+        // Private and writable: guest stores trigger copy-on-write in the kernel
+        void* mem = mmap(nullptr, file->length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (mem == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("Failed to map file: " + path);
+        }
+        file->base = static_cast<uint8_t*>(mem);
+        file->mapped = true;
+    }
+    ::close(fd);
+#else
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+    std::streamsize size = in.tellg();
+    in.seekg(0, std::ios::beg);
+    file->fallback.resize(static_cast<size_t>(size));
+    if (!in.read(reinterpret_cast<char*>(file->fallback.data()), size)) {
+        throw std::runtime_error("Failed to read file: " + path);
+    }
+    file->base = file->fallback.data();
+    file->length = file->fallback.size();
+#endif
+
+    return file;
+}
+
+MappedFile::~MappedFile() {
+#ifdef ARM_EMULATOR_HAVE_MMAP
+    if (mapped) {
+        munmap(base, length);
+    }
+#endif
+}
+
+} // namespace arm_emulator
\ No newline at end of file
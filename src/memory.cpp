@@ -1,101 +1,538 @@
 #include "memory.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
 #include <sstream>
 #include <iomanip>
+#include <set>
 #include <stdexcept>
 
 namespace arm_emulator {
 
-Memory::Memory(size_t size) : memory(size, 0) {
+namespace {
+
+// Backing for reads of pages that have never been written
+const uint8_t zero_page[Memory::PAGE_SIZE] = {};
+
+std::shared_ptr<uint8_t> allocate_page() {
+    return std::shared_ptr<uint8_t>(new uint8_t[Memory::PAGE_SIZE](), std::default_delete<uint8_t[]>());
+}
+
+} // namespace
+
+Memory::Memory(uint64_t size) : limit(size) {
     if (size == 0) {
         throw std::invalid_argument("Memory size must be greater than 0");
     }
 }
 
 void Memory::reset() noexcept {
-    std::fill(memory.begin(), memory.end(), 0);
+    pages.clear();
+    base.reset();
+    lazy_regions.reset();
+    code_pages.clear();
+    flush_tlb();
+    if (on_code_write) {
+        on_code_write(0, limit);
+    }
 }
 
 void Memory::check_address(uint64_t address, size_t size) const {
-    if (address + size > memory.size() || address + size < address) {
-        throw std::runtime_error("Memory access out of bounds: 0x" + 
-                               std::to_string(address) + " + " + 
-                               std::to_string(size));
+    if (!contains(address, size)) {
+        throw_out_of_bounds(address, size);
     }
 }
 
-uint8_t Memory::read8(uint64_t address) const {
-    check_address(address, sizeof(uint8_t));
-    return memory[address];
+void Memory::throw_out_of_bounds(uint64_t address, size_t size) {
+    throw std::runtime_error("Memory access out of bounds: 0x" +
+                           std::to_string(address) + " + " +
+                           std::to_string(size));
 }
 
-uint32_t Memory::read32(uint64_t address) const {
-    check_address(address, sizeof(uint32_t));
-    uint32_t value = 0;
-    for (size_t i = 0; i < sizeof(uint32_t); ++i) {
-        value |= static_cast<uint32_t>(memory[address + i]) << (i * 8);
+const Memory::Page* Memory::find_layered(uint64_t page) const {
+    auto it = pages.find(page);
+    if (it != pages.end()) return &it->second;
+    for (const PageLayer* layer = base.get(); layer; layer = layer->parent.get()) {
+        auto frozen = layer->pages.find(page);
+        if (frozen != layer->pages.end()) return &frozen->second;
     }
-    return value;
+    return nullptr;
+}
+
+const uint8_t* Memory::find_page(uint64_t page) const {
+    const Page* entry = find_layered(page);
+    if (entry && entry->data) return entry->data.get();
+    return lazy_regions ? populate_lazy(page) : nullptr;
 }
 
-uint64_t Memory::read64(uint64_t address) const {
-    check_address(address, sizeof(uint64_t));
-    uint64_t value = 0;
-    for (size_t i = 0; i < sizeof(uint64_t); ++i) {
-        value |= static_cast<uint64_t>(memory[address + i]) << (i * 8);
+Memory::LazyCover Memory::lazy_cover(uint64_t page) const {
+    uint64_t page_start = page << PAGE_SHIFT;
+    uint64_t page_end = page_start + PAGE_SIZE;
+    
+    // Regions start before the page's end; walk back to those that overlap it
+    LazyCover covering;
+    if (!lazy_regions) return covering;
+    auto it = lazy_regions->lower_bound(page_end);
+    while (it != lazy_regions->begin()) {
+        --it;
+        if (it->second.end <= page_start) {
+            break;  // Regions do not overlap each other, so nothing earlier can reach
+        }
+        covering.emplace_back(it->first, &it->second);
+    }
+    return covering;
+}
+
+uint8_t* Memory::lazy_alias(uint64_t page, const LazyCover& cover) {
+    if (cover.size() != 1) return nullptr;
+    uint64_t page_start = page << PAGE_SHIFT;
+    uint64_t start = cover[0].first;
+    const LazyRegion& region = *cover[0].second;
+    uint64_t file_offset = region.offset + (page_start - start);
+    if (page_start >= start && page_start + PAGE_SIZE <= start + region.file_size &&
+        (file_offset & PAGE_MASK) == 0) {
+        return region.file->data() + file_offset;
     }
-    return value;
+    return nullptr;
 }
 
-void Memory::write8(uint64_t address, uint8_t value) {
-    check_address(address, sizeof(uint8_t));
-    memory[address] = value;
+void Memory::fill_lazy(uint64_t page, const LazyCover& cover, uint8_t* data) {
+    uint64_t page_start = page << PAGE_SHIFT;
+    uint64_t page_end = page_start + PAGE_SIZE;
+    std::memset(data, 0, PAGE_SIZE);
+    for (const auto& [start, region] : cover) {
+        uint64_t data_end = std::min(start + region->file_size, page_end);
+        for (uint64_t addr = std::max(start, page_start); addr < data_end; ++addr) {
+            data[addr - page_start] = region->file->data()[region->offset + (addr - start)];
+        }
+    }
 }
 
-void Memory::write32(uint64_t address, uint32_t value) {
-    check_address(address, sizeof(uint32_t));
-    for (size_t i = 0; i < sizeof(uint32_t); ++i) {
-        memory[address + i] = static_cast<uint8_t>(value >> (i * 8));
+const uint8_t* Memory::populate_lazy(uint64_t page) const {
+    LazyCover covering = lazy_cover(page);
+    if (covering.empty()) return nullptr;
+    
+    Page& entry = pages[page];
+    
+    // A page lying wholly in one region's file data can alias the mapping
+    if (uint8_t* alias = lazy_alias(page, covering)) {
+        const LazyRegion& region = *covering[0].second;
+        entry = Page{std::shared_ptr<uint8_t>(region.file, alias), false};
+        return entry.data.get();
+    }
+    
+    // Otherwise copy the file-backed parts of every region into a zeroed page
+    entry = Page{allocate_page(), true};
+    fill_lazy(page, covering, entry.data.get());
+    return entry.data.get();
+}
+
+uint8_t* Memory::get_page(uint64_t page) {
+    auto it = pages.find(page);
+    if (it != pages.end() && it->second.owned) return it->second.data.get();
+    
+    // Copy shared contents (a frozen layer or a file) into a private page
+    const uint8_t* source = find_page(page);
+    Page& entry = pages[page];
+    if (entry.owned) return entry.data.get();  // populate_lazy made a private copy
+    
+    std::shared_ptr<uint8_t> data = allocate_page();
+    if (source) {
+        std::memcpy(data.get(), source, PAGE_SIZE);
+    }
+    entry = Page{std::move(data), true};
+    // The read TLB may still map this page to the shared or zero page
+    evict_tlb(page);
+    return entry.data.get();
+}
+
+void Memory::install_page(uint64_t page, std::shared_ptr<uint8_t> data) {
+    pages[page] = Page{std::move(data), false};
+    evict_tlb(page);
+}
+
+void Memory::evict_tlb(uint64_t page) noexcept {
+    TlbEntry& read_entry = read_tlb[tlb_index(page)];
+    if (read_entry.tag == page) read_entry = TlbEntry{};
+    TlbEntry& write_entry = write_tlb[tlb_index(page)];
+    if (write_entry.tag == page) write_entry = TlbEntry{};
+}
+
+void Memory::flush_tlb() noexcept {
+    read_tlb.fill(TlbEntry{});
+    write_tlb.fill(TlbEntry{});
+}
+
+bool Memory::read_slow(uint64_t address, size_t size, bool watched, uint64_t& value) const {
+    uint8_t bytes[sizeof(uint64_t)];
+    if (!read_bytes_slow(address, size, watched, bytes)) return false;
+    value = 0;
+    for (size_t i = 0; i < size; ++i) {
+        value |= static_cast<uint64_t>(bytes[i]) << (i * 8);
+    }
+    return true;
+}
+
+bool Memory::write_slow(uint64_t address, uint64_t value, size_t size) {
+    uint8_t bytes[sizeof(uint64_t)];
+    for (size_t i = 0; i < size; ++i) {
+        bytes[i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+    return write_bytes_slow(address, bytes, size);
+}
+
+bool Memory::read_bytes_slow(uint64_t address, size_t size, bool watched, uint8_t* bytes) const {
+    if (!contains(address, size)) return false;
+    if (watched && !read_watch_pages.empty()) {
+        check_watch(address, size, false);
+    }
+
+    for (size_t i = 0; i < size; ++i) {
+        uint64_t page = (address + i) >> PAGE_SHIFT;
+        const uint8_t* host = find_page(page);
+        if (!host) host = zero_page;
+
+        // Only pages lying wholly inside the address space go into the TLB
+        if (((page + 1) << PAGE_SHIFT) <= limit &&
+            (read_watch_pages.empty() || read_watch_pages.count(page) == 0)) {
+            read_tlb[tlb_index(page)] = TlbEntry{page, const_cast<uint8_t*>(host)};
+        }
+        bytes[i] = host[(address + i) & PAGE_MASK];
+    }
+    return true;
+}
+
+bool Memory::write_bytes_slow(uint64_t address, const uint8_t* bytes, size_t size) {
+    if (!contains(address, size)) return false;
+    if (!write_watch_pages.empty()) {
+        check_watch(address, size, true);
+    }
+    check_code_write(address, size);
+
+    for (size_t i = 0; i < size; ++i) {
+        uint64_t page = (address + i) >> PAGE_SHIFT;
+        uint8_t* host = get_page(page);
+        if (code_pages.count(page) == 0 && ((page + 1) << PAGE_SHIFT) <= limit &&
+            (write_watch_pages.empty() || write_watch_pages.count(page) == 0)) {
+            write_tlb[tlb_index(page)] = TlbEntry{page, host};
+            if (read_watch_pages.empty() || read_watch_pages.count(page) == 0) {
+                read_tlb[tlb_index(page)] = TlbEntry{page, host};
+            }
+        }
+        host[(address + i) & PAGE_MASK] = bytes[i];
+    }
+    return true;
+}
+
+void Memory::mark_code_page(uint64_t address) {
+    if (address >= limit) return;
+    uint64_t page = address >> PAGE_SHIFT;
+    if (code_pages.insert(page).second) {
+        // Writes to this page must now take the slow path
+        TlbEntry& write_entry = write_tlb[tlb_index(page)];
+        if (write_entry.tag == page) write_entry = TlbEntry{};
+    }
+}
+
+void Memory::check_code_write(uint64_t address, size_t size) {
+    if (size == 0 || code_pages.empty()) return;
+    uint64_t first = address >> PAGE_SHIFT;
+    uint64_t last = (address + size - 1) >> PAGE_SHIFT;
+    
+    // Walk whichever of the range and the code page set is smaller
+    bool hit = false;
+    if (last - first >= code_pages.size()) {
+        hit = std::any_of(code_pages.begin(), code_pages.end(),
+                          [&](uint64_t page) { return page >= first && page <= last; });
+    } else {
+        for (uint64_t page = first; page <= last && !hit; ++page) {
+            hit = code_pages.count(page) != 0;
+        }
+    }
+    if (hit && on_code_write) {
+        on_code_write(address, size);
+    }
+}
+
+void Memory::check_watch(uint64_t address, size_t size, bool write) const {
+    WatchKind needed = write ? WatchKind::Write : WatchKind::Read;
+    for (const Watchpoint& watch : watchpoints) {
+        if ((static_cast<uint8_t>(watch.kind) & static_cast<uint8_t>(needed)) != 0 &&
+            address < watch.address + watch.size && watch.address < address + size) {
+            if (on_watch) {
+                on_watch(WatchHit{address, size, write});
+            }
+            return;
+        }
+    }
+}
+
+void Memory::add_watchpoint(uint64_t address, uint64_t size, WatchKind kind) {
+    if (size == 0) {
+        throw std::invalid_argument("Watchpoint size must be greater than 0");
     }
+    check_address(address, size);
+    remove_watchpoint(address);
+    watchpoints.push_back(Watchpoint{address, size, kind});
+    update_watch_pages();
 }
 
-void Memory::write64(uint64_t address, uint64_t value) {
-    check_address(address, sizeof(uint64_t));
-    for (size_t i = 0; i < sizeof(uint64_t); ++i) {
-        memory[address + i] = static_cast<uint8_t>(value >> (i * 8));
+bool Memory::remove_watchpoint(uint64_t address) {
+    auto it = std::find_if(watchpoints.begin(), watchpoints.end(),
+                           [&](const Watchpoint& watch) { return watch.address == address; });
+    if (it == watchpoints.end()) return false;
+    watchpoints.erase(it);
+    update_watch_pages();
+    return true;
+}
+
+void Memory::clear_watchpoints() noexcept {
+    if (watchpoints.empty()) return;
+    watchpoints.clear();
+    read_watch_pages.clear();
+    write_watch_pages.clear();
+    flush_tlb();
+}
+
+void Memory::update_watch_pages() {
+    read_watch_pages.clear();
+    write_watch_pages.clear();
+    for (const Watchpoint& watch : watchpoints) {
+        for (uint64_t page = watch.address >> PAGE_SHIFT;
+             page <= (watch.address + watch.size - 1) >> PAGE_SHIFT; ++page) {
+            if ((static_cast<uint8_t>(watch.kind) & static_cast<uint8_t>(WatchKind::Read)) != 0) {
+                read_watch_pages.insert(page);
+            }
+            if ((static_cast<uint8_t>(watch.kind) & static_cast<uint8_t>(WatchKind::Write)) != 0) {
+                write_watch_pages.insert(page);
+            }
+        }
     }
+    flush_tlb();
 }
 
 void Memory::load_binary(uint64_t address, const std::vector<uint8_t>& data) {
     check_address(address, data.size());
-    std::copy(data.begin(), data.end(), memory.begin() + address);
+    check_code_write(address, data.size());
+
+    size_t done = 0;
+    while (done < data.size()) {
+        uint64_t current = address + done;
+        size_t chunk = std::min<uint64_t>(data.size() - done, PAGE_SIZE - (current & PAGE_MASK));
+        uint8_t* host = get_page(current >> PAGE_SHIFT);
+        std::copy(data.begin() + done, data.begin() + done + chunk,
+                  host + (current & PAGE_MASK));
+        done += chunk;
+    }
+}
+
+void Memory::map_file(uint64_t address, const std::shared_ptr<MappedFile>& file,
+                      uint64_t offset, uint64_t length) {
+    if (offset > file->size() || length > file->size() - offset) {
+        throw std::invalid_argument("File range out of bounds");
+    }
+    check_address(address, length);
+    
+    if ((address & PAGE_MASK) != 0 || (offset & PAGE_MASK) != 0) {
+        const uint8_t* begin = file->data() + offset;
+        load_binary(address, std::vector<uint8_t>(begin, begin + length));
+        return;
+    }
+    
+    check_code_write(address, length);
+    
+    uint64_t full_pages = length >> PAGE_SHIFT;
+    for (uint64_t i = 0; i < full_pages; ++i) {
+        uint8_t* host = file->data() + offset + (i << PAGE_SHIFT);
+        install_page((address >> PAGE_SHIFT) + i, std::shared_ptr<uint8_t>(file, host));
+    }
+    
+    uint64_t tail = length & PAGE_MASK;
+    if (tail != 0) {
+        uint64_t page = (address >> PAGE_SHIFT) + full_pages;
+        const uint8_t* source = file->data() + offset + (full_pages << PAGE_SHIFT);
+        if (offset + length == file->size()) {
+            // The host mapping zero-fills the rest of the page past end of file
+            install_page(page, std::shared_ptr<uint8_t>(file, const_cast<uint8_t*>(source)));
+        } else {
+            // More of the file follows in this page; it must not become visible
+            uint8_t* host = get_page(page);
+            std::copy(source, source + tail, host);
+            std::fill(host + tail, host + PAGE_SIZE, 0);
+        }
+    }
+}
+
+void Memory::map_file_lazy(uint64_t address, uint64_t mem_size,
+                           const std::shared_ptr<MappedFile>& file,
+                           uint64_t offset, uint64_t file_size) {
+    if (file_size > mem_size || offset > file->size() || file_size > file->size() - offset) {
+        throw std::invalid_argument("File range out of bounds");
+    }
+    check_address(address, mem_size);
+    if (mem_size == 0) return;
+    
+    auto regions = lazy_regions ? std::make_shared<LazyRegionMap>(*lazy_regions)
+                                : std::make_shared<LazyRegionMap>();
+    auto next = regions->lower_bound(address);
+    if ((next != regions->end() && next->first < address + mem_size) ||
+        (next != regions->begin() && std::prev(next)->second.end > address)) {
+        throw std::invalid_argument("Lazy region overlaps an existing one");
+    }
+    
+    // Drop pages already present in the range so they repopulate from the file.
+    // Whole pages go, so invalidate cached code on all of them.
+    uint64_t first = address >> PAGE_SHIFT;
+    uint64_t last = (address + mem_size - 1) >> PAGE_SHIFT;
+    check_code_write(first << PAGE_SHIFT, (last - first + 1) << PAGE_SHIFT);
+    for (auto it = pages.begin(); it != pages.end();) {
+        if (it->first >= first && it->first <= last) {
+            it = pages.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    // Frozen layers cannot change, so hide their pages behind empty entries
+    for (const PageLayer* layer = base.get(); layer; layer = layer->parent.get()) {
+        for (const auto& frozen : layer->pages) {
+            if (frozen.first >= first && frozen.first <= last) {
+                pages[frozen.first] = Page{};
+            }
+        }
+    }
+    
+    // The read TLB may map pages of the range to the zero page
+    flush_tlb();
+    (*regions)[address] = LazyRegion{address + mem_size, file, offset, file_size};
+    lazy_regions = std::move(regions);
+}
+
+Memory::Snapshot Memory::snapshot() {
+    if (!pages.empty()) {
+        auto layer = std::make_shared<PageLayer>();
+        layer->pages.swap(pages);
+        layer->parent = base;
+        
+        // Fold in parents that are not much larger, like carries in a binary
+        // counter: layer sizes at least double down the chain, so lookups visit
+        // O(log n) layers and each page is copied O(log n) times overall
+        while (layer->parent && layer->parent->pages.size() <= 2 * layer->pages.size()) {
+            PageMap merged = layer->parent->pages;
+            for (auto& [page, entry] : layer->pages) {
+                merged[page] = std::move(entry);
+            }
+            layer->pages.swap(merged);
+            layer->parent = layer->parent->parent;
+        }
+        if (!layer->parent) {
+            // Nothing is left for empty entries to hide
+            for (auto it = layer->pages.begin(); it != layer->pages.end();) {
+                it = it->second.data ? std::next(it) : layer->pages.erase(it);
+            }
+        }
+        base = std::move(layer);
+        
+        // Frozen pages must be copied before they are written again
+        write_tlb.fill(TlbEntry{});
+    }
+    
+    Snapshot result;
+    result.layer = base;
+    result.lazy_regions = lazy_regions;
+    result.limit = limit;
+    return result;
+}
+
+void Memory::restore(const Snapshot& snapshot) {
+    if (snapshot.limit != limit) {
+        throw std::invalid_argument("Snapshot is of a different address space size");
+    }
+    
+    if (on_code_write) {
+        if (base == snapshot.layer && lazy_regions == snapshot.lazy_regions) {
+            // Only pages touched since that snapshot can differ from it
+            for (const auto& entry : pages) {
+                if (code_pages.count(entry.first) != 0) {
+                    on_code_write(entry.first << PAGE_SHIFT, PAGE_SIZE);
+                }
+            }
+        } else {
+            on_code_write(0, limit);
+        }
+    }
+    
+    pages.clear();
+    base = snapshot.layer;
+    lazy_regions = snapshot.lazy_regions;
+    flush_tlb();
+}
+
+void Memory::for_each_page(const std::function<void(uint64_t, const uint8_t*)>& visit) const {
+    std::set<uint64_t> candidates;
+    for (const auto& entry : pages) {
+        candidates.insert(entry.first);
+    }
+    for (const PageLayer* layer = base.get(); layer; layer = layer->parent.get()) {
+        for (const auto& entry : layer->pages) {
+            candidates.insert(entry.first);
+        }
+    }
+    // Lazy pages never touched hold only their file data, so zero-fill
+    // (.bss) pages are visited only once they have been populated
+    if (lazy_regions) {
+        for (const auto& [start, region] : *lazy_regions) {
+            if (region.file_size == 0) continue;
+            uint64_t last = (start + region.file_size - 1) >> PAGE_SHIFT;
+            for (uint64_t page = start >> PAGE_SHIFT; page <= last; ++page) {
+                candidates.insert(page);
+            }
+        }
+    }
+    
+    // Untouched lazy pages are read in place rather than populated
+    std::vector<uint8_t> scratch(PAGE_SIZE);
+    for (uint64_t page : candidates) {
+        const Page* entry = find_layered(page);
+        if (entry && entry->data) {
+            visit(page << PAGE_SHIFT, entry->data.get());
+            continue;
+        }
+        LazyCover covering = lazy_cover(page);
+        if (covering.empty()) continue;
+        const uint8_t* data = lazy_alias(page, covering);
+        if (!data) {
+            fill_lazy(page, covering, scratch.data());
+            data = scratch.data();
+        }
+        visit(page << PAGE_SHIFT, data);
+    }
 }
 
 std::string Memory::dump_memory(uint64_t start, uint64_t end) const {
-    if (end >= memory.size()) end = memory.size() - 1;
+    if (end >= limit) end = limit - 1;
     if (start >= end) return "";
-    
+
     std::ostringstream oss;
     oss << std::hex << std::setfill('0');
-    
+
     for (uint64_t addr = start; addr <= end; addr += 16) {
         oss << "0x" << std::setw(16) << addr << ": ";
-        
+
         // Print hex values
         for (uint64_t i = 0; i < 16 && addr + i <= end; ++i) {
             if (i > 0 && i % 4 == 0) oss << " ";
-            oss << std::setw(2) << static_cast<unsigned>(memory[addr + i]) << " ";
+            oss << std::setw(2) << static_cast<unsigned>(read<uint8_t, false>(addr + i)) << " ";
         }
-        
+
         // Print ASCII
         oss << " |";
         for (uint64_t i = 0; i < 16 && addr + i <= end; ++i) {
-            char c = memory[addr + i];
+            char c = static_cast<char>(read<uint8_t, false>(addr + i));
             oss << (c >= 32 && c < 127 ? c : '.');
         }
         oss << "|\n";
     }
-    
+
     return oss.str();
 }
 
-} // namespace arm_emulator
+} // namespace arm_emulator
\ No newline at end of file
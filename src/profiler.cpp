@@ -0,0 +1,134 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace arm_emulator {
+
+namespace {
+
+// Entries sorted by descending count, ties broken by key
+template <typename Key>
+std::vector<std::pair<Key, uint64_t>> by_count(std::vector<std::pair<Key, uint64_t>> entries) {
+    std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    return entries;
+}
+
+void write_row(std::ostream& out, uint64_t count, uint64_t total, const std::string& label) {
+    out << std::setw(10) << count << "  " << std::fixed << std::setprecision(2) << std::setw(6)
+        << 100.0 * static_cast<double>(count) / static_cast<double>(total) << "%  " << label << "\n";
+}
+
+} // namespace
+
+Profiler::Profiler(uint64_t period_, SymbolTable symbols_)
+    : period(period_), until_sample(period_), symbols(std::move(symbols_)) {
+    if (period == 0) {
+        throw std::invalid_argument("Sampling period must be at least one instruction");
+    }
+}
+
+RunResult Profiler::run(CPU& cpu, uint64_t max_instructions) {
+    RunResult total{StopReason::InstructionLimit, 0};
+    while (total.instructions < max_instructions) {
+        uint64_t chunk = std::min(until_sample, max_instructions - total.instructions);
+        RunResult result = cpu.run_for(chunk);
+        total.instructions += result.instructions;
+        until_sample -= result.instructions;
+        
+        if (until_sample == 0) {
+            sample(cpu);
+            until_sample = period;
+        }
+        if (result.reason != StopReason::InstructionLimit) {
+            total.reason = result.reason;
+            break;
+        }
+    }
+    return total;
+}
+
+void Profiler::clear() noexcept {
+    until_sample = period;
+    samples = 0;
+    hot_addresses.clear();
+    stacks.clear();
+}
+
+void Profiler::sample(const CPU& cpu) {
+    const Registers& registers = cpu.get_registers();
+    uint64_t pc = registers.get_pc();
+    ++samples;
+    ++hot_addresses[pc];
+    ++stacks[{pc, registers.get_register(30)}];
+}
+
+std::string Profiler::function_name(uint64_t address) const {
+    if (const Symbol* symbol = symbols.find(address)) {
+        return symbol->name;
+    }
+    std::ostringstream oss;
+    oss << "0x" << std::hex << address;
+    return oss.str();
+}
+
+void Profiler::write_flat(std::ostream& out, size_t top) const {
+    out << samples << " samples, one every " << period << " instructions\n";
+    if (samples == 0) return;
+    
+    // Without symbols every address is its own function, so skip straight
+    // to the address table
+    if (!symbols.empty()) {
+        std::map<std::string, uint64_t> functions;
+        for (const auto& [pc, count] : hot_addresses) {
+            functions[function_name(pc)] += count;
+        }
+        auto rows = by_count(std::vector<std::pair<std::string, uint64_t>>(functions.begin(),
+                                                                           functions.end()));
+        out << "\n   samples       %  function\n";
+        for (size_t i = 0; i < rows.size() && i < top; ++i) {
+            write_row(out, rows[i].second, samples, rows[i].first);
+        }
+    }
+    
+    auto rows = by_count(std::vector<std::pair<uint64_t, uint64_t>>(hot_addresses.begin(),
+                                                                    hot_addresses.end()));
+    out << "\n   samples       %  address\n";
+    for (size_t i = 0; i < rows.size() && i < top; ++i) {
+        std::ostringstream label;
+        label << "0x" << std::hex << std::setw(8) << std::setfill('0') << rows[i].first;
+        if (!symbols.empty()) {
+            label << "  " << symbols.describe(rows[i].first);
+        }
+        write_row(out, rows[i].second, samples, label.str());
+    }
+    out << std::defaultfloat;
+}
+
+void Profiler::write_collapsed(std::ostream& out) const {
+    // Several (PC, LR) pairs fold into the same pair of names
+    std::map<std::string, uint64_t> folded;
+    for (const auto& [key, count] : stacks) {
+        const auto& [pc, lr] = key;
+        std::string function = function_name(pc);
+        std::string stack = function;
+        if (lr >= 4 && symbols.find(lr - 4)) {
+            std::string caller = function_name(lr - 4);
+            if (caller != function) {
+                stack = caller + ";" + function;
+            }
+        }
+        folded[stack] += count;
+    }
+    for (const auto& [stack, count] : folded) {
+        out << stack << " " << count << "\n";
+    }
+}
+
+} // namespace arm_emulator
@@ -1,4 +1,5 @@
 #include "registers.hpp"
+#include <cstddef>
 #include <sstream>
 #include <iomanip>
 #include <stdexcept>
@@ -13,6 +14,8 @@ void Registers::reset() noexcept {
     registers.fill(0);
     // Initialize SP to a reasonable value (top of memory - 8)
     registers[static_cast<size_t>(SpecialRegister::SP)] = 0xFFFF0000;
+    condition_flags = ConditionFlags{};
+    vector_registers.fill(VectorRegister{});
 }
 
 uint64_t Registers::get_register(size_t index) const {
@@ -25,6 +28,10 @@ uint64_t Registers::get_register(size_t index) const {
         return 0;
     }
     
+    if (index == static_cast<size_t>(SpecialRegister::NZCV)) {
+        return static_cast<uint64_t>(condition_flags.nzcv()) << 28;
+    }
+    
     return registers[index];
 }
 
@@ -38,9 +45,22 @@ void Registers::set_register(size_t index, uint64_t value) noexcept {
         return;
     }
     
+    if (index == static_cast<size_t>(SpecialRegister::NZCV)) {
+        condition_flags.set_nzcv(static_cast<uint32_t>(value >> 28));
+        return;
+    }
+    
     registers[index] = value;
 }
 
+size_t Registers::flags_offset() noexcept {
+    return offsetof(Registers, condition_flags) - offsetof(Registers, registers);
+}
+
+size_t Registers::vector_offset() noexcept {
+    return offsetof(Registers, vector_registers) - offsetof(Registers, registers);
+}
+
 std::string Registers::to_string() const {
     std::ostringstream oss;
     oss << std::hex << std::setfill('0');
@@ -61,6 +81,19 @@ std::string Registers::to_string() const {
     oss << "  SP: 0x" << std::setw(16) << get_register(static_cast<size_t>(SpecialRegister::SP));
     oss << "\n PC: 0x" << std::setw(16) << get_register(static_cast<size_t>(SpecialRegister::PC));
     
+    // Flags as letters, upper case when set
+    uint32_t nzcv = condition_flags.nzcv();
+    oss << "  NZCV: " << (nzcv & FLAG_N ? 'N' : 'n') << (nzcv & FLAG_Z ? 'Z' : 'z')
+        << (nzcv & FLAG_C ? 'C' : 'c') << (nzcv & FLAG_V ? 'V' : 'v');
+    
+    // Vector registers in use, most significant byte first
+    for (size_t i = 0; i < NUM_VECTOR_REGISTERS; ++i) {
+        const VectorRegister& v = vector_registers[i];
+        if (v.get<uint64_t>(0) == 0 && v.get<uint64_t>(1) == 0) continue;
+        oss << "\n" << (i < 10 ? " V" : "V") << std::dec << i << std::hex << ": 0x"
+            << std::setw(16) << v.get<uint64_t>(1) << std::setw(16) << v.get<uint64_t>(0);
+    }
+    
     return oss.str();
 }
 
@@ -1,4 +1,6 @@
 #include "repl.hpp"
+#include "profiler.hpp"
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
@@ -6,7 +8,7 @@
 
 namespace arm_emulator {
 
-REPL::REPL(CPU& cpu_ref) : cpu(cpu_ref) {}
+REPL::REPL(CPU& cpu_ref) : cpu(cpu_ref), history(cpu_ref) {}
 
 void REPL::run() {
     std::cout << "ARM Emulator - Type 'help' for available commands\n";
@@ -28,6 +30,8 @@ void REPL::run() {
             break;
         }
     }
+    
+    stop_trace();
 }
 
 bool REPL::process_command(const std::string& line) {
@@ -42,13 +46,37 @@ bool REPL::process_command(const std::string& line) {
         if (cmd == "step" || cmd == "s") {
             handle_step();
         } else if (cmd == "run" || cmd == "r") {
-            handle_run();
+            handle_run(args);
+        } else if (cmd == "until" || cmd == "u") {
+            handle_until(args);
+        } else if (cmd == "reverse-step" || cmd == "rs") {
+            handle_reverse_step(args);
+        } else if (cmd == "reverse-continue" || cmd == "rc") {
+            handle_reverse_continue();
         } else if (cmd == "break" || cmd == "b") {
             handle_break(args);
+        } else if (cmd == "delete" || cmd == "d") {
+            handle_delete(args);
+        } else if (cmd == "watch" || cmd == "w") {
+            handle_watch(args);
+        } else if (cmd == "unwatch") {
+            handle_unwatch(args);
         } else if (cmd == "reg" || cmd == "r") {
             handle_register(args);
         } else if (cmd == "mem" || cmd == "m") {
             handle_memory(args);
+        } else if (cmd == "save") {
+            handle_save(args);
+        } else if (cmd == "load") {
+            handle_load(args);
+        } else if (cmd == "profile") {
+            handle_profile(args);
+        } else if (cmd == "trace") {
+            handle_trace(args);
+        } else if (cmd == "cache") {
+            handle_cache();
+        } else if (cmd == "branches") {
+            handle_branches();
         } else if (cmd == "help" || cmd == "h" || cmd == "?") {
             handle_help();
         } else if (cmd == "quit" || cmd == "q" || cmd == "exit") {
@@ -65,14 +93,38 @@ bool REPL::process_command(const std::string& line) {
 }
 
 void REPL::handle_step() {
-    if (!cpu.step_instruction()) {
-        std::cout << "Execution stopped\n";
+    RunResult result = history.run_for(1);
+    if (result.reason != StopReason::InstructionLimit) {
+        report_stop(result);
     }
     print_state();
 }
 
-void REPL::handle_run() {
-    cpu.run();
+void REPL::handle_run(const std::vector<std::string>& args) {
+    uint64_t count = args.size() > 1 ? std::stoull(args[1], nullptr, 0) : ~0ULL;
+    report_stop(history.run_for(count));
+    print_state();
+}
+
+void REPL::handle_until(const std::vector<std::string>& args) {
+    if (args.size() < 2) {
+        std::cout << "Usage: until <address>\n";
+        return;
+    }
+    
+    uint64_t address = std::stoull(args[1], nullptr, 0);
+    report_stop(history.run_until(address));
+    print_state();
+}
+
+void REPL::handle_reverse_step(const std::vector<std::string>& args) {
+    uint64_t count = args.size() > 1 ? std::stoull(args[1], nullptr, 0) : 1;
+    report_reverse(history.step_back(count));
+    print_state();
+}
+
+void REPL::handle_reverse_continue() {
+    report_reverse(history.reverse_continue());
     print_state();
 }
 
@@ -91,6 +143,62 @@ void REPL::handle_break(const std::vector<std::string>& args) {
     }
 }
 
+void REPL::handle_delete(const std::vector<std::string>& args) {
+    if (args.size() < 2) {
+        std::cout << "Usage: delete <address>\n";
+        return;
+    }
+    
+    try {
+        uint64_t address = std::stoull(args[1], nullptr, 0);
+        cpu.clear_breakpoint(address);
+        std::cout << "Breakpoint cleared at 0x" << std::hex << address << std::dec << "\n";
+    } catch (const std::exception&) {
+        std::cerr << "Invalid address: " << args[1] << "\n";
+    }
+}
+
+void REPL::handle_watch(const std::vector<std::string>& args) {
+    if (args.size() < 2) {
+        std::cout << "Usage: watch <address> [len] [r|w|rw]\n";
+        return;
+    }
+    
+    uint64_t address = std::stoull(args[1], nullptr, 0);
+    uint64_t length = args.size() > 2 ? std::stoull(args[2], nullptr, 0) : 8;
+    std::string mode = args.size() > 3 ? args[3] : "w";
+    
+    Memory::WatchKind kind;
+    if (mode == "r") {
+        kind = Memory::WatchKind::Read;
+    } else if (mode == "w") {
+        kind = Memory::WatchKind::Write;
+    } else if (mode == "rw") {
+        kind = Memory::WatchKind::Access;
+    } else {
+        std::cout << "Watch mode must be r, w or rw\n";
+        return;
+    }
+    
+    cpu.set_watchpoint(address, length, kind);
+    std::cout << "Watchpoint (" << mode << ") set at 0x" << std::hex << address << std::dec
+              << ", " << length << " bytes\n";
+}
+
+void REPL::handle_unwatch(const std::vector<std::string>& args) {
+    if (args.size() < 2) {
+        std::cout << "Usage: unwatch <address>\n";
+        return;
+    }
+    
+    uint64_t address = std::stoull(args[1], nullptr, 0);
+    if (cpu.clear_watchpoint(address)) {
+        std::cout << "Watchpoint cleared at 0x" << std::hex << address << std::dec << "\n";
+    } else {
+        std::cout << "No watchpoint at 0x" << std::hex << address << std::dec << "\n";
+    }
+}
+
 void REPL::handle_register(const std::vector<std::string>& args) {
     if (args.size() < 2) {
         // Show all registers
@@ -108,17 +216,25 @@ void REPL::handle_register(const std::vector<std::string>& args) {
                 int reg_num = std::stoi(reg.substr(1));
                 if (reg_num >= 0 && reg_num < 31) {
                     cpu.get_registers().set_register(reg_num, value);
+                    history.reset();
                     std::cout << "Set " << reg << " = 0x" << std::hex << value << "\n";
                     return;
                 }
             } else if (reg == "SP" || reg == "sp") {
                 cpu.get_registers().set_sp(value);
+                history.reset();
                 std::cout << "Set SP = 0x" << std::hex << value << "\n";
                 return;
             } else if (reg == "PC" || reg == "pc") {
                 cpu.get_registers().set_pc(value);
+                history.reset();
                 std::cout << "Set PC = 0x" << std::hex << value << "\n";
                 return;
+            } else if (reg == "NZCV" || reg == "nzcv") {
+                cpu.get_registers().set_register(static_cast<size_t>(SpecialRegister::NZCV), value);
+                history.reset();
+                std::cout << "Set NZCV = 0x" << std::hex << value << "\n";
+                return;
             }
         } catch (const std::exception&) {
             // Fall through to error message
@@ -148,6 +264,19 @@ void REPL::handle_register(const std::vector<std::string>& args) {
             value = cpu.get_registers().get_pc();
             std::cout << "PC = 0x" << std::hex << value << "\n";
             return;
+        } else if (reg == "NZCV" || reg == "nzcv") {
+            value = cpu.get_registers().get_register(static_cast<size_t>(SpecialRegister::NZCV));
+            std::cout << "NZCV = 0x" << std::hex << value << "\n";
+            return;
+        } else if (reg[0] == 'V' || reg[0] == 'v') {
+            int reg_num = std::stoi(reg.substr(1));
+            if (reg_num >= 0 && reg_num < static_cast<int>(NUM_VECTOR_REGISTERS)) {
+                const VectorRegister& v = cpu.get_registers().vector(reg_num);
+                std::cout << reg << " = 0x" << std::hex << std::setfill('0')
+                          << std::setw(16) << v.get<uint64_t>(1) << std::setw(16) << v.get<uint64_t>(0)
+                          << std::setfill(' ') << "\n";
+                return;
+            }
         }
     } catch (const std::exception&) {
         // Fall through to error message
@@ -176,19 +305,164 @@ void REPL::handle_memory(const std::vector<std::string>& args) {
     }
 }
 
+void REPL::handle_save(const std::vector<std::string>& args) {
+    if (args.size() < 2) {
+        std::cout << "Usage: save <file>\n";
+        return;
+    }
+    
+    if (cpu.save_snapshot(args[1])) {
+        std::cout << "Saved snapshot to " << args[1] << "\n";
+    }
+}
+
+void REPL::handle_load(const std::vector<std::string>& args) {
+    if (args.size() < 2) {
+        std::cout << "Usage: load <file>\n";
+        return;
+    }
+    
+    if (cpu.load_snapshot(args[1])) {
+        history.reset();
+        std::cout << "Loaded snapshot from " << args[1] << "\n";
+        print_state();
+    }
+}
+
+void REPL::handle_profile(const std::vector<std::string>& args) {
+    if (args.size() < 2) {
+        std::cout << "Usage: profile <period> [collapsed-file]\n";
+        return;
+    }
+    
+    // The profiler runs the CPU directly, so the history starts again after it
+    Profiler profiler(std::stoull(args[1], nullptr, 0), symbols);
+    report_stop(profiler.run(cpu));
+    history.reset();
+    profiler.write_flat(std::cout);
+    
+    if (args.size() > 2) {
+        std::ofstream out(args[2]);
+        if (!out) {
+            std::cerr << "Failed to open " << args[2] << "\n";
+            return;
+        }
+        profiler.write_collapsed(out);
+        std::cout << "Wrote collapsed stacks to " << args[2] << "\n";
+    }
+}
+
+void REPL::handle_trace(const std::vector<std::string>& args) {
+    if (args.size() < 2) {
+        std::cout << "Usage: trace <file> | trace off\n";
+        return;
+    }
+    
+    stop_trace();
+    if (args[1] == "off") {
+        return;
+    }
+    trace = std::make_unique<TraceWriter>(args[1]);
+    cpu.add_observer(trace.get());
+    std::cout << "Tracing to " << args[1] << "\n";
+}
+
+void REPL::handle_cache() const {
+    if (!cache_model) {
+        std::cout << "No cache model; start the emulator with --cache <spec>\n";
+        return;
+    }
+    cache_model->write_report(std::cout, symbols);
+}
+
+void REPL::handle_branches() const {
+    if (branch_models.empty()) {
+        std::cout << "No branch predictor; start the emulator with --branch-predictor <spec>\n";
+        return;
+    }
+    for (size_t i = 0; i < branch_models.size(); ++i) {
+        if (i > 0) std::cout << "\n";
+        branch_models[i]->write_report(std::cout, symbols);
+    }
+}
+
+void REPL::stop_trace() {
+    if (!trace) return;
+    
+    cpu.remove_observer(trace.get());
+    auto finished = std::move(trace);
+    finished->close();
+    std::cout << "Traced " << finished->record_count() << " instructions\n";
+}
+
 void REPL::handle_help() const {
     std::cout << "Available commands:\n"
               << "  step, s        - Execute one instruction\n"
-              << "  run, r         - Run until breakpoint or end of program\n"
+              << "  run, r [count] - Run until breakpoint or end of program, or for at\n"
+              << "                   most count instructions\n"
+              << "  until, u <addr>- Run until PC reaches address\n"
+              << "  reverse-step, rs [count] - Go back count instructions (default 1)\n"
+              << "  reverse-continue, rc - Go back to the previous breakpoint or\n"
+              << "                   watchpoint stop\n"
               << "  break, b <addr>- Set breakpoint at address\n"
+              << "  delete, d <addr> - Clear breakpoint at address\n"
+              << "  watch, w <addr> [len] [r|w|rw] - Stop on reads and/or writes\n"
+              << "                   (default: 8 bytes, writes)\n"
+              << "  unwatch <addr> - Clear watchpoint at address\n"
               << "  reg, r         - Show all registers\n"
-              << "  reg <reg>      - Show value of specific register\n"
+              << "  reg <reg>      - Show value of specific register (X0-X30, SP,\n"
+              << "                   PC, NZCV or V0-V31)\n"
               << "  reg <reg> = <val> - Set register value\n"
               << "  mem, m <addr> [len] - Show memory contents\n"
+              << "  save <file>    - Save a machine snapshot\n"
+              << "  load <file>    - Restore a machine snapshot\n"
+              << "  profile <period> [file] - Run, sampling the PC every period\n"
+              << "                   instructions; print the hottest functions and\n"
+              << "                   addresses and write collapsed stacks to file\n"
+              << "  trace <file>   - Record every instruction executed to a binary trace\n"
+              << "  trace off      - Stop tracing\n"
+              << "  cache          - Show cache model statistics (with --cache)\n"
+              << "  branches       - Show branch prediction statistics (with --branch-predictor)\n"
               << "  help, h, ?     - Show this help\n"
               << "  quit, q, exit  - Exit the emulator\n";
 }
 
+void REPL::report_stop(const RunResult& result) const {
+    report_cause(result.reason);
+    std::cout << "Stopped (" << to_string(result.reason) << ") after "
+              << result.instructions << " instructions\n";
+}
+
+void REPL::report_cause(StopReason reason) const {
+    uint64_t pc = cpu.get_registers().get_pc();
+    switch (reason) {
+        case StopReason::Breakpoint:
+            std::cout << "Breakpoint hit at 0x" << std::hex << pc << std::dec << "\n";
+            break;
+        case StopReason::Watchpoint: {
+            const Memory::WatchHit& hit = cpu.get_watch_hit();
+            std::cout << "Watchpoint hit: " << (hit.write ? "write" : "read") << " of "
+                      << hit.size << " bytes at 0x" << std::hex << hit.address << std::dec << "\n";
+            break;
+        }
+        case StopReason::Fault:
+            std::cerr << "Error executing instruction at 0x" << std::hex << cpu.get_trap().pc
+                      << std::dec << ": " << cpu.get_trap().to_string() << "\n";
+            break;
+        case StopReason::HistoryStart:
+            std::cout << "Reached the start of the recorded history\n";
+            break;
+        default:
+            break;
+    }
+}
+
+void REPL::report_reverse(const RunResult& result) const {
+    report_cause(result.reason);
+    std::cout << "Went back " << result.instructions << " instructions, to instruction "
+              << history.position() << "\n";
+}
+
 void REPL::print_state() const {
     std::cout << cpu.get_state() << "\n";
 }
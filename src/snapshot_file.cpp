@@ -0,0 +1,194 @@
+#include "snapshot_file.hpp"
+#include "mapped_file.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace arm_emulator {
+
+namespace {
+
+constexpr char MAGIC[8] = {'A', 'R', 'M', 'S', 'N', 'A', 'P', '\0'};
+constexpr uint32_t FLAG_RUNNING = 1;
+
+// Fixed-size header at offset 0; registers follow it
+struct Header {
+    uint32_t version;
+    uint32_t flags;
+    uint64_t memory_size;
+    uint64_t register_count;
+    uint64_t page_size;
+    uint64_t page_count;
+    uint64_t page_table_offset;
+    uint64_t data_offset;
+};
+
+constexpr uint64_t HEADER_SIZE = sizeof(MAGIC) + 2 * sizeof(uint32_t) + 6 * sizeof(uint64_t);
+
+// V0-V31 follow the general registers from version 3, as low and high halves
+constexpr uint64_t VECTOR_BLOCK_SIZE = NUM_VECTOR_REGISTERS * 2 * sizeof(uint64_t);
+
+// General registers saved by each version: version 1 predates NZCV
+constexpr uint64_t general_registers(uint32_t version) {
+    return version == 1 ? TOTAL_REGISTERS - 1 : TOTAL_REGISTERS;
+}
+
+constexpr uint64_t vector_block_size(uint32_t version) {
+    return version >= 3 ? VECTOR_BLOCK_SIZE : 0;
+}
+
+void put(std::vector<uint8_t>& out, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+}
+
+uint64_t get(const uint8_t* in, size_t size) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; ++i) {
+        value |= static_cast<uint64_t>(in[i]) << (i * 8);
+    }
+    return value;
+}
+
+bool is_zero(const uint8_t* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        if (data[i] != 0) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+void SnapshotFile::save(const std::string& path, const Registers& registers,
+                        const Memory& memory, bool running) {
+    // Page data is only valid during each visit, so list the pages first
+    // and write them out in a second pass
+    std::vector<uint64_t> addresses;
+    memory.for_each_page([&](uint64_t address, const uint8_t* data) {
+        if (!is_zero(data, Memory::PAGE_SIZE)) {
+            addresses.push_back(address);
+        }
+    });
+
+    Header header{};
+    header.version = VERSION;
+    header.flags = running ? FLAG_RUNNING : 0;
+    header.memory_size = memory.size();
+    header.register_count = TOTAL_REGISTERS;
+    header.page_size = Memory::PAGE_SIZE;
+    header.page_count = addresses.size();
+    header.page_table_offset = HEADER_SIZE + TOTAL_REGISTERS * sizeof(uint64_t) + VECTOR_BLOCK_SIZE;
+    header.data_offset = (header.page_table_offset + addresses.size() * sizeof(uint64_t) +
+                          Memory::PAGE_MASK) & ~Memory::PAGE_MASK;
+
+    std::vector<uint8_t> prefix(MAGIC, MAGIC + sizeof(MAGIC));
+    put(prefix, header.version, sizeof(uint32_t));
+    put(prefix, header.flags, sizeof(uint32_t));
+    put(prefix, header.memory_size, sizeof(uint64_t));
+    put(prefix, header.register_count, sizeof(uint64_t));
+    put(prefix, header.page_size, sizeof(uint64_t));
+    put(prefix, header.page_count, sizeof(uint64_t));
+    put(prefix, header.page_table_offset, sizeof(uint64_t));
+    put(prefix, header.data_offset, sizeof(uint64_t));
+    for (size_t i = 0; i < TOTAL_REGISTERS; ++i) {
+        put(prefix, registers.get_register(i), sizeof(uint64_t));
+    }
+    for (size_t i = 0; i < NUM_VECTOR_REGISTERS; ++i) {
+        put(prefix, registers.vector(i).get<uint64_t>(0), sizeof(uint64_t));
+        put(prefix, registers.vector(i).get<uint64_t>(1), sizeof(uint64_t));
+    }
+    for (uint64_t address : addresses) {
+        put(prefix, address, sizeof(uint64_t));
+    }
+    prefix.resize(header.data_offset, 0);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Failed to create snapshot: " + path);
+    }
+    out.write(reinterpret_cast<const char*>(prefix.data()), static_cast<std::streamsize>(prefix.size()));
+    memory.for_each_page([&](uint64_t, const uint8_t* data) {
+        if (!is_zero(data, Memory::PAGE_SIZE)) {
+            out.write(reinterpret_cast<const char*>(data), Memory::PAGE_SIZE);
+        }
+    });
+    if (!out.flush()) {
+        throw std::runtime_error("Failed to write snapshot: " + path);
+    }
+}
+
+bool SnapshotFile::load(const std::string& path, Registers& registers, Memory& memory) {
+    auto file = MappedFile::open(path);
+    const uint8_t* base = file->data();
+    if (file->size() < HEADER_SIZE || std::memcmp(base, MAGIC, sizeof(MAGIC)) != 0) {
+        throw std::runtime_error("Snapshot: bad magic");
+    }
+
+    const uint8_t* field = base + sizeof(MAGIC);
+    Header header{};
+    header.version = static_cast<uint32_t>(get(field, 4));
+    header.flags = static_cast<uint32_t>(get(field + 4, 4));
+    header.memory_size = get(field + 8, 8);
+    header.register_count = get(field + 16, 8);
+    header.page_size = get(field + 24, 8);
+    header.page_count = get(field + 32, 8);
+    header.page_table_offset = get(field + 40, 8);
+    header.data_offset = get(field + 48, 8);
+
+    if (header.version < 1 || header.version > VERSION) {
+        throw std::runtime_error("Snapshot: unsupported version " + std::to_string(header.version));
+    }
+    uint64_t general = general_registers(header.version);
+    uint64_t vector_bytes = vector_block_size(header.version);
+    if (header.register_count != general || header.page_size != Memory::PAGE_SIZE) {
+        throw std::runtime_error("Snapshot: incompatible layout");
+    }
+    if (header.memory_size != memory.size()) {
+        throw std::runtime_error("Snapshot: address space size mismatch");
+    }
+    // Each bound only subtracts values already known to be in order, so no
+    // header field can wrap a check around (register_count is checked above)
+    if (header.data_offset > file->size() || (header.data_offset & Memory::PAGE_MASK) != 0 ||
+        header.page_table_offset < HEADER_SIZE + general * sizeof(uint64_t) + vector_bytes ||
+        header.page_table_offset > header.data_offset ||
+        header.page_count > (header.data_offset - header.page_table_offset) / sizeof(uint64_t) ||
+        header.page_count > (file->size() - header.data_offset) / Memory::PAGE_SIZE) {
+        throw std::runtime_error("Snapshot: truncated file");
+    }
+
+    // Validate the whole table before touching memory
+    const uint8_t* table = base + header.page_table_offset;
+    for (uint64_t i = 0; i < header.page_count; ++i) {
+        uint64_t address = get(table + i * sizeof(uint64_t), sizeof(uint64_t));
+        if ((address & Memory::PAGE_MASK) != 0 || address >= memory.size() ||
+            memory.size() - address < Memory::PAGE_SIZE) {
+            throw std::runtime_error("Snapshot: bad page address");
+        }
+    }
+
+    memory.reset();
+    for (uint64_t i = 0; i < header.page_count; ++i) {
+        uint64_t address = get(table + i * sizeof(uint64_t), sizeof(uint64_t));
+        memory.map_file(address, file, header.data_offset + i * Memory::PAGE_SIZE, Memory::PAGE_SIZE);
+    }
+
+    const uint8_t* values = base + HEADER_SIZE;
+    registers.reset();
+    for (size_t i = 0; i < general; ++i) {
+        registers.set_register(i, get(values + i * sizeof(uint64_t), sizeof(uint64_t)));
+    }
+    if (vector_bytes != 0) {
+        const uint8_t* vectors = values + general * sizeof(uint64_t);
+        for (size_t i = 0; i < NUM_VECTOR_REGISTERS; ++i) {
+            registers.vector(i).set<uint64_t>(0, get(vectors + i * 16, sizeof(uint64_t)));
+            registers.vector(i).set<uint64_t>(1, get(vectors + i * 16 + 8, sizeof(uint64_t)));
+        }
+    }
+    return (header.flags & FLAG_RUNNING) != 0;
+}
+
+} // namespace arm_emulator
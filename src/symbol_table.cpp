@@ -0,0 +1,66 @@
+#include "symbol_table.hpp"
+#include "elf_loader.hpp"
+#include "mapped_file.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+namespace arm_emulator {
+
+SymbolTable::SymbolTable(std::vector<Symbol> unsorted) : symbols(std::move(unsorted)) {
+    // Sized symbols first among those at the same address
+    std::stable_sort(symbols.begin(), symbols.end(), [](const Symbol& a, const Symbol& b) {
+        return a.address != b.address ? a.address < b.address : a.size > b.size;
+    });
+    
+    // Aliases share an address; keep the first. Unsized labels inside a sized
+    // symbol would hide the rest of it from find(), so drop them too.
+    std::vector<Symbol> kept;
+    uint64_t covered_end = 0;
+    for (Symbol& symbol : symbols) {
+        if (!kept.empty() && symbol.address == kept.back().address) continue;
+        if (symbol.size == 0 && symbol.address < covered_end) continue;
+        if (symbol.size != 0) {
+            covered_end = std::max(covered_end, symbol.address + symbol.size);
+        }
+        kept.push_back(std::move(symbol));
+    }
+    symbols = std::move(kept);
+    
+    starts.reserve(symbols.size());
+    for (const Symbol& symbol : symbols) {
+        starts.push_back(symbol.address);
+    }
+}
+
+SymbolTable SymbolTable::from_file(const std::string& path) {
+    auto file = MappedFile::open(path);
+    if (!ElfLoader::is_elf(*file)) {
+        return SymbolTable();
+    }
+    return SymbolTable(ElfLoader::read_symbols(*file));
+}
+
+const Symbol* SymbolTable::find(uint64_t address) const noexcept {
+    auto it = std::upper_bound(starts.begin(), starts.end(), address);
+    if (it == starts.begin()) return nullptr;
+    
+    const Symbol& symbol = symbols[static_cast<size_t>(it - starts.begin()) - 1];
+    if (symbol.size != 0 && address - symbol.address >= symbol.size) return nullptr;
+    return &symbol;
+}
+
+std::string SymbolTable::describe(uint64_t address) const {
+    std::ostringstream oss;
+    if (const Symbol* symbol = find(address)) {
+        oss << symbol->name;
+        if (address != symbol->address) {
+            oss << "+0x" << std::hex << address - symbol->address;
+        }
+    } else {
+        oss << "0x" << std::hex << address;
+    }
+    return oss.str();
+}
+
+} // namespace arm_emulator
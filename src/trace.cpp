@@ -0,0 +1,209 @@
+#include "trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+namespace arm_emulator {
+
+namespace {
+
+constexpr char MAGIC[8] = {'A', 'R', 'M', 'T', 'R', 'A', 'C', 'E'};
+
+// Record flags
+constexpr uint8_t PC_JUMP = 1 << 0;     // PC is not the previous record's next PC
+constexpr uint8_t BRANCHED = 1 << 1;    // Next PC is not PC + 4
+constexpr uint8_t NEW_WORD = 1 << 2;    // Word differs from the one last seen here
+constexpr uint8_t DEST = 1 << 3;        // A register was written
+constexpr uint8_t MEMORY = 1 << 4;      // A load or store
+constexpr uint8_t WRITE = 1 << 5;       // The access was a store
+constexpr uint8_t LOADED_DEST = 1 << 6; // The loaded value is the register value
+
+// Records encoded per write to the file
+constexpr size_t BATCH = 1024;
+
+uint64_t zigzag(uint64_t delta) noexcept {
+    return (delta << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(delta) >> 63);
+}
+
+uint64_t unzigzag(uint64_t value) noexcept {
+    return (value >> 1) ^ (~(value & 1) + 1);
+}
+
+void put_varint(std::vector<char>& buffer, uint64_t value) {
+    while (value >= 0x80) {
+        buffer.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<char>(value));
+}
+
+// Signed difference between two values, as a varint
+void put_delta(std::vector<char>& buffer, uint64_t value, uint64_t base) {
+    put_varint(buffer, zigzag(value - base));
+}
+
+void encode(std::vector<char>& buffer, TraceContext& context, const RetiredInstruction& retired) {
+    uint32_t& word = context.words[TraceContext::slot(retired.pc)];
+    bool loaded_dest = retired.memory && !retired.write && retired.dest != RetiredInstruction::NO_REGISTER &&
+                       retired.value == retired.dest_value;
+    
+    uint8_t flags = 0;
+    if (retired.pc != context.next_pc) flags |= PC_JUMP;
+    if (retired.next_pc != retired.pc + 4) flags |= BRANCHED;
+    if (retired.word != word) flags |= NEW_WORD;
+    if (retired.dest != RetiredInstruction::NO_REGISTER) flags |= DEST;
+    if (retired.memory) flags |= MEMORY;
+    if (retired.write) flags |= WRITE;
+    if (loaded_dest) flags |= LOADED_DEST;
+    buffer.push_back(static_cast<char>(flags));
+    
+    if (flags & PC_JUMP) put_delta(buffer, retired.pc, context.next_pc);
+    if (flags & BRANCHED) put_delta(buffer, retired.next_pc, retired.pc);
+    if (flags & NEW_WORD) {
+        for (int shift = 0; shift < 32; shift += 8) {
+            buffer.push_back(static_cast<char>(retired.word >> shift));
+        }
+        word = retired.word;
+    }
+    if (flags & DEST) {
+        buffer.push_back(static_cast<char>(retired.dest));
+        put_delta(buffer, retired.dest_value, context.registers[retired.dest]);
+        context.registers[retired.dest] = retired.dest_value;
+    }
+    if (flags & MEMORY) {
+        put_delta(buffer, retired.address, context.address);
+        context.address = retired.address;
+        if (!loaded_dest) put_delta(buffer, retired.value, context.value);
+        context.value = retired.value;
+    }
+    context.next_pc = retired.next_pc;
+}
+
+} // namespace
+
+TraceWriter::TraceWriter(const std::string& path, size_t capacity)
+    : ring(capacity), out(path, std::ios::binary | std::ios::trunc) {
+    if (!out) {
+        throw std::runtime_error("Failed to create trace file: " + path);
+    }
+    out.write(MAGIC, sizeof(MAGIC));
+    writer = std::thread([this] { drain(); });
+}
+
+TraceWriter::~TraceWriter() {
+    try {
+        close();
+    } catch (const std::exception&) {
+        // Nothing to report a failure to; close() explicitly to see it
+    }
+}
+
+void TraceWriter::on_retire(const RetiredInstruction& retired) {
+    while (!ring.try_push(retired)) {
+        std::this_thread::yield();
+    }
+    ++records;
+}
+
+void TraceWriter::close() {
+    if (!writer.joinable()) return;
+    closing.store(true, std::memory_order_release);
+    writer.join();
+    out.close();
+    if (out.fail()) {
+        throw std::runtime_error("Failed to write trace file");
+    }
+}
+
+void TraceWriter::drain() {
+    TraceContext context;
+    std::vector<RetiredInstruction> batch(BATCH);
+    std::vector<char> buffer;
+    buffer.reserve(BATCH * 32);
+    
+    while (true) {
+        // Read the flag first: once it is set, everything recorded is in the ring
+        bool last = closing.load(std::memory_order_acquire);
+        size_t count = ring.pop(batch.data(), batch.size());
+        for (size_t i = 0; i < count; ++i) {
+            encode(buffer, context, batch[i]);
+        }
+        if (!buffer.empty()) {
+            out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            buffer.clear();
+        }
+        if (count == batch.size()) continue;
+        if (last) break;
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+
+TraceReader::TraceReader(const std::string& path) : in(path, std::ios::binary) {
+    if (!in) {
+        throw std::runtime_error("Failed to open trace file: " + path);
+    }
+    char magic[sizeof(MAGIC)] = {};
+    in.read(magic, sizeof(magic));
+    if (!in || !std::equal(magic, magic + sizeof(magic), MAGIC)) {
+        throw std::runtime_error("Not a trace file: " + path);
+    }
+}
+
+bool TraceReader::next(RetiredInstruction& retired) {
+    int first = in.get();
+    if (first == std::char_traits<char>::eof()) return false;
+    uint8_t flags = static_cast<uint8_t>(first);
+    
+    auto byte = [this]() {
+        int c = in.get();
+        if (c == std::char_traits<char>::eof()) {
+            throw std::runtime_error("Truncated trace file");
+        }
+        return static_cast<uint8_t>(c);
+    };
+    auto delta = [&](uint64_t base) {
+        uint64_t value = 0;
+        for (unsigned shift = 0;; shift += 7) {
+            if (shift >= 64) throw std::runtime_error("Corrupt trace file");
+            uint8_t b = byte();
+            value |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if (!(b & 0x80)) break;
+        }
+        return base + unzigzag(value);
+    };
+    
+    retired = RetiredInstruction{};
+    retired.pc = (flags & PC_JUMP) ? delta(context.next_pc) : context.next_pc;
+    retired.next_pc = (flags & BRANCHED) ? delta(retired.pc) : retired.pc + 4;
+    
+    uint32_t& word = context.words[TraceContext::slot(retired.pc)];
+    if (flags & NEW_WORD) {
+        word = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            word |= static_cast<uint32_t>(byte()) << shift;
+        }
+    }
+    retired.word = word;
+    
+    if (flags & DEST) {
+        retired.dest = byte();
+        if (retired.dest >= context.registers.size()) {
+            throw std::runtime_error("Corrupt trace file");
+        }
+        retired.dest_value = delta(context.registers[retired.dest]);
+        context.registers[retired.dest] = retired.dest_value;
+    }
+    if (flags & MEMORY) {
+        retired.memory = true;
+        retired.write = (flags & WRITE) != 0;
+        retired.address = delta(context.address);
+        retired.value = (flags & LOADED_DEST) ? retired.dest_value : delta(context.value);
+        context.address = retired.address;
+        context.value = retired.value;
+    }
+    context.next_pc = retired.next_pc;
+    return true;
+}
+
+} // namespace arm_emulator
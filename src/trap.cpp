@@ -0,0 +1,37 @@
+#include "trap.hpp"
+
+#include <sstream>
+
+namespace arm_emulator {
+
+const char* to_string(FaultKind kind) noexcept {
+    switch (kind) {
+        case FaultKind::None: return "none";
+        case FaultKind::MemoryOutOfBounds: return "memory-out-of-bounds";
+        case FaultKind::FetchOutOfBounds: return "fetch-out-of-bounds";
+        case FaultKind::UndefinedInstruction: return "undefined-instruction";
+    }
+    return "unknown";
+}
+
+std::string Trap::to_string() const {
+    std::ostringstream oss;
+    oss << std::hex;
+    switch (kind) {
+        case FaultKind::None:
+            return "No fault";
+        case FaultKind::MemoryOutOfBounds:
+            oss << "Memory " << (write ? "write" : "read") << " out of bounds: 0x" << address
+                << " + " << std::dec << size;
+            break;
+        case FaultKind::FetchOutOfBounds:
+            oss << "Instruction fetch out of bounds: 0x" << address;
+            break;
+        case FaultKind::UndefinedInstruction:
+            oss << "Unimplemented instruction at 0x" << address;
+            break;
+    }
+    return oss.str();
+}
+
+} // namespace arm_emulator
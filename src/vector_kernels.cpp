@@ -0,0 +1,334 @@
+#include "vector_kernels.hpp"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define ARM_EMULATOR_X86_KERNELS 1
+#include <immintrin.h>
+#define ARM_EMULATOR_TARGET_SSE41 __attribute__((target("sse4.1")))
+#endif
+
+namespace arm_emulator {
+
+namespace {
+
+using Op = VectorKernels::Op;
+using Reduction = VectorKernels::Reduction;
+
+// Portable kernels, one element at a time
+
+template <typename T, Op OP>
+T apply(T x, T y) {
+    // Integer arithmetic is done in 64 bits so narrow products cannot overflow int
+    if constexpr (OP == VectorKernels::Add || OP == VectorKernels::FAdd) return static_cast<T>(x + y);
+    if constexpr (OP == VectorKernels::Sub || OP == VectorKernels::FSub) return static_cast<T>(x - y);
+    if constexpr (OP == VectorKernels::Mul) return static_cast<T>(static_cast<uint64_t>(x) * y);
+    if constexpr (OP == VectorKernels::FMul) return x * y;
+    if constexpr (OP == VectorKernels::And) return x & y;
+    if constexpr (OP == VectorKernels::Orr) return x | y;
+    if constexpr (OP == VectorKernels::Eor) return x ^ y;
+}
+
+template <typename T, Op OP>
+void scalar_binary(VectorRegister& d, const VectorRegister& n, const VectorRegister& m) {
+    VectorRegister result;
+    for (size_t i = 0; i < 16 / sizeof(T); ++i) {
+        result.set<T>(i, apply<T, OP>(n.get<T>(i), m.get<T>(i)));
+    }
+    d = result;
+}
+
+void scalar_tbl(VectorRegister& d, const VectorRegister& n, const VectorRegister& m) {
+    VectorRegister result;
+    for (size_t i = 0; i < 16; ++i) {
+        result.bytes[i] = m.bytes[i] < 16 ? n.bytes[m.bytes[i]] : 0;
+    }
+    d = result;
+}
+
+void scalar_ext(VectorRegister& d, const VectorRegister& n, const VectorRegister& m, unsigned index) {
+    VectorRegister result;
+    for (size_t i = 0; i < 16; ++i) {
+        size_t from = i + index;
+        result.bytes[i] = from < 16 ? n.bytes[from] : m.bytes[from - 16];
+    }
+    d = result;
+}
+
+template <typename T>
+void scalar_dup(VectorRegister& d, uint64_t value) {
+    for (size_t i = 0; i < 16 / sizeof(T); ++i) {
+        d.set<T>(i, static_cast<T>(value));
+    }
+}
+
+template <typename T, Reduction R>
+void scalar_reduce(VectorRegister& d, const VectorRegister& n) {
+    T result = n.get<T>(0);
+    for (size_t i = 1; i < 16 / sizeof(T); ++i) {
+        T x = n.get<T>(i);
+        if constexpr (R == VectorKernels::AddV) result = static_cast<T>(result + x);
+        if constexpr (R == VectorKernels::UMaxV) result = x > result ? x : result;
+        if constexpr (R == VectorKernels::UMinV) result = x < result ? x : result;
+    }
+    d = VectorRegister{};
+    d.set<T>(0, result);
+}
+
+constexpr VectorKernels scalar_kernels = {
+    {
+        {scalar_binary<uint8_t, VectorKernels::Add>, scalar_binary<uint16_t, VectorKernels::Add>,
+         scalar_binary<uint32_t, VectorKernels::Add>, scalar_binary<uint64_t, VectorKernels::Add>},
+        {scalar_binary<uint8_t, VectorKernels::Sub>, scalar_binary<uint16_t, VectorKernels::Sub>,
+         scalar_binary<uint32_t, VectorKernels::Sub>, scalar_binary<uint64_t, VectorKernels::Sub>},
+        {scalar_binary<uint8_t, VectorKernels::Mul>, scalar_binary<uint16_t, VectorKernels::Mul>,
+         scalar_binary<uint32_t, VectorKernels::Mul>, nullptr},
+        {scalar_binary<uint64_t, VectorKernels::And>, nullptr, nullptr, nullptr},
+        {scalar_binary<uint64_t, VectorKernels::Orr>, nullptr, nullptr, nullptr},
+        {scalar_binary<uint64_t, VectorKernels::Eor>, nullptr, nullptr, nullptr},
+        {nullptr, nullptr, scalar_binary<float, VectorKernels::FAdd>, scalar_binary<double, VectorKernels::FAdd>},
+        {nullptr, nullptr, scalar_binary<float, VectorKernels::FSub>, scalar_binary<double, VectorKernels::FSub>},
+        {nullptr, nullptr, scalar_binary<float, VectorKernels::FMul>, scalar_binary<double, VectorKernels::FMul>},
+        {scalar_tbl, nullptr, nullptr, nullptr},
+    },
+    {
+        {scalar_reduce<uint8_t, VectorKernels::AddV>, scalar_reduce<uint16_t, VectorKernels::AddV>,
+         scalar_reduce<uint32_t, VectorKernels::AddV>, nullptr},
+        {scalar_reduce<uint8_t, VectorKernels::UMaxV>, scalar_reduce<uint16_t, VectorKernels::UMaxV>,
+         scalar_reduce<uint32_t, VectorKernels::UMaxV>, nullptr},
+        {scalar_reduce<uint8_t, VectorKernels::UMinV>, scalar_reduce<uint16_t, VectorKernels::UMinV>,
+         scalar_reduce<uint32_t, VectorKernels::UMinV>, nullptr},
+    },
+    {scalar_dup<uint8_t>, scalar_dup<uint16_t>, scalar_dup<uint32_t>, scalar_dup<uint64_t>},
+    scalar_ext,
+};
+
+#ifdef ARM_EMULATOR_X86_KERNELS
+
+// SSE4.1 kernels: each instruction is a handful of host vector instructions
+
+ARM_EMULATOR_TARGET_SSE41 inline __m128i load(const VectorRegister& v) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(v.bytes));
+}
+
+ARM_EMULATOR_TARGET_SSE41 inline void store(VectorRegister& v, __m128i value) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(v.bytes), value);
+}
+
+template <unsigned ESIZE>
+ARM_EMULATOR_TARGET_SSE41 inline __m128i sse_add(__m128i x, __m128i y) {
+    if constexpr (ESIZE == 0) return _mm_add_epi8(x, y);
+    if constexpr (ESIZE == 1) return _mm_add_epi16(x, y);
+    if constexpr (ESIZE == 2) return _mm_add_epi32(x, y);
+    if constexpr (ESIZE == 3) return _mm_add_epi64(x, y);
+}
+
+template <unsigned ESIZE>
+ARM_EMULATOR_TARGET_SSE41 inline __m128i sse_sub(__m128i x, __m128i y) {
+    if constexpr (ESIZE == 0) return _mm_sub_epi8(x, y);
+    if constexpr (ESIZE == 1) return _mm_sub_epi16(x, y);
+    if constexpr (ESIZE == 2) return _mm_sub_epi32(x, y);
+    if constexpr (ESIZE == 3) return _mm_sub_epi64(x, y);
+}
+
+template <unsigned ESIZE>
+ARM_EMULATOR_TARGET_SSE41 inline __m128i sse_mul(__m128i x, __m128i y) {
+    if constexpr (ESIZE == 0) {
+        // No byte multiply: multiply the even and odd bytes as 16-bit lanes
+        // and keep the low byte of each product
+        __m128i low_bytes = _mm_set1_epi16(0x00FF);
+        __m128i even = _mm_and_si128(_mm_mullo_epi16(x, y), low_bytes);
+        __m128i odd = _mm_slli_epi16(_mm_mullo_epi16(_mm_srli_epi16(x, 8), _mm_srli_epi16(y, 8)), 8);
+        return _mm_or_si128(even, odd);
+    }
+    if constexpr (ESIZE == 1) return _mm_mullo_epi16(x, y);
+    if constexpr (ESIZE == 2) return _mm_mullo_epi32(x, y);
+}
+
+template <Op OP, unsigned ESIZE>
+ARM_EMULATOR_TARGET_SSE41 void sse_binary(VectorRegister& d, const VectorRegister& n,
+                                          const VectorRegister& m) {
+    __m128i x = load(n);
+    __m128i y = load(m);
+    if constexpr (OP == VectorKernels::Add) store(d, sse_add<ESIZE>(x, y));
+    if constexpr (OP == VectorKernels::Sub) store(d, sse_sub<ESIZE>(x, y));
+    if constexpr (OP == VectorKernels::Mul) store(d, sse_mul<ESIZE>(x, y));
+    if constexpr (OP == VectorKernels::And) store(d, _mm_and_si128(x, y));
+    if constexpr (OP == VectorKernels::Orr) store(d, _mm_or_si128(x, y));
+    if constexpr (OP == VectorKernels::Eor) store(d, _mm_xor_si128(x, y));
+}
+
+template <Op OP>
+ARM_EMULATOR_TARGET_SSE41 void sse_float(VectorRegister& d, const VectorRegister& n,
+                                         const VectorRegister& m) {
+    __m128 x = _mm_castsi128_ps(load(n));
+    __m128 y = _mm_castsi128_ps(load(m));
+    if constexpr (OP == VectorKernels::FAdd) store(d, _mm_castps_si128(_mm_add_ps(x, y)));
+    if constexpr (OP == VectorKernels::FSub) store(d, _mm_castps_si128(_mm_sub_ps(x, y)));
+    if constexpr (OP == VectorKernels::FMul) store(d, _mm_castps_si128(_mm_mul_ps(x, y)));
+}
+
+template <Op OP>
+ARM_EMULATOR_TARGET_SSE41 void sse_double(VectorRegister& d, const VectorRegister& n,
+                                          const VectorRegister& m) {
+    __m128d x = _mm_castsi128_pd(load(n));
+    __m128d y = _mm_castsi128_pd(load(m));
+    if constexpr (OP == VectorKernels::FAdd) store(d, _mm_castpd_si128(_mm_add_pd(x, y)));
+    if constexpr (OP == VectorKernels::FSub) store(d, _mm_castpd_si128(_mm_sub_pd(x, y)));
+    if constexpr (OP == VectorKernels::FMul) store(d, _mm_castpd_si128(_mm_mul_pd(x, y)));
+}
+
+ARM_EMULATOR_TARGET_SSE41 void sse_tbl(VectorRegister& d, const VectorRegister& n,
+                                       const VectorRegister& m) {
+    // pshufb zeroes bytes whose index has bit 7 set; set it for indices 16-127 too
+    __m128i index = load(m);
+    __m128i out_of_range = _mm_cmpgt_epi8(index, _mm_set1_epi8(15));
+    store(d, _mm_shuffle_epi8(load(n), _mm_or_si128(index, out_of_range)));
+}
+
+ARM_EMULATOR_TARGET_SSE41 void sse_ext(VectorRegister& d, const VectorRegister& n,
+                                       const VectorRegister& m, unsigned index) {
+    // Byte i comes from position i + index of Vm:Vn; shuffle each half with
+    // the positions outside it marked out of range
+    __m128i from = _mm_add_epi8(_mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+                                _mm_set1_epi8(static_cast<char>(index)));
+    __m128i from_n = _mm_or_si128(from, _mm_cmpgt_epi8(from, _mm_set1_epi8(15)));
+    __m128i from_m = _mm_sub_epi8(from, _mm_set1_epi8(16));
+    store(d, _mm_or_si128(_mm_shuffle_epi8(load(n), from_n), _mm_shuffle_epi8(load(m), from_m)));
+}
+
+template <unsigned ESIZE>
+ARM_EMULATOR_TARGET_SSE41 void sse_dup(VectorRegister& d, uint64_t value) {
+    if constexpr (ESIZE == 0) store(d, _mm_set1_epi8(static_cast<char>(value)));
+    if constexpr (ESIZE == 1) store(d, _mm_set1_epi16(static_cast<short>(value)));
+    if constexpr (ESIZE == 2) store(d, _mm_set1_epi32(static_cast<int>(value)));
+    if constexpr (ESIZE == 3) store(d, _mm_set1_epi64x(static_cast<long long>(value)));
+}
+
+template <Reduction R>
+ARM_EMULATOR_TARGET_SSE41 inline __m128i combine32(__m128i x, __m128i y) {
+    if constexpr (R == VectorKernels::AddV) return _mm_add_epi32(x, y);
+    if constexpr (R == VectorKernels::UMaxV) return _mm_max_epu32(x, y);
+    if constexpr (R == VectorKernels::UMinV) return _mm_min_epu32(x, y);
+}
+
+// Fold the upper 64 and then 32 bits onto the lowest 32-bit lane
+template <Reduction R>
+ARM_EMULATOR_TARGET_SSE41 inline uint32_t fold32(__m128i v) {
+    v = combine32<R>(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = combine32<R>(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(v));
+}
+
+template <unsigned ESIZE>
+ARM_EMULATOR_TARGET_SSE41 void sse_addv(VectorRegister& d, const VectorRegister& n) {
+    __m128i v = load(n);
+    uint32_t sum = 0;
+    if constexpr (ESIZE == 0) {
+        // psadbw against zero sums each half's bytes
+        __m128i halves = _mm_sad_epu8(v, _mm_setzero_si128());
+        sum = static_cast<uint8_t>(_mm_cvtsi128_si32(_mm_add_epi64(halves, _mm_unpackhi_epi64(halves, halves))));
+    } else {
+        if constexpr (ESIZE == 1) {
+            // Pairwise sums into 32-bit lanes; only the low 16 bits matter
+            v = _mm_madd_epi16(v, _mm_set1_epi16(1));
+        }
+        sum = fold32<VectorKernels::AddV>(v);
+        if constexpr (ESIZE == 1) sum &= 0xFFFF;
+    }
+    store(d, _mm_cvtsi32_si128(static_cast<int>(sum)));
+}
+
+template <Reduction R, unsigned ESIZE>
+ARM_EMULATOR_TARGET_SSE41 void sse_minmax(VectorRegister& d, const VectorRegister& n) {
+    // phminposuw finds the minimum of eight unsigned 16-bit lanes; maxima are
+    // minima of the complement, and bytes are first reduced pairwise into
+    // 16-bit lanes
+    constexpr bool max = R == VectorKernels::UMaxV;
+    __m128i v = load(n);
+    uint32_t result = 0;
+    if constexpr (ESIZE == 0 || ESIZE == 1) {
+        __m128i ones = _mm_set1_epi8(-1);
+        if constexpr (max) v = _mm_xor_si128(v, ones);
+        if constexpr (ESIZE == 0) {
+            // The high byte of each lane becomes min(high, 0) = 0
+            v = _mm_min_epu8(v, _mm_srli_epi16(v, 8));
+        }
+        result = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_minpos_epu16(v))) & 0xFFFF;
+        if constexpr (max) result = ~result & (ESIZE == 0 ? 0xFFu : 0xFFFFu);
+    } else {
+        result = fold32<R>(v);
+    }
+    store(d, _mm_cvtsi32_si128(static_cast<int>(result)));
+}
+
+constexpr VectorKernels sse41_kernels = {
+    {
+        {sse_binary<VectorKernels::Add, 0>, sse_binary<VectorKernels::Add, 1>,
+         sse_binary<VectorKernels::Add, 2>, sse_binary<VectorKernels::Add, 3>},
+        {sse_binary<VectorKernels::Sub, 0>, sse_binary<VectorKernels::Sub, 1>,
+         sse_binary<VectorKernels::Sub, 2>, sse_binary<VectorKernels::Sub, 3>},
+        {sse_binary<VectorKernels::Mul, 0>, sse_binary<VectorKernels::Mul, 1>,
+         sse_binary<VectorKernels::Mul, 2>, nullptr},
+        {sse_binary<VectorKernels::And, 0>, nullptr, nullptr, nullptr},
+        {sse_binary<VectorKernels::Orr, 0>, nullptr, nullptr, nullptr},
+        {sse_binary<VectorKernels::Eor, 0>, nullptr, nullptr, nullptr},
+        {nullptr, nullptr, sse_float<VectorKernels::FAdd>, sse_double<VectorKernels::FAdd>},
+        {nullptr, nullptr, sse_float<VectorKernels::FSub>, sse_double<VectorKernels::FSub>},
+        {nullptr, nullptr, sse_float<VectorKernels::FMul>, sse_double<VectorKernels::FMul>},
+        {sse_tbl, nullptr, nullptr, nullptr},
+    },
+    {
+        {sse_addv<0>, sse_addv<1>, sse_addv<2>, nullptr},
+        {sse_minmax<VectorKernels::UMaxV, 0>, sse_minmax<VectorKernels::UMaxV, 1>,
+         sse_minmax<VectorKernels::UMaxV, 2>, nullptr},
+        {sse_minmax<VectorKernels::UMinV, 0>, sse_minmax<VectorKernels::UMinV, 1>,
+         sse_minmax<VectorKernels::UMinV, 2>, nullptr},
+    },
+    {sse_dup<0>, sse_dup<1>, sse_dup<2>, sse_dup<3>},
+    sse_ext,
+};
+
+#endif
+
+} // namespace
+
+bool VectorKernels::is_supported(Set set) noexcept {
+    switch (set) {
+        case Set::Scalar:
+            return true;
+#ifdef ARM_EMULATOR_X86_KERNELS
+        case Set::SSE41:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("ssse3");
+#endif
+        default:
+            return false;
+    }
+}
+
+VectorKernels::Set VectorKernels::best_set() noexcept {
+    return is_supported(Set::SSE41) ? Set::SSE41 : Set::Scalar;
+}
+
+const char* VectorKernels::to_string(Set set) noexcept {
+    switch (set) {
+        case Set::Scalar: return "scalar";
+        case Set::SSE41: return "sse4.1";
+    }
+    return "unknown";
+}
+
+const VectorKernels& VectorKernels::get(Set set) noexcept {
+    switch (set) {
+#ifdef ARM_EMULATOR_X86_KERNELS
+        case Set::SSE41: return sse41_kernels;
+#endif
+        default: return scalar_kernels;
+    }
+}
+
+const VectorKernels& VectorKernels::host() noexcept {
+    static const VectorKernels& kernels = get(best_set());
+    return kernels;
+}
+
+} // namespace arm_emulator
@@ -0,0 +1,149 @@
+// Batch jobs run on a thread pool must finish exactly as they would one at
+// a time, and come back in job order.
+#include "test_support.hpp"
+
+#include "batch_runner.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+using namespace arm_emulator;
+using namespace arm_test;
+using namespace arm_test::encode;
+
+namespace {
+
+constexpr const char* IMAGE_PATH = "test_batch.bin";
+constexpr size_t JOBS = 64;
+
+// X4 = Z ? X2 : X3 from the job's NZCV, then mixes X2 and X3 X1 times
+std::vector<uint32_t> program() {
+    return {
+        csel(4, 2, 3, 0),
+        add(3, 3, 2),       // loop:
+        eor(2, 2, 3),
+        subi(1, 1, 1),
+        cbnz(1, -3),
+        halt(),
+    };
+}
+
+void write_image() {
+    std::vector<uint8_t> bytes = to_bytes(program());
+    std::ofstream out(IMAGE_PATH, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+}
+
+// Job lines with distinct inputs. The first quarter loops far longer, so
+// the worker dealt them falls behind and the others steal from it. Some
+// jobs run out of budget, and one names an image that does not exist.
+std::string job_file(std::mt19937_64& rng) {
+    std::ostringstream text;
+    text << "# Generated by test_batch\n\n";
+    for (size_t i = 0; i < JOBS; ++i) {
+        uint64_t trips = i < JOBS / 4 ? 50000 + i : 1 + i;
+        text << (i == 37 ? "missing.bin" : IMAGE_PATH);
+        if (i % 5 == 0) text << " 0x500000";
+        text << " X1=" << trips << " x2=0x" << std::hex << rng() << std::dec << " X3=" << rng();
+        if (i % 3 == 0) text << (i % 2 ? " nzcv=0x40000000" : " NZCV=0x20000000");
+        if (i % 7 == 0) text << " max=" << 3 * trips;
+        text << "\n";
+    }
+    return text.str();
+}
+
+// The job run on its own, by the switch interpreter
+BatchResult run_alone(const BatchJob& job) {
+    BatchResult result;
+    CPU cpu;
+    if (!cpu.load_program_file(job.image, job.load_address)) return result;
+    for (const auto& [index, value] : job.registers) {
+        cpu.get_registers().set_register(index, value);
+    }
+    RunResult run = cpu.run_for(job.max_instructions);
+    result.reason = run.reason;
+    result.instructions = run.instructions;
+    result.registers = cpu.get_registers();
+    return result;
+}
+
+void check_parallel(const std::vector<BatchJob>& jobs, const std::vector<BatchResult>& expected) {
+    for (ExecutionEngine engine : {ExecutionEngine::Switch, ExecutionEngine::Jit}) {
+        for (unsigned threads : {1u, 4u, 7u}) {
+            BatchRunner runner(threads, engine);
+            std::vector<BatchResult> results = runner.run(jobs);
+            CHECK_EQ(results.size(), jobs.size());
+            for (size_t i = 0; i < jobs.size() && i < results.size(); ++i) {
+                bool same = results[i].reason == expected[i].reason &&
+                            results[i].instructions == expected[i].instructions &&
+                            results[i].registers.to_string() == expected[i].registers.to_string();
+                CHECK(same);
+                if (!same) {
+                    std::cout << "  job " << i << " differs with " << threads << " threads on engine "
+                              << static_cast<int>(engine) << "\n";
+                }
+            }
+        }
+    }
+}
+
+void check_jobs() {
+    std::mt19937_64 rng(7);
+    std::istringstream text(job_file(rng));
+    std::vector<BatchJob> jobs = read_batch_jobs(text);
+    CHECK_EQ(jobs.size(), JOBS);
+    CHECK_EQ(jobs[5].load_address, uint64_t{0x500000});
+    CHECK_EQ(jobs[6].load_address, uint64_t{0x400000});
+    CHECK_EQ(jobs[21].max_instructions, uint64_t{3 * 22});
+    CHECK_EQ(jobs[3].registers.back().first, static_cast<size_t>(SpecialRegister::NZCV));
+    CHECK_EQ(jobs[3].registers.back().second, uint64_t{0x40000000});
+
+    std::vector<BatchResult> expected;
+    for (const BatchJob& job : jobs) {
+        expected.push_back(run_alone(job));
+    }
+    CHECK(expected[0].reason == StopReason::InstructionLimit);
+    CHECK(expected[1].reason == StopReason::Halted);
+    CHECK(expected[37].reason == StopReason::LoadFailed);
+    // NZCV reached the CSEL: Z set selects X2, clear selects X3
+    CHECK_EQ(expected[3].registers.get_register(4), jobs[3].registers[1].second);
+    CHECK_EQ(expected[6].registers.get_register(4), jobs[6].registers[2].second);
+
+    check_parallel(jobs, expected);
+}
+
+void check_malformed() {
+    const char* lines[] = {
+        "image.bin 0x1000 0x2000",  // Two load addresses
+        "image.bin max=0x1000 0x2000",
+        "image.bin X31=1",
+        "image.bin Q1=5",
+        "image.bin X1=",
+        "image.bin max=lots",
+        "image.bin NZCV=0x1g",
+    };
+    for (const char* line : lines) {
+        std::istringstream text(std::string("# comment\n\nimage.bin X1=1\n") + line + "\n");
+        std::string message;
+        try {
+            read_batch_jobs(text);
+        } catch (const std::runtime_error& e) {
+            message = e.what();
+        }
+        CHECK(message.find("line 4") != std::string::npos);
+        if (message.empty()) std::cout << "  accepted \"" << line << "\"\n";
+    }
+}
+
+} // namespace
+
+int main() {
+    write_image();
+    check_jobs();
+    check_malformed();
+    std::remove(IMAGE_PATH);
+    return test_result();
+}
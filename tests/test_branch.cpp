@@ -0,0 +1,151 @@
+// Branch predictors must mispredict exactly as their counters and histories
+// say, and the branch model must keep its return-address stack straight.
+#include "test_support.hpp"
+
+#include "branch_predictor.hpp"
+
+#include <string>
+
+using namespace arm_emulator;
+using namespace arm_test;
+using namespace arm_test::encode;
+
+namespace {
+
+constexpr uint64_t PC = 0x400000;
+
+// Runs the outcomes ("T" taken, "N" not) at pc, repeated times, and returns
+// how many of the last `counted` were mispredicted
+uint64_t mispredicts(BranchPredictor& predictor, uint64_t pc, const std::string& pattern,
+                     size_t repeat, size_t counted) {
+    size_t total = pattern.size() * repeat;
+    uint64_t count = 0;
+    for (size_t i = 0; i < total; ++i) {
+        bool taken = pattern[i % pattern.size()] == 'T';
+        bool wrong = predictor.predict(pc) != taken;
+        predictor.update(pc, taken);
+        if (i >= total - counted) count += wrong;
+    }
+    return count;
+}
+
+std::string loop_exit(size_t trips) { return std::string(trips - 1, 'T') + "N"; }
+
+// Counters start weakly not taken and saturate at both ends
+void check_bimodal() {
+    BimodalPredictor bimodal(4);
+    CHECK_EQ(mispredicts(bimodal, PC, "TTTNT", 1, 5), uint64_t{2});
+    CHECK_EQ(mispredicts(bimodal, PC, "NNNN", 1, 4), uint64_t{2});
+    CHECK_EQ(mispredicts(bimodal, PC, "TTT", 1, 3), uint64_t{2});
+
+    // 16 counters: branches 16 instructions apart share one
+    BimodalPredictor aliased(4);
+    mispredicts(aliased, PC, "TT", 1, 0);
+    CHECK(aliased.predict(PC + 16 * 4));
+    CHECK(!aliased.predict(PC + 4));
+
+    // Alternating outcomes defeat a counter; a loop exit costs one per trip
+    BimodalPredictor alternating(4);
+    CHECK_EQ(mispredicts(alternating, PC, "TN", 50, 100), uint64_t{100});
+    BimodalPredictor loop(4);
+    CHECK_EQ(mispredicts(loop, PC, "TTN", 30, 90), uint64_t{31});
+}
+
+// Global history separates the outcomes a lone counter cannot
+void check_gshare() {
+    // Histories 0, 1, 2, 5 and 10 each start weakly not taken, so the first
+    // taken outcomes at 0, 2 and 10 are mispredicted; after that 5 and 10
+    // alternate and agree
+    GsharePredictor gshare(4, 4);
+    CHECK_EQ(mispredicts(gshare, 0, "TN", 50, 100), uint64_t{3});
+
+    GsharePredictor loop(8, 8);
+    mispredicts(loop, PC, loop_exit(6), 20, 0);
+    CHECK_EQ(mispredicts(loop, PC, loop_exit(6), 20, 120), uint64_t{0});
+
+    // A loop exit further back than the history looks like any other trip
+    GsharePredictor short_history(8, 4);
+    mispredicts(short_history, PC, loop_exit(8), 20, 0);
+    CHECK_EQ(mispredicts(short_history, PC, loop_exit(8), 20, 160), uint64_t{20});
+}
+
+// Mispredictions allocate in tables with longer history until one
+// separates the outcomes
+void check_tage() {
+    TagePredictor tage;
+    mispredicts(tage, PC, "TN", 50, 0);
+    CHECK_EQ(mispredicts(tage, PC, "TN", 50, 100), uint64_t{0});
+
+    // An exit after 12 trips needs the 11-bit table or longer
+    TagePredictor loop;
+    mispredicts(loop, PC, loop_exit(12), 100, 0);
+    CHECK_EQ(mispredicts(loop, PC, loop_exit(12), 50, 600), uint64_t{0});
+    BimodalPredictor bimodal;
+    mispredicts(bimodal, PC, loop_exit(12), 100, 0);
+    CHECK_EQ(mispredicts(bimodal, PC, loop_exit(12), 50, 600), uint64_t{50});
+}
+
+// Returns predicted from a two-entry stack: the first is popped from empty,
+// the third call overwrites the oldest entry, and popping past the two
+// kept entries underflows again
+void check_return_stack() {
+    BranchModel model(BranchPredictor::create("bimodal"), 2);
+    model.on_branch(Opcode::RET, 0x500, 0x104);
+    CHECK_EQ(model.mispredicted(), uint64_t{1});
+
+    model.on_branch(Opcode::BL, 0x100, 0x1000);
+    model.on_branch(Opcode::BL, 0x200, 0x2000);
+    model.on_branch(Opcode::BLR, 0x300, 0x3000);  // Indirect, with no target yet
+    CHECK_EQ(model.mispredicted(), uint64_t{2});
+    model.on_branch(Opcode::RET, 0x3010, 0x304);
+    model.on_branch(Opcode::RET, 0x2010, 0x204);
+    CHECK_EQ(model.mispredicted(), uint64_t{2});
+    model.on_branch(Opcode::RET, 0x1010, 0x104);
+    CHECK_EQ(model.mispredicted(), uint64_t{3});
+
+    // A return elsewhere than the call site is mispredicted, and pops it
+    model.on_branch(Opcode::BL, 0x400, 0x4000);
+    model.on_branch(Opcode::RET, 0x4010, 0x800);
+    model.on_branch(Opcode::RET, 0x4020, 0x404);
+    CHECK_EQ(model.mispredicted(), uint64_t{5});
+    CHECK_EQ(model.executed(), uint64_t{10});
+
+    // Indirect branches are predicted to go where they went last time
+    model.on_branch(Opcode::BR, 0x600, 0x6000);
+    model.on_branch(Opcode::BR, 0x600, 0x6000);
+    model.on_branch(Opcode::BR, 0x600, 0x7000);
+    CHECK_EQ(model.mispredicted(), uint64_t{7});
+}
+
+// on_retire classifies instructions by their word and skips non-branches
+void check_retired_words() {
+    BranchModel model(BranchPredictor::create("bimodal:4"));
+    RetiredInstruction retired;
+    retired.pc = PC;
+    retired.word = addi(1, 1, 1);
+    retired.next_pc = PC + 4;
+    model.on_retire(retired);
+    CHECK_EQ(model.executed(), uint64_t{0});
+
+    retired.word = cbnz(1, -4);
+    for (int i = 0; i < 4; ++i) {
+        retired.next_pc = PC - 16;
+        model.on_retire(retired);
+    }
+    retired.word = b_cond(0, 2);
+    retired.next_pc = PC + 4;
+    model.on_retire(retired);
+    CHECK_EQ(model.executed(), uint64_t{5});
+    CHECK_EQ(model.mispredicted(), uint64_t{2});  // The first trip and the exit
+}
+
+} // namespace
+
+int main() {
+    check_bimodal();
+    check_gshare();
+    check_tage();
+    check_return_stack();
+    check_retired_words();
+    return test_result();
+}
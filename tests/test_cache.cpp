@@ -0,0 +1,170 @@
+// The cache model must pick the victims its replacement policy says, write
+// back exactly the dirty lines it evicts, and reject malformed configurations.
+#include "test_support.hpp"
+
+#include "cache_model.hpp"
+
+#include <stdexcept>
+
+using namespace arm_emulator;
+using namespace arm_test;
+
+namespace {
+
+// 2 sets x 2 ways of 64-byte lines. Lines alternate between the sets, so
+// these four addresses all map to set 0 and the fifth to set 1.
+constexpr const char* SMALL = "256:2:64";
+constexpr uint64_t A = 0x000;
+constexpr uint64_t B = 0x080;
+constexpr uint64_t C = 0x100;
+constexpr uint64_t D = 0x180;
+constexpr uint64_t OTHER_SET = 0x040;
+
+Cache small_cache(const char* policy) {
+    return Cache(CacheConfig::parse(std::string(SMALL) + ":" + policy));
+}
+
+bool hit(Cache& cache, uint64_t address, bool write = false) {
+    return cache.access(address, write).hit;
+}
+
+// LRU evicts the line used longest ago; a hit refreshes it
+void check_lru() {
+    Cache cache = small_cache("lru");
+    CHECK(!hit(cache, A));
+    CHECK(!hit(cache, B));
+    CHECK(hit(cache, A));
+    CHECK(!hit(cache, OTHER_SET));  // Set 1 does not disturb set 0
+    CHECK(!hit(cache, C));          // Evicts B
+    CHECK(hit(cache, A));
+    CHECK(hit(cache, C));
+    CHECK(!hit(cache, B));          // Evicts A
+    CHECK(!hit(cache, A));          // Evicts C
+    CHECK(hit(cache, B));
+    CHECK(hit(cache, OTHER_SET));
+    CHECK_EQ(cache.hits, uint64_t{5});
+    CHECK_EQ(cache.misses, uint64_t{6});
+    CHECK_EQ(cache.writebacks, uint64_t{0});
+}
+
+// FIFO evicts the line filled longest ago, however recently it was used
+void check_fifo() {
+    Cache cache = small_cache("fifo");
+    CHECK(!hit(cache, A));
+    CHECK(!hit(cache, B));
+    CHECK(hit(cache, A));
+    CHECK(!hit(cache, C));  // Evicts A despite the hit
+    CHECK(hit(cache, B));
+    CHECK(!hit(cache, A));  // Evicts B
+    CHECK(hit(cache, C));
+    CHECK(!hit(cache, B));  // Evicts C
+    CHECK_EQ(cache.hits, uint64_t{3});
+    CHECK_EQ(cache.misses, uint64_t{5});
+}
+
+// Random replacement still fills empty ways first
+void check_random() {
+    Cache cache = small_cache("random");
+    CHECK(!hit(cache, A, true));
+    Cache::Result second = cache.access(B, true);
+    CHECK(!second.hit && !second.writeback);
+    CHECK(hit(cache, A));
+    CHECK(hit(cache, B));
+    Cache::Result third = cache.access(C, false);
+    CHECK(!third.hit && third.writeback);
+    CHECK(third.victim_address == A || third.victim_address == B);
+    CHECK_EQ(cache.writebacks, uint64_t{1});
+}
+
+// Only dirty victims are written back, at the start of their line
+void check_writeback() {
+    Cache cache = small_cache("lru");
+    CHECK(!cache.access(A + 8, true).hit);  // Dirty on a write miss
+    CHECK(!hit(cache, B));
+    CHECK(hit(cache, B + 0x3F, true));      // Dirty on a write hit
+
+    Cache::Result evict_a = cache.access(C, false);
+    CHECK(!evict_a.hit);
+    CHECK(evict_a.writeback);
+    CHECK_EQ(evict_a.victim_address, A);
+
+    Cache::Result evict_b = cache.access(D, false);
+    CHECK(evict_b.writeback);
+    CHECK_EQ(evict_b.victim_address, B);
+
+    // C and D were only read
+    CHECK(!cache.access(A, false).writeback);
+    CHECK(!cache.access(B, false).writeback);
+    CHECK_EQ(cache.hits, uint64_t{1});
+    CHECK_EQ(cache.misses, uint64_t{6});
+    CHECK_EQ(cache.writebacks, uint64_t{2});
+}
+
+// Line-crossing accesses miss once per line, and L1 victims go to the L2
+void check_hierarchy() {
+    CacheHierarchy caches(CacheHierarchy::Config::parse("l1d=256:2:64,l2=4k:4:64"));
+    RetiredInstruction store;
+    store.pc = 0x1000;
+    store.memory = true;
+    store.write = true;
+    store.size = 8;
+    store.address = 0x3C;  // Lines 0x000 and 0x040
+    caches.on_retire(store);
+    CHECK_EQ(caches.l1d().misses, uint64_t{2});
+    CHECK_EQ(caches.l1i().misses, uint64_t{1});
+    CHECK_EQ(caches.l2().misses, uint64_t{3});
+
+    // Two more lines in set 0 evict the dirty line at 0
+    store.write = false;
+    for (uint64_t address : {B, C}) {
+        store.address = address;
+        caches.on_retire(store);
+    }
+    CHECK_EQ(caches.l1d().writebacks, uint64_t{1});
+    CHECK_EQ(caches.l2().misses, uint64_t{5});
+    CHECK_EQ(caches.l2().hits, uint64_t{1});  // The writeback; fetches hit in the L1I
+}
+
+template <typename Parse>
+void check_rejected(const std::string& spec, Parse parse) {
+    bool threw = false;
+    try {
+        parse(spec);
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+    CHECK(threw);
+    if (!threw) std::cout << "  accepted \"" << spec << "\"\n";
+}
+
+void check_parse() {
+    CacheConfig config = CacheConfig::parse("32k:8:64:fifo");
+    CHECK_EQ(config.size, uint64_t{32 * 1024});
+    CHECK_EQ(config.associativity, 8u);
+    CHECK_EQ(config.line_size, 64u);
+    CHECK(config.policy == ReplacementPolicy::FIFO);
+    config = CacheConfig::parse("2M:16:128");
+    CHECK_EQ(config.size, uint64_t{2} << 20);
+    CHECK(config.policy == ReplacementPolicy::LRU);
+
+    auto make_cache = [](const std::string& spec) { Cache cache(CacheConfig::parse(spec)); };
+    for (const char* spec : {"", "32k:8", "32k:8:64:lru:x", "32q:8:64", "k:8:64", "32k:eight:64",
+                             "32k:8:64:mru", "32k:8:48", "96k:8:64", "32k:0:64", "64:2:64"}) {
+        check_rejected(spec, make_cache);
+    }
+    for (const char* spec : {"l3=32k:8:64", "l1d", "l1d=32k:8", "region=3000"}) {
+        check_rejected(spec, [](const std::string& text) { CacheHierarchy::Config::parse(text); });
+    }
+}
+
+} // namespace
+
+int main() {
+    check_lru();
+    check_fifo();
+    check_random();
+    check_writeback();
+    check_hierarchy();
+    check_parse();
+    return test_result();
+}
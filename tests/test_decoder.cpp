@@ -0,0 +1,24 @@
+// The table-driven decoder must agree with the field-by-field reference
+// decoder. A sample of the encoding space is checked by default;
+// --exhaustive checks all 2^32 words, as `arm_bench --verify-decoder` does.
+#include "test_support.hpp"
+
+#include "benchmark.hpp"
+
+#include <string>
+
+using namespace arm_test;
+
+namespace {
+
+// Prime, so the sample covers every op0 group with varied low bits
+constexpr uint32_t SAMPLE_STRIDE = 251;
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    bool exhaustive = argc > 1 && std::string(argv[1]) == "--exhaustive";
+    uint64_t mismatches = arm_bench::verify_decoder(std::cout, 20, exhaustive ? 1 : SAMPLE_STRIDE);
+    CHECK_EQ(mismatches, uint64_t{0});
+    return test_result();
+}
@@ -0,0 +1,246 @@
+// Every execution engine, and lockstep execution, must leave the machine in
+// the same state as the switch interpreter on the same program.
+#include "test_support.hpp"
+
+#include "decoder.hpp"
+#include "lockstep.hpp"
+
+#include <random>
+
+using namespace arm_emulator;
+using namespace arm_test;
+using namespace arm_test::encode;
+
+namespace {
+
+constexpr uint64_t CODE = 0x400000;
+constexpr uint64_t DATA = 0x800000;
+constexpr uint64_t DATA_SIZE = 0x3000;
+
+// X1-X12 hold data, X20-X23 point into DATA and X28 counts loop iterations
+constexpr uint32_t STORE_BASE = 20;  // Stores at DATA + offset
+constexpr uint32_t LOAD_BASE = 21;   // Loads reach DATA + offset
+constexpr uint32_t VECTOR_BASE = 22;
+constexpr uint32_t VECTOR_CURSOR = 23;
+constexpr uint32_t COUNTER = 28;
+
+uint32_t data_register(std::mt19937_64& rng) { return 1 + static_cast<uint32_t>(rng() % 12); }
+uint32_t vector_register(std::mt19937_64& rng) { return static_cast<uint32_t>(rng() % 8); }
+
+uint32_t random_vector_instruction(std::mt19937_64& rng) {
+    for (;;) {
+        uint32_t rd = vector_register(rng), rn = vector_register(rng), rm = vector_register(rng);
+        uint32_t size = static_cast<uint32_t>(rng() % 4);
+        uint32_t word = 0;
+        switch (rng() % 6) {
+            case 0:
+            case 1:
+                // EXT takes its index from the size field and bits 12-13
+                word = simd(0, static_cast<uint32_t>(rng() % 11), rd, rn, rm, size) |
+                       static_cast<uint32_t>(rng() % 4) << 12;
+                break;
+            case 2:
+                word = simd(1, 0, rd, data_register(rng), 0, size);  // DUP
+                break;
+            case 3:
+                word = simd(1, 1, data_register(rng), rn, 0, size) |  // UMOV
+                       static_cast<uint32_t>(rng() % 16) << 12;
+                break;
+            case 4:
+                word = simd(1, 2 + static_cast<uint32_t>(rng() % 3), rd, rn, 0, size);  // Reductions
+                break;
+            default: {
+                bool post_index = rng() % 2;
+                uint32_t base = post_index ? VECTOR_CURSOR : VECTOR_BASE;
+                word = rng() % 2 ? ld1(rd, base, post_index) : st1(rd, base, post_index);
+                break;
+            }
+        }
+        if (Decoder::decode(word).opcode != Opcode::INVALID) return word;
+    }
+}
+
+// A loop over a random body of ALU, flag, select, memory, SIMD and forward
+// conditional branch instructions, run X28 times
+std::vector<uint32_t> random_program(std::mt19937_64& rng, bool with_vectors) {
+    std::vector<uint32_t> body = {addi(VECTOR_CURSOR, VECTOR_BASE, 0)};
+    size_t length = 4 + rng() % 28;
+    while (body.size() < length) {
+        uint32_t rd = data_register(rng), rn = data_register(rng), rm = data_register(rng);
+        uint32_t value = static_cast<uint32_t>(rng() % 4096);
+        uint32_t offset = static_cast<uint32_t>(rng() % 512) * 8;
+        switch (rng() % (with_vectors ? 9 : 8)) {
+            case 0: {
+                uint32_t (*ops[])(uint32_t, uint32_t, uint32_t) = {and_, eor, sub, add, orr};
+                body.push_back(ops[rng() % 5](rd, rn, rm));
+                break;
+            }
+            case 1: {
+                uint32_t (*ops[])(uint32_t, uint32_t, uint32_t) = {addi, subi, andi, orri, subsi};
+                body.push_back(ops[rng() % 5](rd, rn, value));
+                break;
+            }
+            case 2: {
+                uint32_t (*ops[])(uint32_t, uint32_t, uint32_t) = {ands, subs, adds};
+                body.push_back(ops[rng() % 3](rd, rn, rm));
+                break;
+            }
+            case 3:
+                body.push_back(csel(rd, rn, rm, static_cast<uint32_t>(rng() % 15)));
+                break;
+            case 4:
+                body.push_back(ldur(rd, LOAD_BASE, offset));
+                break;
+            case 5:
+                body.push_back(stur(rn, STORE_BASE, offset));
+                break;
+            case 6:
+                // Skips one or two instructions; the loop tail is never skipped
+                body.push_back(b_cond(static_cast<uint32_t>(rng() % 15), 2 + static_cast<int32_t>(rng() % 2)));
+                break;
+            case 7:
+                body.push_back(rng() % 2 ? cbz(rn, 2) : cbnz(rn, 2));
+                break;
+            default:
+                body.push_back(random_vector_instruction(rng));
+                break;
+        }
+    }
+    body.push_back(addi(XZR, XZR, 0));  // Landing pad for skips at the end
+    body.push_back(addi(XZR, XZR, 0));
+    body.push_back(subi(COUNTER, COUNTER, 1));
+    body.push_back(cbnz(COUNTER, -static_cast<int32_t>(body.size())));
+    body.push_back(halt());
+    return body;
+}
+
+void set_up(CPU& cpu, const std::vector<uint32_t>& code, uint64_t seed, uint64_t iterations) {
+    cpu.load_program(to_bytes(code), CODE);
+    std::mt19937_64 rng(seed);
+    Registers& registers = cpu.get_registers();
+    for (size_t r = 1; r <= 12; ++r) registers.set_register(r, rng());
+    for (size_t v = 0; v < 8; ++v) {
+        for (uint8_t& byte : registers.vector(v).bytes) byte = static_cast<uint8_t>(rng());
+    }
+    registers.set_register(STORE_BASE, DATA);
+    registers.set_register(LOAD_BASE, DATA - 4096);
+    registers.set_register(VECTOR_BASE, DATA + 0x1000);
+    registers.set_register(COUNTER, iterations);
+    for (uint64_t offset = 0; offset < DATA_SIZE; offset += 8) {
+        cpu.get_memory().write64(DATA + offset, rng());
+    }
+}
+
+void dump(const std::vector<uint32_t>& code) {
+    for (uint32_t word : code) {
+        std::cout << "    " << Decoder::decode(word).to_string() << "\n";
+    }
+}
+
+// Single-CPU engines, each past the JIT's hot threshold
+void check_engines(std::mt19937_64& rng, int programs) {
+    for (int program = 0; program < programs; ++program) {
+        std::vector<uint32_t> code = random_program(rng, true);
+        uint64_t seed = rng();
+
+        CPU reference(Memory::DEFAULT_SIZE, ExecutionEngine::Switch);
+        set_up(reference, code, seed, 200);
+        RunResult expected = reference.run_for(1000000);
+        CHECK(expected.reason == StopReason::Halted);
+
+        for (ExecutionEngine engine : {ExecutionEngine::Threaded, ExecutionEngine::Block, ExecutionEngine::Jit}) {
+            CPU cpu(Memory::DEFAULT_SIZE, engine);
+            set_up(cpu, code, seed, 200);
+            RunResult result = cpu.run_for(1000000);
+            bool same = result.reason == expected.reason && result.instructions == expected.instructions &&
+                        state_of(cpu) == state_of(reference) &&
+                        memory_of(cpu, DATA, DATA_SIZE) == memory_of(reference, DATA, DATA_SIZE);
+            CHECK(same);
+            if (!same) {
+                std::cout << "  engine " << static_cast<int>(engine) << " differs on:\n";
+                dump(code);
+                return;
+            }
+        }
+    }
+}
+
+// Lanes with different inputs split and rejoin on the data-dependent branches
+void check_lockstep(std::mt19937_64& rng, int programs) {
+    constexpr size_t LANES = 8;
+    for (int program = 0; program < programs; ++program) {
+        std::vector<uint32_t> code = random_program(rng, program % 2 == 0);
+        std::vector<uint64_t> seeds(LANES);
+        for (uint64_t& seed : seeds) seed = rng();
+
+        LockstepEngine lockstep(LANES);
+        for (size_t lane = 0; lane < LANES; ++lane) {
+            set_up(lockstep.lane(lane), code, seeds[lane], 50);
+            lockstep.lane(lane).get_registers().set_pc(CODE);
+        }
+        std::vector<BatchResult> results = lockstep.run(1000000);
+
+        for (size_t lane = 0; lane < LANES; ++lane) {
+            CPU reference;
+            set_up(reference, code, seeds[lane], 50);
+            RunResult expected = reference.run_for(1000000);
+            bool same = results[lane].reason == expected.reason &&
+                        results[lane].instructions == expected.instructions &&
+                        state_of(lockstep.lane(lane)) == state_of(reference) &&
+                        memory_of(lockstep.lane(lane), DATA, DATA_SIZE) == memory_of(reference, DATA, DATA_SIZE);
+            CHECK(same);
+            if (!same) {
+                std::cout << "  lockstep lane " << lane << " differs on:\n";
+                dump(code);
+                return;
+            }
+        }
+    }
+}
+
+// A store into the loop body must drop the decoded instruction it replaces,
+// in every lane; lane 0 writes a different word and so has to leave
+void check_lockstep_self_modifying() {
+    constexpr size_t LANES = 4;
+    std::vector<uint32_t> code = {
+        addi(1, 1, 1),      // loop: rewritten by the STUR below
+        stur(6, 5, 0),
+        subi(28, 28, 1),
+        cbnz(28, -3),
+        halt(),
+    };
+    // The store is 8 bytes wide, so it writes itself back as the high half
+    auto set_up_lane = [&](CPU& cpu, size_t lane) {
+        cpu.load_program(to_bytes(code), CODE);
+        Registers& registers = cpu.get_registers();
+        uint32_t replacement = addi(1, 1, lane == 0 ? 7 : 100);
+        registers.set_register(5, CODE);
+        registers.set_register(6, static_cast<uint64_t>(code[1]) << 32 | replacement);
+        registers.set_register(28, 3);
+    };
+
+    LockstepEngine lockstep(LANES);
+    for (size_t lane = 0; lane < LANES; ++lane) {
+        set_up_lane(lockstep.lane(lane), lane);
+    }
+    std::vector<BatchResult> results = lockstep.run(1000);
+    for (size_t lane = 0; lane < LANES; ++lane) {
+        CPU reference;
+        set_up_lane(reference, lane);
+        RunResult expected = reference.run_for(1000);
+        CHECK(results[lane].reason == expected.reason);
+        CHECK_EQ(results[lane].instructions, expected.instructions);
+        CHECK(state_of(lockstep.lane(lane)) == state_of(reference));
+        CHECK_EQ(lockstep.lane(lane).get_registers().get_register(1), lane == 0 ? 15u : 201u);
+    }
+}
+
+} // namespace
+
+int main() {
+    std::mt19937_64 rng(2024);
+    check_engines(rng, 300);
+    check_lockstep(rng, 60);
+    check_lockstep_self_modifying();
+    return test_result();
+}
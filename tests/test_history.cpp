@@ -0,0 +1,167 @@
+// Stepping backwards must reproduce the state the CPU was in at that point.
+#include "test_support.hpp"
+
+#include "cache_model.hpp"
+#include "history.hpp"
+#include "trace.hpp"
+
+#include <cstdio>
+
+using namespace arm_emulator;
+using namespace arm_test;
+using namespace arm_test::encode;
+
+namespace {
+
+constexpr uint64_t CODE = 0x400000;
+constexpr uint64_t DATA = 0x800000;
+constexpr uint64_t DATA_SIZE = 0x800;
+constexpr uint64_t STEPS = 600;
+
+// Mixes X1-X3 with a table in memory, writing the results back, 100 times
+std::vector<uint32_t> program() {
+    return {
+        add(1, 1, 28),       // loop:
+        eor(2, 2, 1),
+        ldur(3, 21, 0),
+        adds(3, 3, 2),
+        stur(3, 20, 0),
+        addi(20, 20, 8),
+        addi(21, 21, 8),
+        subi(28, 28, 1),
+        cbnz(28, -8),
+        halt(),
+    };
+}
+
+void set_up(CPU& cpu) {
+    cpu.load_program(to_bytes(program()), CODE);
+    Registers& registers = cpu.get_registers();
+    registers.set_register(2, 0x5555AAAA5555AAAAULL);
+    registers.set_register(20, DATA);
+    registers.set_register(21, DATA - 4096);
+    registers.set_register(28, 100);
+}
+
+struct Recorded {
+    std::string registers;
+    std::string memory;
+};
+
+// Machine state after each of the first STEPS instructions, by single steps
+std::vector<Recorded> record_reference() {
+    CPU cpu;
+    set_up(cpu);
+    std::vector<Recorded> states;
+    states.push_back({state_of(cpu), memory_of(cpu, DATA, DATA_SIZE)});
+    for (uint64_t i = 0; i < STEPS && cpu.is_running(); ++i) {
+        cpu.step_instruction();
+        states.push_back({state_of(cpu), memory_of(cpu, DATA, DATA_SIZE)});
+    }
+    return states;
+}
+
+void check_step_back(ExecutionEngine engine, const std::vector<Recorded>& reference) {
+    CPU cpu(Memory::DEFAULT_SIZE, engine);
+    set_up(cpu);
+    ExecutionHistory history(cpu, 64, 4);
+    history.run_for(STEPS);
+    CHECK_EQ(history.position(), STEPS);
+
+    // Back in uneven strides, past several checkpoints and a thinning
+    for (uint64_t stride : {1, 7, 63, 64, 65, 150}) {
+        history.step_back(stride);
+        uint64_t at = history.position();
+        CHECK(state_of(cpu) == reference[at].registers);
+        CHECK(memory_of(cpu, DATA, DATA_SIZE) == reference[at].memory);
+    }
+
+    // Forward again from the middle of the history, then all the way back
+    history.run_for(100);
+    CHECK(state_of(cpu) == reference[history.position()].registers);
+    RunResult result = history.step_back(STEPS * 2);
+    CHECK(result.reason == StopReason::HistoryStart);
+    CHECK_EQ(history.position(), uint64_t{0});
+    CHECK(state_of(cpu) == reference[0].registers);
+    CHECK(memory_of(cpu, DATA, DATA_SIZE) == reference[0].memory);
+}
+
+void check_reverse_continue(const std::vector<Recorded>& reference) {
+    CPU cpu;
+    set_up(cpu);
+    ExecutionHistory history(cpu, 50);
+    history.run_for(STEPS);
+
+    // The STUR is instruction 4 of the 9-instruction loop, so it is next to
+    // execute after 9k + 4 retired instructions
+    uint64_t store = CODE + 4 * 4;
+    cpu.set_breakpoint(store);
+    RunResult result = history.reverse_continue();
+    CHECK(result.reason == StopReason::Breakpoint);
+    CHECK_EQ(cpu.get_registers().get_pc(), store);
+    uint64_t at = history.position();
+    CHECK_EQ(at % 9, uint64_t{4});
+    CHECK(at < STEPS && at + 9 >= STEPS);
+    CHECK(state_of(cpu) == reference[at].registers);
+
+    // The next one back is an iteration earlier
+    history.reverse_continue();
+    CHECK_EQ(history.position(), at - 9);
+    CHECK(state_of(cpu) == reference[at - 9].registers);
+}
+
+struct CountingObserver : ExecutionObserver {
+    uint64_t retired{0};
+    void on_retire(const RetiredInstruction&) override { ++retired; }
+};
+
+// Replaying to a past position re-executes instructions observers have
+// already seen; they must not see them twice
+void check_observers_not_replayed() {
+    const char* trace_path = "test_history.trace";
+    CPU cpu;
+    set_up(cpu);
+    CountingObserver counter;
+    TraceWriter trace(trace_path);
+    CacheHierarchy caches(CacheHierarchy::Config::parse("default"));
+    cpu.add_observer(&counter);
+    cpu.add_observer(&trace);
+    cpu.add_observer(&caches);
+
+    ExecutionHistory history(cpu, 4);
+    history.run_for(10);
+    history.step_back(5);
+    CHECK_EQ(counter.retired, uint64_t{10});
+    CHECK_EQ(trace.record_count(), uint64_t{10});
+    CHECK_EQ(caches.l1i().hits + caches.l1i().misses, uint64_t{10});
+
+    // Forward to the STUR of the next iteration and back to that of this one
+    cpu.set_breakpoint(CODE + 4 * 4);
+    RunResult forward = history.run_for(20);
+    CHECK(forward.reason == StopReason::Breakpoint);
+    uint64_t seen = 10 + forward.instructions;
+    CHECK_EQ(counter.retired, seen);
+    CHECK(history.reverse_continue().reason == StopReason::Breakpoint);
+    CHECK_EQ(counter.retired, seen);
+    CHECK_EQ(trace.record_count(), seen);
+
+    // Running forward again is new execution and is reported
+    history.run_for(3);
+    CHECK_EQ(counter.retired, seen + 3);
+    trace.close();
+    std::remove(trace_path);
+}
+
+} // namespace
+
+int main() {
+    std::vector<Recorded> reference = record_reference();
+    CHECK_EQ(reference.size(), static_cast<size_t>(STEPS + 1));
+    for (ExecutionEngine engine : {ExecutionEngine::Switch, ExecutionEngine::Threaded,
+                                   ExecutionEngine::Block, ExecutionEngine::Jit}) {
+        check_step_back(engine, reference);
+    }
+    check_reverse_continue(reference);
+    check_observers_not_replayed();
+    return test_result();
+}
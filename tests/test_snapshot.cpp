@@ -0,0 +1,310 @@
+// Snapshots, in memory and in files, must resume exactly where they were taken.
+#include "test_support.hpp"
+
+#include "mapped_file.hpp"
+#include "snapshot_file.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+using namespace arm_emulator;
+using namespace arm_test;
+using namespace arm_test::encode;
+
+namespace {
+
+constexpr uint64_t CODE = 0x400000;
+constexpr uint64_t DATA = 0x800000;
+constexpr uint64_t DATA_SIZE = 0x4000;
+constexpr const char* SNAPSHOT_PATH = "test_snapshot.armsnap";
+
+// Mixes X1-X3 and V0-V1 into memory DATA_SIZE / 8 times, setting flags and
+// selecting on them as it goes
+std::vector<uint32_t> program() {
+    return {
+        adds(1, 1, 2),               // loop:
+        eor(2, 2, 1),
+        subs(XZR, 1, 2),
+        csel(3, 1, 2, 8),            // HI
+        stur(3, 20, 0),
+        addi(20, 20, 8),
+        simd(0, 0, 0, 0, 1, 2),      // VADD V0.4S, V0.4S, V1.4S
+        st1(0, 21, true),
+        subi(28, 28, 1),
+        cbnz(28, -9),
+        halt(),
+    };
+}
+
+void set_up(CPU& cpu) {
+    cpu.load_program(to_bytes(program()), CODE);
+    Registers& registers = cpu.get_registers();
+    registers.set_register(1, 0x0123456789ABCDEFULL);
+    registers.set_register(2, 0xFEDCBA9876543210ULL);
+    registers.set_register(20, DATA);
+    registers.set_register(21, DATA + DATA_SIZE / 2);
+    registers.set_register(28, DATA_SIZE / 32);
+    for (uint8_t i = 0; i < 16; ++i) {
+        registers.vector(0).bytes[i] = i;
+        registers.vector(1).bytes[i] = static_cast<uint8_t>(0x11 * i);
+    }
+}
+
+bool same_machine(const CPU& a, const CPU& b) {
+    return state_of(a) == state_of(b) && a.is_running() == b.is_running() &&
+           memory_of(a, DATA, DATA_SIZE) == memory_of(b, DATA, DATA_SIZE) &&
+           memory_of(a, CODE, program().size() * 4) == memory_of(b, CODE, program().size() * 4);
+}
+
+void check_file_round_trip(ExecutionEngine engine) {
+    CPU original(Memory::DEFAULT_SIZE, engine);
+    set_up(original);
+    CHECK(original.run_for(301).reason == StopReason::InstructionLimit);
+    CHECK(original.save_snapshot(SNAPSHOT_PATH));
+
+    CPU loaded(Memory::DEFAULT_SIZE, engine);
+    CHECK(loaded.load_snapshot(SNAPSHOT_PATH));
+    CHECK(same_machine(loaded, original));
+
+    // Both finish identically, and writes to the loaded pages stay private
+    RunResult expected = original.run();
+    RunResult result = loaded.run();
+    CHECK(expected.reason == StopReason::Halted);
+    CHECK(result.reason == expected.reason);
+    CHECK_EQ(result.instructions, expected.instructions);
+    CHECK(same_machine(loaded, original));
+
+    CPU reloaded(Memory::DEFAULT_SIZE, engine);
+    CHECK(reloaded.load_snapshot(SNAPSHOT_PATH));
+    CHECK(reloaded.is_running());
+    CHECK(!same_machine(reloaded, loaded));
+    std::remove(SNAPSHOT_PATH);
+}
+
+void check_in_memory_round_trip() {
+    CPU cpu;
+    set_up(cpu);
+    cpu.run_for(123);
+    CPU::Snapshot snapshot = cpu.snapshot();
+    std::unique_ptr<CPU> fork = cpu.fork();
+    CHECK(same_machine(*fork, cpu));
+
+    RunResult first = cpu.run();
+    std::string finished = state_of(cpu);
+    std::string finished_memory = memory_of(cpu, DATA, DATA_SIZE);
+
+    // The fork is unaffected by the original's writes
+    CHECK(!same_machine(*fork, cpu));
+
+    cpu.restore(snapshot);
+    CHECK(same_machine(*fork, cpu));
+    RunResult second = cpu.run();
+    CHECK_EQ(second.instructions, first.instructions);
+    CHECK_EQ(state_of(cpu), finished);
+    CHECK(memory_of(cpu, DATA, DATA_SIZE) == finished_memory);
+
+    RunResult forked = fork->run();
+    CHECK_EQ(forked.instructions, first.instructions);
+    CHECK(same_machine(*fork, cpu));
+}
+
+void check_missing_file() {
+    CPU cpu;
+    set_up(cpu);
+    std::string before = state_of(cpu);
+    CHECK(!cpu.load_snapshot("does-not-exist.armsnap"));
+    CHECK_EQ(state_of(cpu), before);
+}
+
+std::vector<uint8_t> read_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+void write_file(const std::string& path, const std::vector<uint8_t>& bytes) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+}
+
+void put(std::vector<uint8_t>& bytes, size_t offset, uint64_t value, size_t size = 8) {
+    for (size_t i = 0; i < size; ++i) bytes[offset + i] = static_cast<uint8_t>(value >> (i * 8));
+}
+
+uint64_t get(const std::vector<uint8_t>& bytes, size_t offset) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < 8; ++i) value |= static_cast<uint64_t>(bytes[offset + i]) << (i * 8);
+    return value;
+}
+
+// Header field offsets (see SnapshotFile)
+constexpr size_t VERSION_FIELD = 8;
+constexpr size_t REGISTER_COUNT_FIELD = 24;
+constexpr size_t PAGE_COUNT_FIELD = 40;
+constexpr size_t PAGE_TABLE_FIELD = 48;
+constexpr size_t DATA_OFFSET_FIELD = 56;
+
+// A corrupted header must be rejected before anything is read through it,
+// leaving the machine as it was
+void check_corrupted_headers() {
+    CPU original;
+    set_up(original);
+    original.run_for(50);
+    CHECK(original.save_snapshot(SNAPSHOT_PATH));
+    const std::vector<uint8_t> good = read_file(SNAPSHOT_PATH);
+    CHECK(good.size() > 64);
+
+    struct Corruption {
+        const char* name;
+        void (*apply)(std::vector<uint8_t>&);
+    };
+    const Corruption corruptions[] = {
+        {"bad magic", [](std::vector<uint8_t>& f) { f[0] = 'X'; }},
+        {"bad version", [](std::vector<uint8_t>& f) { put(f, VERSION_FIELD, 99, 4); }},
+        {"truncated header", [](std::vector<uint8_t>& f) { f.resize(40); }},
+        {"truncated pages", [](std::vector<uint8_t>& f) { f.resize(f.size() - 1); }},
+        {"register count", [](std::vector<uint8_t>& f) { put(f, REGISTER_COUNT_FIELD, ~0ULL / 4); }},
+        // page_table_offset + page_count * 8 wraps to a small value
+        {"wrapping page table", [](std::vector<uint8_t>& f) { put(f, PAGE_TABLE_FIELD, ~0ULL - 7); }},
+        {"page table past data", [](std::vector<uint8_t>& f) { put(f, PAGE_TABLE_FIELD, f.size()); }},
+        {"wrapping page count", [](std::vector<uint8_t>& f) { put(f, PAGE_COUNT_FIELD, 1ULL << 61); }},
+        {"huge page count", [](std::vector<uint8_t>& f) { put(f, PAGE_COUNT_FIELD, 1ULL << 40); }},
+        {"data past end", [](std::vector<uint8_t>& f) { put(f, DATA_OFFSET_FIELD, f.size() + Memory::PAGE_SIZE); }},
+        {"unaligned data", [](std::vector<uint8_t>& f) { put(f, DATA_OFFSET_FIELD, Memory::PAGE_SIZE + 8); }},
+        {"bad page address", [](std::vector<uint8_t>& f) { put(f, get(f, PAGE_TABLE_FIELD), 123); }},
+    };
+
+    for (const Corruption& corruption : corruptions) {
+        std::vector<uint8_t> bytes = good;
+        corruption.apply(bytes);
+        write_file(SNAPSHOT_PATH, bytes);
+
+        Registers registers;
+        Memory memory(Memory::DEFAULT_SIZE);
+        bool rejected = false;
+        try {
+            SnapshotFile::load(SNAPSHOT_PATH, registers, memory);
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        CHECK(rejected);
+        if (!rejected) std::cout << "  accepted: " << corruption.name << "\n";
+
+        CPU cpu;
+        set_up(cpu);
+        std::string before = state_of(cpu);
+        CHECK(!cpu.load_snapshot(SNAPSHOT_PATH));
+        CHECK_EQ(state_of(cpu), before);
+    }
+    std::remove(SNAPSHOT_PATH);
+}
+
+constexpr uint64_t LEGACY_NZCV = 0x60000000;  // Z and C
+
+// A file in the layout of an older version: version 1 lacks NZCV and both
+// 1 and 2 lack the vector registers. Holds one page of data at DATA.
+std::vector<uint8_t> legacy_snapshot(uint32_t version, uint64_t register_count) {
+    constexpr uint64_t HEADER_SIZE = 64;
+    uint64_t table_offset = HEADER_SIZE + register_count * 8;
+    std::vector<uint8_t> bytes(2 * Memory::PAGE_SIZE);
+    std::memcpy(bytes.data(), "ARMSNAP", 8);
+    put(bytes, VERSION_FIELD, version, 4);
+    put(bytes, VERSION_FIELD + 4, 1, 4);  // Running
+    put(bytes, 16, Memory::DEFAULT_SIZE);
+    put(bytes, REGISTER_COUNT_FIELD, register_count);
+    put(bytes, 32, Memory::PAGE_SIZE);
+    put(bytes, PAGE_COUNT_FIELD, 1);
+    put(bytes, PAGE_TABLE_FIELD, table_offset);
+    put(bytes, DATA_OFFSET_FIELD, Memory::PAGE_SIZE);
+    for (uint64_t i = 0; i < register_count; ++i) {
+        put(bytes, HEADER_SIZE + i * 8, i == TOTAL_REGISTERS - 1 ? LEGACY_NZCV : 0x100 + i);
+    }
+    put(bytes, table_offset, DATA);
+    for (uint64_t i = 0; i < Memory::PAGE_SIZE; ++i) bytes[Memory::PAGE_SIZE + i] = static_cast<uint8_t>(i + version);
+    return bytes;
+}
+
+void check_older_versions() {
+    const size_t nzcv = TOTAL_REGISTERS - 1;
+    for (uint32_t version : {1u, 2u}) {
+        uint64_t register_count = version == 1 ? nzcv : TOTAL_REGISTERS;
+        write_file(SNAPSHOT_PATH, legacy_snapshot(version, register_count));
+
+        CPU cpu;
+        set_up(cpu);  // Leaves V0 and V1 non-zero
+        CHECK(cpu.load_snapshot(SNAPSHOT_PATH));
+        CHECK(cpu.is_running());
+        const Registers& registers = cpu.get_registers();
+        CHECK_EQ(registers.get_register(0), uint64_t{0x100});
+        CHECK_EQ(registers.get_pc(), uint64_t{0x100 + static_cast<size_t>(SpecialRegister::PC)});
+        CHECK_EQ(registers.get_register(nzcv), version == 1 ? uint64_t{0} : LEGACY_NZCV);
+        CHECK_EQ(registers.vector(0).get<uint64_t>(0), uint64_t{0});
+        CHECK_EQ(registers.vector(1).get<uint64_t>(1), uint64_t{0});
+        CHECK_EQ(cpu.get_memory().read8(DATA + 5), static_cast<uint8_t>(5 + version));
+
+        // The register count must be the one of the file's version
+        write_file(SNAPSHOT_PATH, legacy_snapshot(version, version == 1 ? TOTAL_REGISTERS : nzcv));
+        CHECK(!cpu.load_snapshot(SNAPSHOT_PATH));
+    }
+
+    // Newer versions are refused rather than misread
+    std::vector<uint8_t> newer = legacy_snapshot(2, TOTAL_REGISTERS);
+    put(newer, VERSION_FIELD, SnapshotFile::VERSION + 1, 4);
+    write_file(SNAPSHOT_PATH, newer);
+    CPU cpu;
+    CHECK(!cpu.load_snapshot(SNAPSHOT_PATH));
+    std::remove(SNAPSHOT_PATH);
+}
+
+// A large lazily mapped segment, mostly .bss: only its file data and the
+// pages the guest touched belong in a snapshot
+void check_lazy_regions() {
+    const std::string image_path = "test_snapshot_image.bin";
+    std::vector<uint8_t> image(2 * Memory::PAGE_SIZE + 100);
+    for (size_t i = 0; i < image.size(); ++i) image[i] = static_cast<uint8_t>(i * 7 + 1);
+    write_file(image_path, image);
+
+    constexpr uint64_t SEGMENT = 0x10000000;
+    constexpr uint64_t SEGMENT_SIZE = 64ULL << 20;
+    CPU cpu;
+    cpu.get_memory().map_file_lazy(SEGMENT, SEGMENT_SIZE, MappedFile::open(image_path), 0, image.size());
+    cpu.get_memory().write64(SEGMENT + SEGMENT_SIZE / 2, 42);
+
+    // Three pages of file data and the one written; none are populated to list them
+    size_t dirty = cpu.get_memory().dirty_pages();
+    std::vector<uint64_t> visited;
+    cpu.get_memory().for_each_page([&](uint64_t address, const uint8_t*) { visited.push_back(address); });
+    std::vector<uint64_t> expected = {SEGMENT, SEGMENT + Memory::PAGE_SIZE, SEGMENT + 2 * Memory::PAGE_SIZE,
+                                      SEGMENT + SEGMENT_SIZE / 2};
+    CHECK(visited == expected);
+    CHECK_EQ(cpu.get_memory().dirty_pages(), dirty);
+
+    CHECK(cpu.save_snapshot(SNAPSHOT_PATH));
+    CHECK(read_file(SNAPSHOT_PATH).size() < 16 * Memory::PAGE_SIZE);
+
+    CPU loaded;
+    CHECK(loaded.load_snapshot(SNAPSHOT_PATH));
+    CHECK(memory_of(loaded, SEGMENT, 3 * Memory::PAGE_SIZE) == memory_of(cpu, SEGMENT, 3 * Memory::PAGE_SIZE));
+    CHECK_EQ(loaded.get_memory().read64(SEGMENT + SEGMENT_SIZE / 2), uint64_t{42});
+    CHECK_EQ(loaded.get_memory().read8(SEGMENT + image.size() - 1), image.back());
+    CHECK_EQ(loaded.get_memory().read8(SEGMENT + image.size()), uint8_t{0});
+    std::remove(SNAPSHOT_PATH);
+    std::remove(image_path.c_str());
+}
+
+} // namespace
+
+int main() {
+    for (ExecutionEngine engine : {ExecutionEngine::Switch, ExecutionEngine::Threaded,
+                                   ExecutionEngine::Block, ExecutionEngine::Jit}) {
+        check_file_round_trip(engine);
+    }
+    check_in_memory_round_trip();
+    check_missing_file();
+    check_corrupted_headers();
+    check_lazy_regions();
+    check_older_versions();
+    return test_result();
+}
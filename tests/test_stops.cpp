@@ -0,0 +1,190 @@
+// Breakpoints, watchpoints and run_until must stop every engine at the same
+// place, with the same reason and the same number of retired instructions.
+#include "test_support.hpp"
+
+using namespace arm_emulator;
+using namespace arm_test;
+using namespace arm_test::encode;
+
+namespace {
+
+constexpr uint64_t CODE = 0x400000;
+constexpr uint64_t DATA = 0x800000;
+constexpr uint64_t ITERATIONS = 10;
+
+// Offsets of the loop's instructions
+constexpr uint64_t STORE = CODE + 1 * 4;
+constexpr uint64_t LOAD = CODE + 2 * 4;
+constexpr uint64_t DECREMENT = CODE + 3 * 4;
+constexpr uint64_t HALT = CODE + 5 * 4;
+constexpr uint64_t LOOP_LENGTH = 5;
+
+// Counts X1 up, storing each value to DATA and loading it back into X2
+std::vector<uint32_t> program() {
+    return {
+        addi(1, 1, 1),      // loop:
+        stur(1, 20, 0),
+        ldur(2, 21, 0),
+        subi(28, 28, 1),
+        cbnz(28, -4),
+        halt(),
+    };
+}
+
+void set_up(CPU& cpu) {
+    cpu.load_program(to_bytes(program()), CODE);
+    Registers& registers = cpu.get_registers();
+    registers.set_register(20, DATA);
+    registers.set_register(21, DATA - 4096);
+    registers.set_register(28, ITERATIONS);
+}
+
+uint64_t reg(const CPU& cpu, size_t index) { return cpu.get_registers().get_register(index); }
+uint64_t pc(const CPU& cpu) { return cpu.get_registers().get_pc(); }
+
+// Instructions retired by an uninterrupted run, halt included
+uint64_t full_run(ExecutionEngine engine) {
+    CPU cpu(Memory::DEFAULT_SIZE, engine);
+    set_up(cpu);
+    RunResult result = cpu.run();
+    CHECK(result.reason == StopReason::Halted);
+    CHECK_EQ(reg(cpu, 1), ITERATIONS);
+    return result.instructions;
+}
+
+// Running again from a breakpoint executes past it, and the next stop is
+// one loop iteration later
+void check_breakpoint_resume(ExecutionEngine engine, uint64_t total) {
+    CPU cpu(Memory::DEFAULT_SIZE, engine);
+    set_up(cpu);
+    cpu.set_breakpoint(LOAD);
+
+    RunResult first = cpu.run();
+    CHECK(first.reason == StopReason::Breakpoint);
+    CHECK_EQ(first.instructions, uint64_t{2});
+    CHECK_EQ(pc(cpu), LOAD);
+    CHECK_EQ(reg(cpu, 2), uint64_t{0});
+
+    RunResult second = cpu.run();
+    CHECK(second.reason == StopReason::Breakpoint);
+    CHECK_EQ(second.instructions, LOOP_LENGTH);
+    CHECK_EQ(pc(cpu), LOAD);
+    CHECK_EQ(reg(cpu, 1), uint64_t{2});
+    CHECK_EQ(reg(cpu, 2), uint64_t{1});
+
+    // Stepping from a breakpoint also executes past it
+    CHECK(cpu.step_instruction());
+    CHECK_EQ(pc(cpu), DECREMENT);
+    CHECK_EQ(reg(cpu, 2), uint64_t{2});
+
+    // A limit that runs out exactly at the breakpoint reports the limit
+    RunResult limited = cpu.run_for(LOOP_LENGTH - 1);
+    CHECK(limited.reason == StopReason::InstructionLimit);
+    CHECK_EQ(limited.instructions, LOOP_LENGTH - 1);
+    CHECK_EQ(pc(cpu), LOAD);
+    RunResult stopped = cpu.run_for(LOOP_LENGTH);
+    CHECK(stopped.reason == StopReason::Breakpoint);
+    CHECK_EQ(stopped.instructions, uint64_t{0});
+
+    cpu.clear_breakpoint(LOAD);
+    RunResult rest = cpu.run();
+    CHECK(rest.reason == StopReason::Halted);
+    CHECK_EQ(first.instructions + second.instructions + 1 + limited.instructions + rest.instructions,
+             total);
+    CHECK_EQ(reg(cpu, 1), ITERATIONS);
+}
+
+// The access that hits a watchpoint retires and execution stops before the
+// next instruction; running again continues from there
+void check_watchpoints(ExecutionEngine engine, uint64_t total) {
+    CPU cpu(Memory::DEFAULT_SIZE, engine);
+    set_up(cpu);
+    cpu.set_watchpoint(DATA, 8, Memory::WatchKind::Write);
+
+    RunResult first = cpu.run();
+    CHECK(first.reason == StopReason::Watchpoint);
+    CHECK_EQ(first.instructions, uint64_t{2});
+    CHECK_EQ(pc(cpu), LOAD);
+    CHECK_EQ(cpu.get_memory().read64(DATA), uint64_t{1});
+    CHECK_EQ(cpu.get_watch_hit().address, DATA);
+    CHECK_EQ(cpu.get_watch_hit().size, size_t{8});
+    CHECK(cpu.get_watch_hit().write);
+    CHECK(cpu.is_running());
+
+    RunResult second = cpu.run();
+    CHECK(second.reason == StopReason::Watchpoint);
+    CHECK_EQ(second.instructions, LOOP_LENGTH);
+    CHECK_EQ(pc(cpu), LOAD);
+    CHECK_EQ(cpu.get_memory().read64(DATA), uint64_t{2});
+
+    // Loads only stop a read watchpoint, after the load has written X2
+    CHECK(cpu.clear_watchpoint(DATA));
+    cpu.set_watchpoint(DATA + 4, 1, Memory::WatchKind::Read);
+    RunResult read = cpu.run();
+    CHECK(read.reason == StopReason::Watchpoint);
+    CHECK_EQ(read.instructions, uint64_t{1});
+    CHECK_EQ(pc(cpu), DECREMENT);
+    CHECK_EQ(reg(cpu, 2), uint64_t{2});
+    CHECK_EQ(cpu.get_watch_hit().address, DATA);
+    CHECK(!cpu.get_watch_hit().write);
+
+    CHECK(cpu.clear_watchpoint(DATA + 4));
+    RunResult rest = cpu.run();
+    CHECK(rest.reason == StopReason::Halted);
+    CHECK_EQ(first.instructions + second.instructions + read.instructions + rest.instructions, total);
+}
+
+// run_until's target is a breakpoint only while it runs; a user breakpoint
+// at the same address outlives it
+void check_run_until(ExecutionEngine engine, uint64_t total) {
+    CPU cpu(Memory::DEFAULT_SIZE, engine);
+    set_up(cpu);
+
+    RunResult reached = cpu.run_until(DECREMENT);
+    CHECK(reached.reason == StopReason::AddressReached);
+    CHECK_EQ(reached.instructions, uint64_t{3});
+    CHECK_EQ(pc(cpu), DECREMENT);
+
+    // Starting at the target goes once around the loop
+    RunResult around = cpu.run_until(DECREMENT);
+    CHECK(around.reason == StopReason::AddressReached);
+    CHECK_EQ(around.instructions, LOOP_LENGTH);
+    CHECK_EQ(pc(cpu), DECREMENT);
+
+    // The temporary breakpoint is gone
+    RunResult rest = cpu.run();
+    CHECK(rest.reason == StopReason::Halted);
+    CHECK_EQ(reached.instructions + around.instructions + rest.instructions, total);
+
+    CPU shared(Memory::DEFAULT_SIZE, engine);
+    set_up(shared);
+    shared.set_breakpoint(STORE);
+    RunResult target = shared.run_until(STORE);
+    CHECK(target.reason == StopReason::AddressReached);
+    CHECK_EQ(target.instructions, uint64_t{1});
+    RunResult user = shared.run();
+    CHECK(user.reason == StopReason::Breakpoint);
+    CHECK_EQ(user.instructions, LOOP_LENGTH);
+    CHECK_EQ(pc(shared), STORE);
+    CHECK_EQ(reg(shared, 1), uint64_t{2});
+
+    // A user breakpoint short of the target stops the run as usual
+    RunResult early = shared.run_until(HALT);
+    CHECK(early.reason == StopReason::Breakpoint);
+    CHECK_EQ(early.instructions, LOOP_LENGTH);
+    CHECK_EQ(pc(shared), STORE);
+}
+
+} // namespace
+
+int main() {
+    for (ExecutionEngine engine : {ExecutionEngine::Switch, ExecutionEngine::Threaded,
+                                   ExecutionEngine::Block, ExecutionEngine::Jit}) {
+        uint64_t total = full_run(engine);
+        CHECK_EQ(total, ITERATIONS * LOOP_LENGTH + 1);
+        check_breakpoint_resume(engine, total);
+        check_watchpoints(engine, total);
+        check_run_until(engine, total);
+    }
+    return test_result();
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "cpu.hpp"
+#include "encode.hpp"
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Shared by the test programs. Each test is its own executable; a failed
+// CHECK prints where and why, and main returns test_result() so ctest sees
+// a non-zero exit status.
+namespace arm_test {
+
+inline int& failures() {
+    static int count = 0;
+    return count;
+}
+
+inline int test_result() {
+    if (failures() == 0) {
+        std::cout << "All checks passed\n";
+        return 0;
+    }
+    std::cout << failures() << " check(s) failed\n";
+    return 1;
+}
+
+#define CHECK(condition)                                                           \
+    do {                                                                           \
+        if (!(condition)) {                                                        \
+            ++arm_test::failures();                                                \
+            std::cout << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed\n"; \
+        }                                                                          \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                                 \
+    do {                                                                           \
+        const auto& check_actual = (actual);                                       \
+        const auto& check_expected = (expected);                                   \
+        if (!(check_actual == check_expected)) {                                   \
+            ++arm_test::failures();                                                \
+            std::cout << __FILE__ << ":" << __LINE__ << ": " #actual " is "        \
+                      << check_actual << ", expected " << check_expected << "\n";  \
+        }                                                                          \
+    } while (0)
+
+// Guest programs are built with the benchmark suite's encoders
+namespace encode = arm_bench::encode;
+using encode::to_bytes;
+
+// Registers (including NZCV and V0-V31) as text, for comparing machine states
+inline std::string state_of(const arm_emulator::CPU& cpu) {
+    return cpu.get_state();
+}
+
+// Memory contents of [address, address + size) as text
+inline std::string memory_of(const arm_emulator::CPU& cpu, uint64_t address, uint64_t size) {
+    std::string text;
+    for (uint64_t offset = 0; offset < size; offset += 8) {
+        text += std::to_string(cpu.get_memory().read64(address + offset)) + " ";
+    }
+    return text;
+}
+
+} // namespace arm_test
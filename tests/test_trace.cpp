@@ -0,0 +1,146 @@
+// A trace read back must hold exactly the records the CPU retired.
+#include "test_support.hpp"
+
+#include "decoder.hpp"
+#include "trace.hpp"
+
+#include <cstdio>
+#include <random>
+
+using namespace arm_emulator;
+using namespace arm_test;
+using namespace arm_test::encode;
+
+namespace {
+
+constexpr uint64_t CODE = 0x400000;
+constexpr uint64_t DATA = 0x800000;
+constexpr uint64_t DATA_SIZE = 0x1000;
+constexpr const char* TRACE_PATH = "test_trace.armtrace";
+
+// Small enough that the CPU laps the writer thread and has to wait for it
+constexpr size_t RING_CAPACITY = 64;
+
+struct Recorder : ExecutionObserver {
+    std::vector<RetiredInstruction> records;
+    void on_retire(const RetiredInstruction& retired) override { records.push_back(retired); }
+};
+
+uint32_t data_register(std::mt19937_64& rng) { return 1 + static_cast<uint32_t>(rng() % 12); }
+
+// A loop over a random body with every kind of record the codec
+// distinguishes: register writes of small and large deltas, loads (also
+// into XZR), stores, SIMD accesses, and taken and untaken branches
+std::vector<uint32_t> random_program(std::mt19937_64& rng) {
+    std::vector<uint32_t> body;
+    size_t length = 4 + rng() % 28;
+    while (body.size() < length) {
+        uint32_t rd = data_register(rng), rn = data_register(rng), rm = data_register(rng);
+        uint32_t offset = static_cast<uint32_t>(rng() % 512) * 8;
+        switch (rng() % 9) {
+            case 0:
+                body.push_back(rng() % 2 ? add(rd, rn, rm) : eor(rd, rn, rm));
+                break;
+            case 1:
+                body.push_back(rng() % 2 ? addi(rd, rn, static_cast<uint32_t>(rng() % 4096))
+                                         : subi(rd, rn, static_cast<uint32_t>(rng() % 4096)));
+                break;
+            case 2:
+                body.push_back(subs(rd, rn, rm));
+                break;
+            case 3:
+                body.push_back(ldur(rng() % 4 ? rd : XZR, 21, offset));
+                break;
+            case 4:
+                body.push_back(stur(rn, 20, offset));
+                break;
+            case 5:
+                body.push_back(b_cond(static_cast<uint32_t>(rng() % 15), 2));
+                break;
+            case 6:
+                body.push_back(rng() % 2 ? cbz(rn, 2) : cbnz(rn, 2));
+                break;
+            case 7:
+                body.push_back(rng() % 2 ? ld1(static_cast<uint32_t>(rng() % 4), 22)
+                                         : st1(static_cast<uint32_t>(rng() % 4), 22));
+                break;
+            default:
+                body.push_back(umov(rd, static_cast<uint32_t>(rng() % 4), 3, static_cast<uint32_t>(rng() % 2)));
+                break;
+        }
+    }
+    body.push_back(addi(XZR, XZR, 0));  // Landing pad for skips at the end
+    body.push_back(subi(28, 28, 1));
+    body.push_back(cbnz(28, -static_cast<int32_t>(body.size() - 1)));
+    body.push_back(halt());
+    return body;
+}
+
+void set_up(CPU& cpu, const std::vector<uint32_t>& code, std::mt19937_64& rng) {
+    cpu.load_program(to_bytes(code), CODE);
+    Registers& registers = cpu.get_registers();
+    for (size_t r = 1; r <= 12; ++r) {
+        // Mostly small values, so both short and long deltas are written
+        registers.set_register(r, rng() % 2 ? rng() % 256 : rng());
+    }
+    for (size_t v = 0; v < 4; ++v) {
+        for (uint8_t& byte : registers.vector(v).bytes) byte = static_cast<uint8_t>(rng());
+    }
+    registers.set_register(20, DATA);
+    registers.set_register(21, DATA - 4096);
+    registers.set_register(22, DATA + DATA_SIZE);
+    registers.set_register(28, 1 + rng() % 50);
+    for (uint64_t offset = 0; offset < DATA_SIZE; offset += 8) {
+        cpu.get_memory().write64(DATA + offset, rng() % 4 ? rng() : 0);
+    }
+}
+
+// Every field the trace carries; the access size is not recorded
+bool same(const RetiredInstruction& a, const RetiredInstruction& b) {
+    return a.pc == b.pc && a.next_pc == b.next_pc && a.word == b.word && a.dest == b.dest &&
+           a.memory == b.memory && a.write == b.write && a.dest_value == b.dest_value &&
+           (!a.memory || (a.address == b.address && a.value == b.value));
+}
+
+void check_round_trip(std::mt19937_64& rng, int programs) {
+    for (int program = 0; program < programs; ++program) {
+        std::vector<uint32_t> code = random_program(rng);
+        CPU cpu;
+        set_up(cpu, code, rng);
+        Recorder recorder;
+        TraceWriter trace(TRACE_PATH, RING_CAPACITY);
+        cpu.add_observer(&recorder);
+        cpu.add_observer(&trace);
+        RunResult result = cpu.run_for(1000000);
+        CHECK(result.reason == StopReason::Halted);
+        trace.close();
+        CHECK_EQ(trace.record_count(), static_cast<uint64_t>(recorder.records.size()));
+
+        TraceReader reader(TRACE_PATH);
+        RetiredInstruction read;
+        size_t count = 0;
+        bool matches = true;
+        while (matches && reader.next(read)) {
+            matches = count < recorder.records.size() && same(read, recorder.records[count]);
+            ++count;
+        }
+        CHECK(matches);
+        CHECK_EQ(count, recorder.records.size());
+        if (!matches) {
+            std::cout << "  record " << count - 1 << " differs on:\n";
+            for (uint32_t word : code) {
+                std::cout << "    " << Decoder::decode(word).to_string() << "\n";
+            }
+            break;
+        }
+    }
+    std::remove(TRACE_PATH);
+}
+
+} // namespace
+
+int main() {
+    std::mt19937_64 rng(2025);
+    check_round_trip(rng, 200);
+    return test_result();
+}
@@ -0,0 +1,46 @@
+// arm_trace.cpp - print a binary execution trace as text
+#include "decoder.hpp"
+#include "trace.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <trace> [max_records]\n";
+        return 1;
+    }
+    
+    try {
+        arm_emulator::TraceReader reader(argv[1]);
+        uint64_t max_records = argc > 2 ? std::stoull(argv[2], nullptr, 0) : ~0ULL;
+        
+        arm_emulator::RetiredInstruction retired;
+        std::cout << std::hex << std::setfill('0');
+        for (uint64_t count = 0; count < max_records && reader.next(retired); ++count) {
+            std::string text = arm_emulator::Decoder::decode(retired.word).to_string();
+            std::cout << "0x" << std::setw(8) << retired.pc << ": " << std::setw(8) << retired.word
+                      << "  " << text;
+            
+            // Results after the disassembly, lined up where the text allows
+            std::cout << std::string(text.size() < 28 ? 28 - text.size() : 1, ' ');
+            if (retired.dest != arm_emulator::RetiredInstruction::NO_REGISTER) {
+                std::cout << " X" << std::dec << static_cast<int>(retired.dest) << std::hex
+                          << "=0x" << retired.dest_value;
+            }
+            if (retired.memory) {
+                std::cout << (retired.write ? " store" : " load") << " [0x" << retired.address
+                          << "]=0x" << retired.value;
+            }
+            if (retired.next_pc != retired.pc + 4) {
+                std::cout << " -> 0x" << retired.next_pc;
+            }
+            std::cout << "\n";
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}